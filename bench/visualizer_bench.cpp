@@ -0,0 +1,435 @@
+﻿#include "xyzi_loader.h"
+#include "points_cloud.h"
+#include "cloud_stats.h"
+#include "voxel_filter.h"
+#include "viewer_2d.h"
+#include "viewer_3d.h"
+#include "latency_stats.h"
+#include "opencv2/core/utility.hpp"
+#include "opencv2/highgui.hpp"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+#define DEFAULT_REPEAT			5
+#define BENCH_VIEW_SIZE			800
+#define TEXT_LINE_BYTES			36		//生成的文本点云每行"%9.3f %9.3f %9.3f %5.1f\n"
+#define CLOUD_RADIUS			400		//生成的点云在相机默认距离下完整可见
+#define ZOOM_STEPS				8		//2d会话中连续放大、缩小的次数
+#define PAN_STEPS				40		//2d会话中拖动平移的次数
+#define ORBIT_STEPS				8		//3d绘制时环绕的相机角度数
+#define APPEND_FRACTION			100		//增量统计时追加的点占总点数的1/100
+
+using namespace cv;
+
+/* 一项基准在一个规模下的结果 */
+struct BenchResult {
+	std::string name;
+	std::string sizeUnit;				//"points"或"megapixels"
+	double size;
+	LatencyStats samples;				//每次操作的耗时，毫秒
+	std::vector<std::pair<std::string, double> > throughput;
+};
+
+/**
+  * 由序号生成[0, 1)之间的伪随机数，与线程划分无关，结果可复现
+  */
+static float Hash01(uint64_t i)
+{
+	uint64_t z = i * 0x9E3779B97F4A7C15ULL + 0x632BE59BD9B4E019ULL;
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	z ^= z >> 31;
+	return (float)(z >> 40) / (float)(1 << 24);
+}
+
+/**
+  * 生成第i个点：半径CLOUD_RADIUS的球壳内随机分布，强度随高度变化
+  */
+static void SyntheticPoint(size_t i, float& x, float& y, float& z, float& intensity)
+{
+	float u = Hash01(i * 4), v = Hash01(i * 4 + 1), w = Hash01(i * 4 + 2);
+	float theta = u * 2 * (float)CV_PI;
+	float phi = acosf(2 * v - 1);
+	float r = CLOUD_RADIUS * (0.8f + 0.2f * w);
+	x = r * sinf(phi) * cosf(theta);
+	y = r * cosf(phi);
+	z = r * sinf(phi) * sinf(theta);
+	intensity = 50 + 200 * Hash01(i * 4 + 3);
+}
+
+/**
+  * 生成点云，各列并行填写
+  */
+static void GenerateCloud(size_t points, PointsCloud& cloud)
+{
+	cloud.Reset();
+	cloud.Resize(points);
+	parallel_for_(Range(0, (int)((points + 65535) / 65536)), [&](const Range& range) {
+		size_t end = MIN(points, (size_t)range.end * 65536);
+		for (size_t i = (size_t)range.start * 65536; i < end; i++) {
+			SyntheticPoint(i, cloud.x[i], cloud.y[i], cloud.z[i], cloud.intensity[i]);
+		}
+	});
+	cloud.UpdateBoundary();
+}
+
+/**
+  * 生成xyzi文本，每行定长，各行并行写入自己的位置
+  */
+static void GenerateText(size_t points, std::string& text)
+{
+	text.resize(points * TEXT_LINE_BYTES);
+	char* data = &text[0];
+	parallel_for_(Range(0, (int)((points + 65535) / 65536)), [&](const Range& range) {
+		char line[64];
+		size_t end = MIN(points, (size_t)range.end * 65536);
+		for (size_t i = (size_t)range.start * 65536; i < end; i++) {
+			float x, y, z, intensity;
+			SyntheticPoint(i, x, y, z, intensity);
+			snprintf(line, sizeof(line), "%9.3f %9.3f %9.3f %5.1f\n", x, y, z, intensity);
+			memcpy(data + i * TEXT_LINE_BYTES, line, TEXT_LINE_BYTES);
+		}
+	});
+}
+
+/**
+  * 生成4:3的BGR图像，包含渐变与异或纹理，各行并行填写
+  */
+static void GenerateImage(double megapixels, Mat& image)
+{
+	int width = cvRound(sqrt(megapixels * 1e6 * 4 / 3));
+	int height = cvRound(megapixels * 1e6 / width);
+	image.create(height, width, CV_8UC3);
+	parallel_for_(Range(0, height), [&](const Range& range) {
+		for (int y = range.start; y < range.end; y++) {
+			uchar* p = image.ptr<uchar>(y);
+			for (int x = 0; x < width; x++) {
+				p[x * 3] = (uchar)(x * 255 / width);
+				p[x * 3 + 1] = (uchar)(y * 255 / height);
+				p[x * 3 + 2] = (uchar)((x ^ y) & 255);
+			}
+		}
+	});
+}
+
+/**
+  * 文本点云解析吞吐量
+  */
+static BenchResult BenchParse(size_t points, int repeat)
+{
+	BenchResult result;
+	result.name = "cloud_parse";
+	result.sizeUnit = "points";
+	result.size = (double)points;
+
+	std::string text;
+	GenerateText(points, text);
+	PointsCloud cloud;
+	for (int i = 0; i < repeat; i++) {
+		int64 startTick = getTickCount();
+		ParseXyziText(text.data(), text.size(), TextColumns(), cloud);
+		result.samples.Add((getTickCount() - startTick) * 1000 / getTickFrequency());
+		if (cloud.Size() != points) {
+			fprintf(stderr, "cloud_parse: parsed %zu of %zu points\n", cloud.Size(), points);
+		}
+	}
+	double seconds = result.samples.Mean() / 1000;
+	result.throughput.push_back(std::make_pair("Mpoints/s", points / seconds / 1e6));
+	result.throughput.push_back(std::make_pair("MB/s", text.size() / seconds / (1 << 20)));
+	return result;
+}
+
+/**
+  * 逐列计算边界的吞吐量
+  */
+static BenchResult BenchBounds(PointsCloud& cloud, int repeat)
+{
+	BenchResult result;
+	result.name = "bounds";
+	result.sizeUnit = "points";
+	result.size = (double)cloud.Size();
+
+	for (int i = 0; i < repeat; i++) {
+		int64 startTick = getTickCount();
+		cloud.UpdateBoundary();
+		result.samples.Add((getTickCount() - startTick) * 1000 / getTickFrequency());
+	}
+	double seconds = result.samples.Mean() / 1000;
+	result.throughput.push_back(std::make_pair("Mpoints/s", cloud.Size() / seconds / 1e6));
+	result.throughput.push_back(std::make_pair("MB/s", cloud.Size() * 3 * sizeof(float) / seconds / (1 << 20)));
+	return result;
+}
+
+/**
+  * 一次遍历统计包围盒、质心与强度直方图的吞吐量，以及追加1%的点后增量统计的耗时
+  */
+static void BenchStats(const PointsCloud& cloud, int repeat, std::vector<BenchResult>& results)
+{
+	BenchResult full;
+	full.name = "stats";
+	full.sizeUnit = "points";
+	full.size = (double)cloud.Size();
+
+	BenchResult append;
+	append.name = "stats_append";
+	append.sizeUnit = "points";
+	append.size = (double)cloud.Size();
+
+	size_t appended = cloud.Size() / APPEND_FRACTION;
+	size_t existing = cloud.Size() - appended;
+	for (int i = 0; i < repeat; i++) {
+		CloudStats stats;
+		int64 startTick = getTickCount();
+		stats.Compute(cloud);
+		full.samples.Add((getTickCount() - startTick) * 1000 / getTickFrequency());
+
+		//先统计前面的点，再只累加追加的部分
+		stats.Reset();
+		stats.Accumulate(cloud.x.data(), cloud.y.data(), cloud.z.data(), cloud.intensity.data(), existing);
+		startTick = getTickCount();
+		stats.Update(cloud);
+		append.samples.Add((getTickCount() - startTick) * 1000 / getTickFrequency());
+	}
+	double seconds = full.samples.Mean() / 1000;
+	full.throughput.push_back(std::make_pair("Mpoints/s", cloud.Size() / seconds / 1e6));
+	full.throughput.push_back(std::make_pair("MB/s", cloud.Size() * 4 * sizeof(float) / seconds / (1 << 20)));
+	seconds = append.samples.Mean() / 1000;
+	append.throughput.push_back(std::make_pair("appended Mpoints/s", appended / seconds / 1e6));
+	results.push_back(full);
+	results.push_back(append);
+}
+
+/**
+  * 按自动叶子尺寸做体素降采样的吞吐量
+  */
+static BenchResult BenchVoxel(const PointsCloud& cloud, int repeat)
+{
+	BenchResult result;
+	result.name = "voxel_grid";
+	result.sizeUnit = "points";
+	result.size = (double)cloud.Size();
+
+	PointsCloud output;
+	float leafSize = AutoVoxelLeafSize(cloud);
+	for (int i = 0; i < repeat; i++) {
+		int64 startTick = getTickCount();
+		VoxelGridDownsample(cloud, leafSize, output);
+		result.samples.Add((getTickCount() - startTick) * 1000 / getTickFrequency());
+	}
+	double seconds = result.samples.Mean() / 1000;
+	result.throughput.push_back(std::make_pair("Mpoints/s", cloud.Size() / seconds / 1e6));
+	result.throughput.push_back(std::make_pair("output ratio", cloud.Size() > 0 ? (double)output.Size() / cloud.Size() : 0));
+	return result;
+}
+
+/**
+  * 2d视图的平移缩放会话：在窗口中心连续放大，拖动平移，再连续缩小，每个事件后绘制一帧
+  */
+static BenchResult BenchView2d(double megapixels, int repeat)
+{
+	BenchResult result;
+	result.name = "view2d_pan_zoom";
+	result.sizeUnit = "megapixels";
+	result.size = megapixels;
+
+	Mat image;
+	GenerateImage(megapixels, image);
+	Viewer2d viewer("bench 2d", Size(BENCH_VIEW_SIZE, BENCH_VIEW_SIZE));
+	viewer.SetImage(image);
+	viewer.WaitImage();
+
+	int center = BENCH_VIEW_SIZE / 2;
+	int wheelIn = 120 * 65536, wheelOut = -120 * 65536;	//滚动量在flags的高16位
+	std::vector<Vec4i> session;							//event、x、y、flags
+	for (int i = 0; i < ZOOM_STEPS; i++) {
+		session.push_back(Vec4i(CV_EVENT_MOUSEWHEEL, center, center, wheelIn));
+	}
+	session.push_back(Vec4i(CV_EVENT_LBUTTONDOWN, center, center, CV_EVENT_FLAG_LBUTTON));
+	for (int i = 1; i <= PAN_STEPS; i++) {
+		session.push_back(Vec4i(CV_EVENT_MOUSEMOVE, center - i * 5, center - i * 3, CV_EVENT_FLAG_LBUTTON));
+	}
+	session.push_back(Vec4i(CV_EVENT_LBUTTONUP, center - PAN_STEPS * 5, center - PAN_STEPS * 3, 0));
+	for (int i = 0; i < ZOOM_STEPS; i++) {
+		session.push_back(Vec4i(CV_EVENT_MOUSEWHEEL, center, center, wheelOut));
+	}
+
+	Mat frame;
+	for (int r = 0; r < repeat; r++) {
+		viewer.FitToWindow();
+		for (size_t i = 0; i < session.size(); i++) {
+			int64 startTick = getTickCount();
+			if (viewer.InjectMouse(session[i][0], session[i][1], session[i][2], session[i][3])) {
+				viewer.Render(frame);
+				result.samples.Add((getTickCount() - startTick) * 1000 / getTickFrequency());
+			}
+		}
+	}
+	result.throughput.push_back(std::make_pair("frames/s", 1000 / MAX(result.samples.Mean(), 1e-6)));
+	return result;
+}
+
+/**
+  * CPU点云绘制，相机绕点云环绕
+  */
+static BenchResult BenchRender3d(const PointsCloud& cloud, int repeat)
+{
+	BenchResult result;
+	result.name = "render3d_cpu";
+	result.sizeUnit = "points";
+	result.size = (double)cloud.Size();
+
+	Viewer3d viewer("bench 3d", Size(BENCH_VIEW_SIZE, BENCH_VIEW_SIZE));
+	viewer.SetCloud(&cloud);
+	SplatConfig config;
+	config.intensityColors = true;
+	Mat frame;
+	ViewCamera camera = viewer.Camera();
+	for (int r = 0; r < repeat; r++) {
+		for (int i = 0; i < ORBIT_STEPS; i++) {
+			camera.yaw = 360.f * i / ORBIT_STEPS;
+			camera.pitch = 20;
+			viewer.SetCamera(camera);
+			result.samples.Add(viewer.RenderSplats(config, frame));
+		}
+	}
+	double seconds = result.samples.Mean() / 1000;
+	result.throughput.push_back(std::make_pair("Mpoints/s", cloud.Size() / seconds / 1e6));
+	result.throughput.push_back(std::make_pair("frames/s", 1 / seconds));
+	return result;
+}
+
+/**
+  * 解析逗号分隔的数量列表，支持K、M后缀，如"10K,1M"
+  */
+static std::vector<double> ParseList(const char* text)
+{
+	std::vector<double> values;
+	const char* p = text;
+	while (*p != '\0') {
+		char* end;
+		double value = strtod(p, &end);
+		if (end == p) {
+			break;
+		}
+		if (*end == 'K' || *end == 'k') {
+			value *= 1e3;
+			end++;
+		} else if (*end == 'M' || *end == 'm') {
+			value *= 1e6;
+			end++;
+		}
+		values.push_back(value);
+		p = *end == ',' ? end + 1 : end;
+	}
+	return values;
+}
+
+static void WriteResults(FILE* file, const std::vector<BenchResult>& results, int repeat)
+{
+	fprintf(file, "{\n  \"opencv\": \"%s\",\n  \"cpus\": %d,\n  \"threads\": %d,\n  \"repeat\": %d,\n  \"results\": [\n",
+		CV_VERSION, getNumberOfCPUs(), getNumThreads(), repeat);
+	for (size_t i = 0; i < results.size(); i++) {
+		const BenchResult& r = results[i];
+		fprintf(file, "    {\"benchmark\": \"%s\", \"size\": %.17g, \"size_unit\": \"%s\", \"samples\": %zu, "
+			"\"mean_ms\": %.4f, \"p50_ms\": %.4f, \"p90_ms\": %.4f, \"p99_ms\": %.4f, \"max_ms\": %.4f, \"throughput\": {",
+			r.name.c_str(), r.size, r.sizeUnit.c_str(), r.samples.Count(), r.samples.Mean(), r.samples.Percentile(0.5),
+			r.samples.Percentile(0.9), r.samples.Percentile(0.99), r.samples.Percentile(1));
+		for (size_t k = 0; k < r.throughput.size(); k++) {
+			fprintf(file, "%s\"%s\": %.4f", k > 0 ? ", " : "", r.throughput[k].first.c_str(), r.throughput[k].second);
+		}
+		fprintf(file, "}}%s\n", i + 1 < results.size() ? "," : "");
+	}
+	fprintf(file, "  ]\n}\n");
+}
+
+/**
+  * 不依赖显示设备的基准测试，数据全部合成，结果以JSON写到标准输出或--out指定的文件，进度写到标准错误
+  * 用法：visualizer_bench [--points 10K,1M] [--megapixels 1,16] [--repeat n] [--only parse,bounds,stats,voxel,view2d,render3d]
+  *       [--full] [--out result.json]
+  */
+int main(int argc, char** argv)
+{
+	std::vector<double> points = ParseList("10K,100K,1M,10M");
+	std::vector<double> megapixels = ParseList("1,16,100");
+	int repeat = DEFAULT_REPEAT;
+	std::string only = "parse,bounds,stats,voxel,view2d,render3d";
+	std::string outPath;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--points" && i + 1 < argc) {
+			points = ParseList(argv[++i]);
+		} else if (arg == "--megapixels" && i + 1 < argc) {
+			megapixels = ParseList(argv[++i]);
+		} else if (arg == "--repeat" && i + 1 < argc) {
+			repeat = atoi(argv[++i]);
+			repeat = MAX(repeat, 1);
+		} else if (arg == "--only" && i + 1 < argc) {
+			only = argv[++i];
+		} else if (arg == "--out" && i + 1 < argc) {
+			outPath = argv[++i];
+		} else if (arg == "--full") {
+			//完整规模需要约10 GB内存
+			points = ParseList("10K,100K,1M,10M,100M");
+			megapixels = ParseList("1,16,100,400");
+		} else {
+			fprintf(stderr, "usage: visualizer_bench [--points 10K,1M] [--megapixels 1,16] [--repeat n] "
+				"[--only parse,bounds,stats,voxel,view2d,render3d] [--full] [--out result.json]\n");
+			return 1;
+		}
+	}
+	bool runParse = only.find("parse") != std::string::npos;
+	bool runBounds = only.find("bounds") != std::string::npos;
+	bool runStats = only.find("stats") != std::string::npos;
+	bool runVoxel = only.find("voxel") != std::string::npos;
+	bool runView2d = only.find("view2d") != std::string::npos;
+	bool runRender3d = only.find("render3d") != std::string::npos;
+
+	std::vector<BenchResult> results;
+	for (size_t i = 0; i < points.size(); i++) {
+		size_t count = (size_t)points[i];
+		if (runParse) {
+			fprintf(stderr, "cloud_parse %zu points\n", count);
+			results.push_back(BenchParse(count, repeat));
+		}
+		if (runBounds || runStats || runVoxel || runRender3d) {
+			PointsCloud cloud;
+			GenerateCloud(count, cloud);
+			if (runBounds) {
+				fprintf(stderr, "bounds %zu points\n", count);
+				results.push_back(BenchBounds(cloud, repeat));
+			}
+			if (runStats) {
+				fprintf(stderr, "stats %zu points\n", count);
+				BenchStats(cloud, repeat, results);
+			}
+			if (runVoxel) {
+				fprintf(stderr, "voxel_grid %zu points\n", count);
+				results.push_back(BenchVoxel(cloud, repeat));
+			}
+			if (runRender3d) {
+				fprintf(stderr, "render3d_cpu %zu points\n", count);
+				results.push_back(BenchRender3d(cloud, repeat));
+			}
+		}
+	}
+	for (size_t i = 0; runView2d && i < megapixels.size(); i++) {
+		fprintf(stderr, "view2d_pan_zoom %.0f megapixels\n", megapixels[i]);
+		results.push_back(BenchView2d(megapixels[i], repeat));
+	}
+
+	FILE* file = outPath.empty() ? stdout : fopen(outPath.c_str(), "w");
+	if (file == NULL) {
+		fprintf(stderr, "cannot write %s\n", outPath.c_str());
+		return 1;
+	}
+	WriteResults(file, results, repeat);
+	if (file != stdout) {
+		fclose(file);
+	}
+	return 0;
+}
@@ -0,0 +1,165 @@
+﻿#include "annotation_layer.h"
+#include "opencv2/imgproc.hpp"
+#include <algorithm>
+#include <math.h>
+
+using namespace cv;
+
+void drawCross(Mat img, CvPoint point, CvScalar color, int size, int thickness)
+{
+	//绘制横线
+	line(img, Point(point.x - size / 2, point.y), Point(point.x + size / 2, point.y), color, thickness, 8, 0);
+	//绘制竖线
+	line(img, Point(point.x, point.y - size / 2), Point(point.x, point.y + size / 2), color, thickness, 8, 0);
+}
+
+Rect2f AnnotationLayer::Bounds(const Annotation& annotation)
+{
+	if (annotation.type == ANNOTATION_POINT || annotation.type == ANNOTATION_CROSS) {
+		return Rect2f(annotation.p0, Size2f(0, 0));
+	}
+	Point2f lower(MIN(annotation.p0.x, annotation.p1.x), MIN(annotation.p0.y, annotation.p1.y));
+	Point2f upper(MAX(annotation.p0.x, annotation.p1.x), MAX(annotation.p0.y, annotation.p1.y));
+	return Rect2f(lower, upper);
+}
+
+int AnnotationLayer::Add(const Annotation& annotation)
+{
+	int id = (int)mAnnotations.size();
+	mAnnotations.push_back(annotation);
+
+	Rect2f bounds = Bounds(annotation);
+	int cx0 = (int)floor(bounds.x / ANNOTATION_CELL_SIZE), cx1 = (int)floor((bounds.x + bounds.width) / ANNOTATION_CELL_SIZE);
+	int cy0 = (int)floor(bounds.y / ANNOTATION_CELL_SIZE), cy1 = (int)floor((bounds.y + bounds.height) / ANNOTATION_CELL_SIZE);
+	for (int cy = cy0; cy <= cy1; cy++) {
+		for (int cx = cx0; cx <= cx1; cx++) {
+			mCells[CellKey(cx, cy)].push_back(id);
+		}
+	}
+	return id;
+}
+
+int AnnotationLayer::AddPoint(const Point2f& point, const Scalar& color, int radius, int thickness)
+{
+	Annotation annotation = { ANNOTATION_POINT, point, point, color, radius, thickness };
+	return Add(annotation);
+}
+
+int AnnotationLayer::AddCross(const Point2f& point, const Scalar& color, int size, int thickness)
+{
+	Annotation annotation = { ANNOTATION_CROSS, point, point, color, size, thickness };
+	return Add(annotation);
+}
+
+int AnnotationLayer::AddLine(const Point2f& from, const Point2f& to, const Scalar& color, int thickness)
+{
+	Annotation annotation = { ANNOTATION_LINE, from, to, color, 0, thickness };
+	return Add(annotation);
+}
+
+int AnnotationLayer::AddBox(const Point2f& corner, const Point2f& opposite, const Scalar& color, int thickness)
+{
+	Annotation annotation = { ANNOTATION_BOX, corner, opposite, color, 0, thickness };
+	return Add(annotation);
+}
+
+void AnnotationLayer::Clear()
+{
+	mAnnotations.clear();
+	mCells.clear();
+	mVisited.clear();
+	mStamp = 0;
+}
+
+void AnnotationLayer::Query(const Rect2f& region, std::vector<int>& ids) const
+{
+	ids.clear();
+	if (mAnnotations.empty()) {
+		return;
+	}
+	if (mVisited.size() != mAnnotations.size()) {
+		mVisited.assign(mAnnotations.size(), 0);
+		mStamp = 0;
+	}
+	if (++mStamp == 0) {
+		std::fill(mVisited.begin(), mVisited.end(), 0);
+		mStamp = 1;
+	}
+
+	//只遍历与区域相交的网格，跨多个网格的标注用标记去重
+	int cx0 = (int)floor(region.x / ANNOTATION_CELL_SIZE), cx1 = (int)floor((region.x + region.width) / ANNOTATION_CELL_SIZE);
+	int cy0 = (int)floor(region.y / ANNOTATION_CELL_SIZE), cy1 = (int)floor((region.y + region.height) / ANNOTATION_CELL_SIZE);
+	if ((int64)(cx1 - cx0 + 1) * (cy1 - cy0 + 1) > (int64)mCells.size()) {
+		//区域比已占用的网格还多时直接遍历占用的网格
+		for (std::unordered_map<uint64_t, std::vector<int> >::const_iterator it = mCells.begin(); it != mCells.end(); ++it) {
+			int cx = (int)(uint32_t)(it->first >> 32), cy = (int)(uint32_t)it->first;
+			if (cx < cx0 || cx > cx1 || cy < cy0 || cy > cy1) {
+				continue;
+			}
+			for (size_t i = 0; i < it->second.size(); i++) {
+				int id = it->second[i];
+				if (mVisited[id] != mStamp) {
+					mVisited[id] = mStamp;
+					ids.push_back(id);
+				}
+			}
+		}
+	} else {
+		for (int cy = cy0; cy <= cy1; cy++) {
+			for (int cx = cx0; cx <= cx1; cx++) {
+				std::unordered_map<uint64_t, std::vector<int> >::const_iterator it = mCells.find(CellKey(cx, cy));
+				if (it == mCells.end()) {
+					continue;
+				}
+				for (size_t i = 0; i < it->second.size(); i++) {
+					int id = it->second[i];
+					if (mVisited[id] != mStamp) {
+						mVisited[id] = mStamp;
+						ids.push_back(id);
+					}
+				}
+			}
+		}
+	}
+
+	//网格只是粗筛，再按包围盒精确判断
+	size_t count = 0;
+	for (size_t i = 0; i < ids.size(); i++) {
+		Rect2f bounds = Bounds(mAnnotations[ids[i]]);
+		if (bounds.x <= region.x + region.width && bounds.x + bounds.width >= region.x
+			&& bounds.y <= region.y + region.height && bounds.y + bounds.height >= region.y) {
+			ids[count++] = ids[i];
+		}
+	}
+	ids.resize(count);
+	std::sort(ids.begin(), ids.end());
+}
+
+size_t AnnotationLayer::Draw(Mat& dst, double scale, Point offset) const
+{
+	//窗口对应的源图像区域，外扩点、十字等固定像素尺寸的部分
+	Rect2f region((float)((-ANNOTATION_MARGIN - offset.x) / scale), (float)((-ANNOTATION_MARGIN - offset.y) / scale),
+		(float)((dst.cols + 2 * ANNOTATION_MARGIN) / scale), (float)((dst.rows + 2 * ANNOTATION_MARGIN) / scale));
+	Query(region, mVisible);
+
+	for (size_t i = 0; i < mVisible.size(); i++) {
+		const Annotation& annotation = mAnnotations[mVisible[i]];
+		Point p0(cvRound(annotation.p0.x * scale) + offset.x, cvRound(annotation.p0.y * scale) + offset.y);
+		Point p1(cvRound(annotation.p1.x * scale) + offset.x, cvRound(annotation.p1.y * scale) + offset.y);
+		switch (annotation.type) {
+		case ANNOTATION_POINT:
+			circle(dst, p0, annotation.size, annotation.color, annotation.thickness);
+			break;
+		case ANNOTATION_CROSS:
+			drawCross(dst, p0, annotation.color, annotation.size, annotation.thickness);
+			break;
+		case ANNOTATION_LINE:
+			line(dst, p0, p1, annotation.color, annotation.thickness);
+			break;
+		case ANNOTATION_BOX:
+			rectangle(dst, p0, p1, annotation.color, annotation.thickness);
+			break;
+		}
+	}
+	return mVisible.size();
+}
@@ -0,0 +1,90 @@
+﻿#pragma once
+
+#include "opencv2/core.hpp"
+#include "opencv2/core/types_c.h"
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+#define ANNOTATION_CELL_SIZE	256		//空间索引网格边长，图像像素
+#define ANNOTATION_MARGIN		16		//标注在窗口中超出自身范围的最大像素数(点半径、十字尺寸、线宽)
+
+/* 标注类型 */
+enum AnnotationType {
+	ANNOTATION_POINT = 0,
+	ANNOTATION_CROSS = 1,
+	ANNOTATION_LINE = 2,
+	ANNOTATION_BOX = 3
+};
+
+/**
+  * 一个标注，坐标为源图像坐标，点与十字的尺寸为窗口像素，不随缩放变化
+  */
+struct Annotation {
+	AnnotationType type;
+	cv::Point2f p0;
+	cv::Point2f p1;				//直线终点或矩形对角，点与十字不使用
+	cv::Scalar color;
+	int size;					//点半径或十字尺寸
+	int thickness;
+};
+
+/**
+  * 绘制十字
+  * @param[in] img 目标图像
+  * @param[in] point 十字中心点
+  * @param[in] color 颜色
+  * @param[in] size 十字尺寸
+  * @param[in] thickness 粗细
+  */
+void drawCross(cv::Mat img, CvPoint point, CvScalar color, int size, int thickness);
+
+/**
+  * 2d视图的标注层，标注单独保存而不修改源图像，只在最终的窗口图像上绘制。
+  * 标注按包围盒登记到均匀网格中，绘制时只取与视口相交的网格中的标注
+  */
+class AnnotationLayer {
+public:
+	AnnotationLayer() : mStamp(0) {}
+
+	/**
+	  * 添加标注
+	  * @return 标注序号
+	  */
+	int Add(const Annotation& annotation);
+
+	int AddPoint(const cv::Point2f& point, const cv::Scalar& color, int radius = 1, int thickness = 4);
+	int AddCross(const cv::Point2f& point, const cv::Scalar& color, int size = 10, int thickness = 1);
+	int AddLine(const cv::Point2f& from, const cv::Point2f& to, const cv::Scalar& color, int thickness = 1);
+	int AddBox(const cv::Point2f& corner, const cv::Point2f& opposite, const cv::Scalar& color, int thickness = 1);
+
+	void Clear();
+	size_t Size() const { return mAnnotations.size(); }
+	const Annotation& Get(int id) const { return mAnnotations[id]; }
+
+	/**
+	  * 查询包围盒与区域相交的标注，每个标注只出现一次
+	  * @param[in] region 源图像坐标系下的区域
+	  * @param[out] ids 标注序号，按添加顺序排列
+	  */
+	void Query(const cv::Rect2f& region, std::vector<int>& ids) const;
+
+	/**
+	  * 把视口内的标注绘制到窗口图像上
+	  * @param[in,out] dst 窗口图像
+	  * @param[in] scale 源图像到窗口的缩放倍数
+	  * @param[in] offset 源图像左上角在窗口中的位置
+	  * @return 绘制的标注数
+	  */
+	size_t Draw(cv::Mat& dst, double scale, cv::Point offset) const;
+
+private:
+	static cv::Rect2f Bounds(const Annotation& annotation);
+	static uint64_t CellKey(int cx, int cy) { return ((uint64_t)(uint32_t)cx << 32) | (uint32_t)cy; }
+
+	std::vector<Annotation> mAnnotations;
+	std::unordered_map<uint64_t, std::vector<int> > mCells;
+	mutable std::vector<uint32_t> mVisited;		//查询时用于去重
+	mutable uint32_t mStamp;
+	mutable std::vector<int> mVisible;
+};
@@ -0,0 +1,312 @@
+﻿#include "cloud_cache.h"
+#include "mapped_file.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/stat.h>
+#include <sys/types.h>
+#endif
+
+#define HASH_SAMPLE_COUNT		64
+#define HASH_SAMPLE_SIZE		4096
+#define HASH_EDGE_SIZE			(64 * 1024)
+
+using namespace cv;
+
+namespace {
+
+const uint64_t kFnvOffset = 14695981039346656037ull;
+const uint64_t kFnvPrime = 1099511628211ull;
+
+uint64_t HashBytes(const void* data, size_t size, uint64_t hash)
+{
+	const unsigned char* p = (const unsigned char*)data;
+	for (size_t i = 0; i < size; i++) {
+		hash = (hash ^ p[i]) * kFnvPrime;
+	}
+	return hash;
+}
+
+/**
+  * 文件大小与纳秒精度的修改时间(自1970年起)，整秒精度不能区分同一秒内的两次写入
+  */
+bool GetFileInfo(const std::string& path, uint64_t& size, int64_t& mtime)
+{
+#ifdef _WIN32
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &data)) {
+		return false;
+	}
+	size = (uint64_t)data.nFileSizeHigh << 32 | data.nFileSizeLow;
+	//FILETIME以100纳秒为单位，从1601年起
+	int64_t ticks = (int64_t)((uint64_t)data.ftLastWriteTime.dwHighDateTime << 32 | data.ftLastWriteTime.dwLowDateTime);
+	mtime = (ticks - 116444736000000000ll) * 100;
+#else
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0) {
+		return false;
+	}
+	size = (uint64_t)st.st_size;
+#ifdef __APPLE__
+	mtime = (int64_t)st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+	mtime = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+#endif
+	return true;
+}
+
+/**
+  * 源文件采样哈希：首尾各HASH_EDGE_SIZE字节加上均匀分布的HASH_SAMPLE_COUNT个块，
+  * 读取量与文件大小无关，启动时校验只需毫秒级
+  */
+bool HashSourceFile(const std::string& path, uint64_t& hash)
+{
+	FILE* file = fopen(path.c_str(), "rb");
+	if (file == NULL) {
+		return false;
+	}
+
+	uint64_t size;
+	int64_t mtime;
+	if (!GetFileInfo(path, size, mtime)) {
+		fclose(file);
+		return false;
+	}
+
+	std::vector<unsigned char> buffer(HASH_EDGE_SIZE);
+	hash = HashBytes(&size, sizeof(size), kFnvOffset);
+
+	std::vector<uint64_t> offsets;
+	offsets.push_back(0);
+	for (int i = 1; i <= HASH_SAMPLE_COUNT; i++) {
+		offsets.push_back(size / (HASH_SAMPLE_COUNT + 1) * i);
+	}
+	offsets.push_back(size > HASH_EDGE_SIZE ? size - HASH_EDGE_SIZE : 0);
+
+	for (size_t i = 0; i < offsets.size(); i++) {
+		size_t length = (i == 0 || i + 1 == offsets.size()) ? HASH_EDGE_SIZE : HASH_SAMPLE_SIZE;
+#ifdef _WIN32
+		_fseeki64(file, (__int64)offsets[i], SEEK_SET);
+#else
+		fseeko(file, (off_t)offsets[i], SEEK_SET);
+#endif
+		size_t read = fread(&buffer[0], 1, length, file);
+		hash = HashBytes(&buffer[0], read, hash);
+	}
+	fclose(file);
+	return true;
+}
+
+uint64_t HeaderChecksum(const CloudCacheHeader& header)
+{
+	return HashBytes(&header, offsetof(CloudCacheHeader, headerChecksum), kFnvOffset);
+}
+
+uint64_t AlignUp(uint64_t value)
+{
+	return (value + CLOUD_CACHE_ALIGNMENT - 1) / CLOUD_CACHE_ALIGNMENT * CLOUD_CACHE_ALIGNMENT;
+}
+
+void SetField(CloudCacheField& field, const char* name, int depth, int channels, uint64_t offset, uint64_t bytes)
+{
+	memset(&field, 0, sizeof(field));
+	strncpy(field.name, name, sizeof(field.name) - 1);
+	field.depth = depth;
+	field.channels = channels;
+	field.offset = offset;
+	field.bytes = bytes;
+}
+
+const CloudCacheField* FindField(const CloudCacheHeader& header, const char* name)
+{
+	for (uint32_t i = 0; i < header.fieldCount; i++) {
+		if (strncmp(header.fields[i].name, name, sizeof(header.fields[i].name)) == 0) {
+			return &header.fields[i];
+		}
+	}
+	return NULL;
+}
+
+bool CheckField(const CloudCacheField* field, int depth, int channels, uint64_t elementSize, uint64_t count, uint64_t fileSize)
+{
+	return field != NULL && field->depth == (uint32_t)depth && field->channels == (uint32_t)channels
+		&& field->offset % CLOUD_CACHE_ALIGNMENT == 0 && field->bytes == elementSize * count
+		&& field->offset <= fileSize && field->bytes <= fileSize - field->offset;
+}
+
+bool WritePadding(FILE* file, uint64_t& position)
+{
+	static const char zeros[CLOUD_CACHE_ALIGNMENT] = { 0 };
+	uint64_t padding = AlignUp(position) - position;
+	position += padding;
+	return fwrite(zeros, 1, (size_t)padding, file) == padding;
+}
+
+}
+
+std::string CloudCachePath(const std::string& sourcePath)
+{
+	return sourcePath + CLOUD_CACHE_EXTENSION;
+}
+
+bool LoadCloudCache(const std::string& sourcePath, PointsCloud& cloud)
+{
+	uint64_t sourceSize;
+	int64_t sourceMtime;
+	if (!GetFileInfo(sourcePath, sourceSize, sourceMtime)) {
+		return false;
+	}
+
+	//映射为写时复制，点云被修改时不会写回缓存文件
+	std::shared_ptr<MappedFile> file(new MappedFile());
+	if (!file->Open(CloudCachePath(sourcePath), true) || file->Size() < sizeof(CloudCacheHeader)) {
+		return false;
+	}
+
+	CloudCacheHeader header;
+	memcpy(&header, file->Data(), sizeof(header));
+	if (memcmp(header.magic, CLOUD_CACHE_MAGIC, sizeof(header.magic)) != 0
+		|| header.version != CLOUD_CACHE_VERSION
+		|| header.headerChecksum != HeaderChecksum(header)
+		|| header.fieldCount > CLOUD_CACHE_MAX_FIELDS) {
+		return false;
+	}
+
+	//先比较大小与修改时间，一致时再计算采样哈希
+	uint64_t sourceHash;
+	if (header.sourceSize != sourceSize || header.sourceMtime != sourceMtime
+		|| !HashSourceFile(sourcePath, sourceHash) || header.sourceHash != sourceHash) {
+		return false;
+	}
+
+	uint64_t count = header.pointCount;
+	const char* names[4] = { "x", "y", "z", "intensity" };
+	ColumnBuffer<float>* columns[4] = { &cloud.x, &cloud.y, &cloud.z, &cloud.intensity };
+	for (int k = 0; k < 4; k++) {
+		if (!CheckField(FindField(header, names[k]), CV_32F, 1, sizeof(float), count, file->Size())) {
+			return false;
+		}
+	}
+
+	cloud.Reset();
+	char* data = file->WritableData();
+	for (int k = 0; k < 4 && count > 0; k++) {
+		const CloudCacheField* field = FindField(header, names[k]);
+		columns[k]->Borrow((float*)(data + field->offset), (size_t)count, file);
+	}
+
+	//其余各列为附加字段
+	for (uint32_t i = 0; i < header.fieldCount; i++) {
+		const CloudCacheField& field = header.fields[i];
+		std::string name(field.name, strnlen(field.name, sizeof(field.name)));
+		if (name == "x" || name == "y" || name == "z" || name == "intensity") {
+			continue;
+		}
+		if (field.channels != 1 || field.depth > CV_64F
+			|| !CheckField(&field, field.depth, 1, CV_ELEM_SIZE1(field.depth), count, file->Size())) {
+			cloud.Reset();
+			return false;
+		}
+		//不经AddField，避免先分配并清零一整列再被映射内存替换
+		if (cloud.FindField(name) != NULL) {
+			continue;
+		}
+		cloud.fields.push_back(PointField());
+		PointField& target = cloud.fields.back();
+		target.name = name;
+		target.depth = field.depth;
+		if (count > 0) {
+			target.data.Borrow((unsigned char*)(data + field.offset), (size_t)field.bytes, file);
+		}
+	}
+
+	cloud.lowerBoundary = Point3f(header.lowerBoundary[0], header.lowerBoundary[1], header.lowerBoundary[2]);
+	cloud.upperBoundary = Point3f(header.upperBoundary[0], header.upperBoundary[1], header.upperBoundary[2]);
+	cloud.centerPoint = Point3f(header.centerPoint[0], header.centerPoint[1], header.centerPoint[2]);
+	cloud.width = header.size[0];
+	cloud.height = header.size[1];
+	cloud.depth = header.size[2];
+	return true;
+}
+
+bool SaveCloudCache(const std::string& sourcePath, const PointsCloud& cloud)
+{
+	CloudCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CLOUD_CACHE_MAGIC, sizeof(header.magic));
+	header.version = CLOUD_CACHE_VERSION;
+	if (!GetFileInfo(sourcePath, header.sourceSize, header.sourceMtime)
+		|| !HashSourceFile(sourcePath, header.sourceHash)) {
+		return false;
+	}
+
+	//x、y、z、intensity与附加字段依次按页对齐存放，字段名过长的附加字段不缓存
+	const char* names[4] = { "x", "y", "z", "intensity" };
+	const ColumnBuffer<float>* columns[4] = { &cloud.x, &cloud.y, &cloud.z, &cloud.intensity };
+	std::vector<const unsigned char*> sources;
+	uint64_t count = cloud.Size();
+	uint64_t offset = AlignUp(sizeof(header));
+	header.pointCount = count;
+	for (int k = 0; k < 4; k++) {
+		SetField(header.fields[header.fieldCount++], names[k], CV_32F, 1, offset, count * sizeof(float));
+		sources.push_back((const unsigned char*)columns[k]->data());
+		offset = AlignUp(offset + count * sizeof(float));
+	}
+	for (size_t i = 0; i < cloud.fields.size() && header.fieldCount < CLOUD_CACHE_MAX_FIELDS; i++) {
+		const PointField& field = cloud.fields[i];
+		if (field.name.size() >= sizeof(header.fields[0].name)) {
+			continue;
+		}
+		SetField(header.fields[header.fieldCount++], field.name.c_str(), field.depth, 1, offset, field.data.size());
+		sources.push_back(field.data.data());
+		offset = AlignUp(offset + field.data.size());
+	}
+
+	const Point3f* bounds[3] = { &cloud.lowerBoundary, &cloud.upperBoundary, &cloud.centerPoint };
+	float* targets[3] = { header.lowerBoundary, header.upperBoundary, header.centerPoint };
+	for (int k = 0; k < 3; k++) {
+		targets[k][0] = bounds[k]->x;
+		targets[k][1] = bounds[k]->y;
+		targets[k][2] = bounds[k]->z;
+	}
+	header.size[0] = cloud.width;
+	header.size[1] = cloud.height;
+	header.size[2] = cloud.depth;
+	header.headerChecksum = HeaderChecksum(header);
+
+	std::string path = CloudCachePath(sourcePath);
+	std::string tempPath = path + ".tmp";
+	FILE* file = fopen(tempPath.c_str(), "wb");
+	if (file == NULL) {
+		return false;
+	}
+
+	uint64_t position = sizeof(header);
+	bool result = fwrite(&header, sizeof(header), 1, file) == 1;
+	for (uint32_t i = 0; i < header.fieldCount && result; i++) {
+		uint64_t bytes = header.fields[i].bytes;
+		result = WritePadding(file, position);
+		result = result && (bytes == 0 || fwrite(sources[i], 1, (size_t)bytes, file) == bytes);
+		position += bytes;
+	}
+	result = fclose(file) == 0 && result;
+
+#ifdef _WIN32
+	//Windows下rename不能覆盖已有文件
+	bool replaced = result && MoveFileExA(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	//rename原子地替换已有缓存，其他进程读到的总是完整的旧缓存或新缓存
+	bool replaced = result && rename(tempPath.c_str(), path.c_str()) == 0;
+#endif
+	if (!replaced) {
+		remove(tempPath.c_str());
+		return false;
+	}
+	return true;
+}
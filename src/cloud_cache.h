@@ -0,0 +1,64 @@
+﻿#pragma once
+
+#include "points_cloud.h"
+#include <stdint.h>
+#include <string>
+
+#define CLOUD_CACHE_MAGIC		"OVCLOUD"
+#define CLOUD_CACHE_VERSION		3
+#define CLOUD_CACHE_EXTENSION	".ovcache"
+#define CLOUD_CACHE_ALIGNMENT	4096
+#define CLOUD_CACHE_MAX_FIELDS	16
+
+/* 缓存文件中的一列数据 */
+struct CloudCacheField {
+	char name[16];
+	uint32_t depth;		//OpenCV深度，如CV_32F
+	uint32_t channels;	//每个点的元素个数
+	uint64_t offset;	//在文件中的偏移，按CLOUD_CACHE_ALIGNMENT对齐
+	uint64_t bytes;
+};
+
+/**
+  * 缓存文件头，位于文件开头，之后x、y、z、intensity与附加字段各列按页对齐依次存放，
+  * 所有字段均为小端序
+  */
+struct CloudCacheHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t fieldCount;
+	uint64_t pointCount;
+	float lowerBoundary[3];
+	float upperBoundary[3];
+	float centerPoint[3];
+	float size[3];				//width、height、depth
+
+	uint64_t sourceSize;		//源文件字节数
+	int64_t sourceMtime;		//源文件修改时间，纳秒
+	uint64_t sourceHash;		//源文件采样哈希
+
+	CloudCacheField fields[CLOUD_CACHE_MAX_FIELDS];
+	uint64_t headerChecksum;	//以上所有字段的哈希
+};
+
+/**
+  * 缓存文件路径，为源文件路径加CLOUD_CACHE_EXTENSION
+  */
+std::string CloudCachePath(const std::string& sourcePath);
+
+/**
+  * 内存映射缓存文件，点云各列直接引用映射内存而不拷贝，
+  * 源文件的大小、修改时间或采样哈希与缓存记录不一致时视为失效
+  * @param[in] sourcePath 源文件路径
+  * @param[out] cloud 输出点云
+  * @return 缓存有效且加载成功返回true
+  */
+bool LoadCloudCache(const std::string& sourcePath, PointsCloud& cloud);
+
+/**
+  * 写入缓存文件，先写临时文件再替换，避免其他进程读到不完整的缓存
+  * @param[in] sourcePath 源文件路径
+  * @param[in] cloud 点云
+  * @return 写入成功返回true
+  */
+bool SaveCloudCache(const std::string& sourcePath, const PointsCloud& cloud);
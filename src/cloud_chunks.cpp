@@ -0,0 +1,221 @@
+﻿#include "cloud_chunks.h"
+#include "opencv2/core/utility.hpp"
+#include <float.h>
+#include <math.h>
+
+using namespace cv;
+
+namespace {
+
+inline int GridCell(float value, int grid)
+{
+	//nan归入第0格
+	int cell = value > 0 ? (int)value : 0;
+	return MIN(cell, grid - 1);
+}
+
+inline void ExpandBox(Point3f& lower, Point3f& upper, const Point3f& boxLower, const Point3f& boxUpper)
+{
+	lower.x = MIN(lower.x, boxLower.x);
+	lower.y = MIN(lower.y, boxLower.y);
+	lower.z = MIN(lower.z, boxLower.z);
+	upper.x = MAX(upper.x, boxUpper.x);
+	upper.y = MAX(upper.y, boxUpper.y);
+	upper.z = MAX(upper.z, boxUpper.z);
+}
+
+}
+
+void CloudChunks::Clear()
+{
+	std::vector<CloudChunk>().swap(mChunks);
+	std::vector<ChunkRange>().swap(mRanges);
+	std::vector<Block>().swap(mBlocks);
+	std::vector<int>().swap(mBlockChunks);
+}
+
+void CloudChunks::Build(const PointsCloud& cloud, const SizeBuckets& buckets, std::vector<uint32_t>& order)
+{
+	Clear();
+	size_t count = cloud.Size();
+	order.clear();
+	if (count == 0) {
+		return;
+	}
+
+	//按各轴的长度比例划分网格，分块总数接近 点数 / CHUNK_POINTS
+	float extents[3] = { cloud.width, cloud.height, cloud.depth };
+	float maxExtent = MAX(extents[0], MAX(extents[1], extents[2]));
+	size_t target = MIN(MAX(count / CHUNK_POINTS, (size_t)1), (size_t)MAX_CHUNKS);
+	int dims[3] = { 1, 1, 1 };
+	for (int grid = 64; grid >= 1; grid--) {
+		size_t cells = 1;
+		for (int a = 0; a < 3; a++) {
+			dims[a] = maxExtent > 0 ? MAX((int)ceilf(grid * extents[a] / maxExtent), 1) : 1;
+			cells *= dims[a];
+		}
+		if (cells <= target) {
+			break;
+		}
+	}
+	float scales[3];
+	for (int a = 0; a < 3; a++) {
+		scales[a] = extents[a] > 0 ? dims[a] / extents[a] : 0;
+	}
+	int cellCount = dims[0] * dims[1] * dims[2];
+	const Point3f& origin = cloud.lowerBoundary;
+
+	//计算每个点所在的网格并统计每格的点数与实际包围盒
+	std::vector<int> cellIds(count);
+	int taskCount = (int)MIN((size_t)MAX(getNumThreads(), 1), count / CHUNK_POINTS + 1);
+	size_t taskSize = (count + taskCount - 1) / taskCount;
+	std::vector<CloudChunk> partial((size_t)taskCount * cellCount);
+	parallel_for_(Range(0, taskCount), [&](const Range& range) {
+		for (int t = range.start; t < range.end; t++) {
+			CloudChunk* cells = &partial[(size_t)t * cellCount];
+			for (int c = 0; c < cellCount; c++) {
+				cells[c].lower = Point3f(FLT_MAX, FLT_MAX, FLT_MAX);
+				cells[c].upper = Point3f(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+				cells[c].count = 0;
+			}
+			size_t end = MIN(count, (t + 1) * taskSize);
+			for (size_t i = t * taskSize; i < end; i++) {
+				Point3f point = cloud.Point(i);
+				int cell = (GridCell((point.z - origin.z) * scales[2], dims[2]) * dims[1]
+					+ GridCell((point.y - origin.y) * scales[1], dims[1])) * dims[0]
+					+ GridCell((point.x - origin.x) * scales[0], dims[0]);
+				cellIds[i] = cell;
+				//nan不参与包围盒，点本身也不会被绘制
+				if (point.x == point.x && point.y == point.y && point.z == point.z) {
+					ExpandBox(cells[cell].lower, cells[cell].upper, point, point);
+				}
+				cells[cell].count++;
+			}
+		}
+	}, taskCount);
+
+	//合并各任务的统计，只保留非空网格作为分块
+	std::vector<int> cellToChunk(cellCount, -1);
+	std::vector<int> chunkCells;
+	for (int c = 0; c < cellCount; c++) {
+		CloudChunk chunk = partial[c];
+		for (int t = 1; t < taskCount; t++) {
+			const CloudChunk& cell = partial[(size_t)t * cellCount + c];
+			ExpandBox(chunk.lower, chunk.upper, cell.lower, cell.upper);
+			chunk.count += cell.count;
+		}
+		if (chunk.count > 0) {
+			if (chunk.lower.x > chunk.upper.x) {
+				chunk.lower = chunk.upper = origin;
+			}
+			cellToChunk[c] = (int)mChunks.size();
+			mChunks.push_back(chunk);
+			chunkCells.push_back(c);
+		}
+	}
+	std::vector<CloudChunk>().swap(partial);
+	int chunkCount = (int)mChunks.size();
+
+	//各桶内按分块做稳定的计数排序
+	int bucketCount = buckets.BucketCount();
+	std::vector<std::vector<ChunkRange> > bucketRanges(bucketCount);
+	order.resize(count);
+	parallel_for_(Range(0, bucketCount), [&](const Range& range) {
+		std::vector<size_t> offsets(chunkCount + 1);
+		for (int b = range.start; b < range.end; b++) {
+			size_t begin = buckets.offsets[b], end = buckets.offsets[b + 1];
+			std::fill(offsets.begin(), offsets.end(), 0);
+			for (size_t k = begin; k < end; k++) {
+				offsets[cellToChunk[cellIds[buckets.order[k]]] + 1]++;
+			}
+			offsets[0] = begin;
+			for (int c = 0; c < chunkCount; c++) {
+				if (offsets[c + 1] > 0) {
+					ChunkRange chunkRange = { b, c, offsets[c], offsets[c + 1] };
+					bucketRanges[b].push_back(chunkRange);
+				}
+				offsets[c + 1] += offsets[c];
+			}
+			for (size_t k = begin; k < end; k++) {
+				uint32_t i = buckets.order[k];
+				order[offsets[cellToChunk[cellIds[i]]]++] = i;
+			}
+		}
+	});
+	for (int b = 0; b < bucketCount; b++) {
+		mRanges.insert(mRanges.end(), bucketRanges[b].begin(), bucketRanges[b].end());
+	}
+
+	//分块按所在粗块归组，并计算粗块的包围盒
+	int blockDims[3];
+	for (int a = 0; a < 3; a++) {
+		blockDims[a] = (dims[a] + CHUNK_BLOCK - 1) / CHUNK_BLOCK;
+	}
+	int blockCount = blockDims[0] * blockDims[1] * blockDims[2];
+	std::vector<int> chunkBlocks(chunkCount);
+	std::vector<size_t> blockSizes(blockCount + 1, 0);
+	for (int c = 0; c < chunkCount; c++) {
+		int cell = chunkCells[c];
+		int cx = cell % dims[0], cy = cell / dims[0] % dims[1], cz = cell / dims[0] / dims[1];
+		chunkBlocks[c] = (cz / CHUNK_BLOCK * blockDims[1] + cy / CHUNK_BLOCK) * blockDims[0] + cx / CHUNK_BLOCK;
+		blockSizes[chunkBlocks[c] + 1]++;
+	}
+	for (int b = 0; b < blockCount; b++) {
+		blockSizes[b + 1] += blockSizes[b];
+	}
+
+	std::vector<Block> blocks(blockCount);
+	for (int b = 0; b < blockCount; b++) {
+		blocks[b].lower = Point3f(FLT_MAX, FLT_MAX, FLT_MAX);
+		blocks[b].upper = Point3f(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		blocks[b].count = 0;
+		blocks[b].first = blockSizes[b];
+		blocks[b].chunkCount = 0;
+	}
+	mBlockChunks.resize(chunkCount);
+	for (int c = 0; c < chunkCount; c++) {
+		Block& block = blocks[chunkBlocks[c]];
+		ExpandBox(block.lower, block.upper, mChunks[c].lower, mChunks[c].upper);
+		block.count += mChunks[c].count;
+		mBlockChunks[block.first + block.chunkCount++] = c;
+	}
+	for (int b = 0; b < blockCount; b++) {
+		if (blocks[b].chunkCount > 0) {
+			mBlocks.push_back(blocks[b]);
+		}
+	}
+}
+
+void CloudChunks::Cull(const Frustum& frustum, std::vector<unsigned char>& visible, CullStats& stats) const
+{
+	visible.assign(mChunks.size(), 0);
+	stats = CullStats();
+	for (size_t b = 0; b < mBlocks.size(); b++) {
+		const Block& block = mBlocks[b];
+		stats.testedBoxes++;
+		FrustumTest blockTest = frustum.TestBox(block.lower, block.upper);
+		if (blockTest == FRUSTUM_OUTSIDE) {
+			stats.culledChunks += block.chunkCount;
+			stats.culledPoints += block.count;
+			continue;
+		}
+
+		for (size_t i = block.first; i < block.first + block.chunkCount; i++) {
+			int c = mBlockChunks[i];
+			const CloudChunk& chunk = mChunks[c];
+			FrustumTest test = blockTest;
+			if (test == FRUSTUM_INTERSECT) {
+				stats.testedBoxes++;
+				test = frustum.TestBox(chunk.lower, chunk.upper);
+			}
+			if (test == FRUSTUM_OUTSIDE) {
+				stats.culledChunks++;
+				stats.culledPoints += chunk.count;
+			} else {
+				visible[c] = 1;
+				stats.visibleChunks++;
+				stats.submittedPoints += chunk.count;
+			}
+		}
+	}
+}
@@ -0,0 +1,75 @@
+﻿#pragma once
+
+#include "points_cloud.h"
+#include "size_buckets.h"
+#include "frustum.h"
+#include <stdint.h>
+#include <vector>
+
+#define CHUNK_POINTS			8192	//每个分块的目标点数
+#define MAX_CHUNKS				32768
+#define CHUNK_BLOCK				4		//每个粗块在各轴上包含的分块数
+
+/* 空间分块，包围盒为块内点的实际范围 */
+struct CloudChunk {
+	cv::Point3f lower;
+	cv::Point3f upper;
+	size_t count;
+};
+
+/* 分块内属于同一尺寸桶的一段连续顶点 */
+struct ChunkRange {
+	int bucket;
+	int chunk;
+	size_t first;
+	size_t count;
+};
+
+/**
+  * 点云的空间分块，点先按尺寸桶、桶内再按分块排列，
+  * 相邻的可见分块在同一桶内首尾相接，可以合并为一次绘制。
+  * 分块按CHUNK_BLOCK^3组成粗块，剔除时先判断粗块，完全在视锥内或外的粗块不再逐块判断
+  */
+class CloudChunks {
+public:
+	/**
+	  * 构建分块并输出顶点排列
+	  * @param[in] cloud 点云，需已更新边界
+	  * @param[in] buckets 尺寸分桶结果
+	  * @param[out] order 顶点排列，第k个顶点为第order[k]个点
+	  */
+	void Build(const PointsCloud& cloud, const SizeBuckets& buckets, std::vector<uint32_t>& order);
+
+	void Clear();
+	bool Empty() const { return mChunks.empty(); }
+
+	const std::vector<CloudChunk>& Chunks() const { return mChunks; }
+
+	/**
+	  * 按桶、分块排列的全部顶点范围
+	  */
+	const std::vector<ChunkRange>& Ranges() const { return mRanges; }
+
+	/**
+	  * 分层视锥剔除
+	  * @param[in] frustum 视锥
+	  * @param[out] visible 每个分块是否可见
+	  * @param[out] stats 剔除统计
+	  */
+	void Cull(const Frustum& frustum, std::vector<unsigned char>& visible, CullStats& stats) const;
+
+private:
+	/* 粗块，包含的分块为mBlockChunks[first]到mBlockChunks[first + chunkCount - 1] */
+	struct Block {
+		cv::Point3f lower;
+		cv::Point3f upper;
+		size_t count;
+		size_t first;
+		size_t chunkCount;
+	};
+
+	std::vector<CloudChunk> mChunks;
+	std::vector<ChunkRange> mRanges;
+	std::vector<Block> mBlocks;
+	std::vector<int> mBlockChunks;
+};
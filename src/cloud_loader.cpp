@@ -0,0 +1,46 @@
+﻿#include "cloud_loader.h"
+#include "cloud_cache.h"
+#include "pcd_loader.h"
+#include "xyzi_loader.h"
+#include "opencv2/core/utility.hpp"
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace {
+
+bool HasExtension(const std::string& path, const char* extension)
+{
+	size_t length = strlen(extension);
+	if (path.size() < length) {
+		return false;
+	}
+	for (size_t i = 0; i < length; i++) {
+		if (tolower((unsigned char)path[path.size() - length + i]) != extension[i]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+}
+
+bool LoadPointsCloud(const std::string& path, PointsCloud& cloud, LoadStats* stats, bool useCache)
+{
+	int64 startTick = cv::getTickCount();
+	if (useCache && LoadCloudCache(path, cloud)) {
+		if (stats != NULL) {
+			stats->bytes = cloud.Size() * 4 * sizeof(float);
+			stats->points = cloud.Size();
+			stats->seconds = (cv::getTickCount() - startTick) / cv::getTickFrequency();
+			stats->fromCache = true;
+		}
+		return true;
+	}
+
+	bool result = HasExtension(path, ".pcd") ? LoadPcd(path, cloud, stats) : LoadXyziTxt(path, cloud, stats);
+	if (result && useCache && !SaveCloudCache(path, cloud)) {
+		printf("cannot write cloud cache %s\n", CloudCachePath(path).c_str());
+	}
+	return result;
+}
@@ -0,0 +1,15 @@
+﻿#pragma once
+
+#include "points_cloud.h"
+#include <string>
+
+/**
+  * 按扩展名加载点云：.pcd按PCD格式读取，其余按xyzi文本读取，
+  * 启用缓存时优先映射有效的缓存文件，否则解析后写入缓存供下次启动使用
+  * @param[in] path 文件路径
+  * @param[out] cloud 输出点云，包含边界与中心点
+  * @param[out] stats 耗时统计，可为NULL
+  * @param[in] useCache 是否使用缓存文件
+  * @return 加载失败返回false
+  */
+bool LoadPointsCloud(const std::string& path, PointsCloud& cloud, LoadStats* stats = NULL, bool useCache = true);
@@ -0,0 +1,503 @@
+﻿#include "cloud_renderer.h"
+#include "trace.h"
+#include "size_buckets.h"
+#include "opencv2/imgproc.hpp"
+#include <stdio.h>
+#ifndef _WIN32
+#include <GL/glx.h>
+#endif
+
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+#ifndef GL_ARRAY_BUFFER
+#define GL_ARRAY_BUFFER			0x8892
+#endif
+#ifndef GL_STATIC_DRAW
+#define GL_STATIC_DRAW			0x88E4
+#endif
+
+#define MAX_DRAW_COUNT			(1 << 30)
+#define STAGING_BLOCK			(64 * 1024)
+
+using namespace cv;
+
+namespace {
+
+/* OpenGL 1.5顶点缓冲函数，Windows的opengl32只导出1.1，需要运行时获取 */
+typedef void (APIENTRY *GenBuffersProc)(GLsizei n, GLuint* buffers);
+typedef void (APIENTRY *BindBufferProc)(GLenum target, GLuint buffer);
+typedef void (APIENTRY *BufferDataProc)(GLenum target, ptrdiff_t size, const void* data, GLenum usage);
+typedef void (APIENTRY *DeleteBuffersProc)(GLsizei n, const GLuint* buffers);
+typedef void (APIENTRY *MultiDrawArraysProc)(GLenum mode, const GLint* first, const GLsizei* count, GLsizei drawCount);
+
+GenBuffersProc glGenBuffersPtr = NULL;
+BindBufferProc glBindBufferPtr = NULL;
+BufferDataProc glBufferDataPtr = NULL;
+DeleteBuffersProc glDeleteBuffersPtr = NULL;
+MultiDrawArraysProc glMultiDrawArraysPtr = NULL;
+
+void* GetGlProc(const char* name)
+{
+#ifdef _WIN32
+	void* proc = (void*)wglGetProcAddress(name);
+	//部分驱动失败时返回1、2、3或-1而不是NULL
+	if (proc == (void*)1 || proc == (void*)2 || proc == (void*)3 || proc == (void*)-1) {
+		return NULL;
+	}
+	return proc;
+#else
+	return (void*)glXGetProcAddressARB((const GLubyte*)name);
+#endif
+}
+
+void* GetGlProc(const char* name, const char* arbName)
+{
+	void* proc = GetGlProc(name);
+	return proc != NULL ? proc : GetGlProc(arbName);
+}
+
+/**
+  * 读取当前的模型视图、投影矩阵与视口，OpenGL矩阵为列主序
+  */
+LodView CurrentView()
+{
+	GLfloat modelview[16], projection[16];
+	GLint viewport[4];
+	glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+	glGetFloatv(GL_PROJECTION_MATRIX, projection);
+	glGetIntegerv(GL_VIEWPORT, viewport);
+
+	LodView view;
+	view.modelview = Matx44f(modelview).t();
+	view.projection = Matx44f(projection).t();
+	view.viewportHeight = viewport[3];
+	return view;
+}
+
+}
+
+const char* RenderPathName(RenderPath path)
+{
+	const char* names[RENDER_PATH_COUNT] = { "immediate", "vertex buffer", "octree lod" };
+	return path >= 0 && path < RENDER_PATH_COUNT ? names[path] : "unknown";
+}
+
+CloudRenderer::CloudRenderer()
+	: mCloud(NULL), mPath(RENDER_VERTEX_BUFFER), mColorMode(COLOR_FIXED), mTiming(false), mDirty(true), mCulling(true),
+	mVertexCount(0), mStagedLod(false), mFunctionsLoaded(false), mHasBuffers(false), mPositionBuffer(0), mColorBuffer(0)
+{
+}
+
+void CloudRenderer::SetCloud(const PointsCloud* cloud)
+{
+	mCloud = cloud;
+	mOctree.Clear();
+	mDirty = true;
+}
+
+void CloudRenderer::Invalidate()
+{
+	mOctree.Clear();
+	mDirty = true;
+}
+
+void CloudRenderer::SetColorMode(ColorMode mode)
+{
+	if (mColorMode != mode) {
+		mColorMode = mode;
+		mDirty = true;
+	}
+}
+
+void CloudRenderer::SetSizeBuckets(const SizeBucketConfig& config)
+{
+	mBucketConfig = config;
+	mDirty = true;
+}
+
+void CloudRenderer::ResetStats()
+{
+	for (int i = 0; i < RENDER_PATH_COUNT; i++) {
+		mStats[i] = FrameStats();
+	}
+}
+
+void CloudRenderer::PrintStats() const
+{
+	for (int i = 0; i < RENDER_PATH_COUNT; i++) {
+		const FrameStats& stats = mStats[i];
+		printf("%-14s frames %5d avg %8.2f ms last %8.2f ms draw calls %zu points %zu culled %zu\n",
+			RenderPathName((RenderPath)i), stats.frames, stats.AverageMs(), stats.lastMs, stats.drawCalls, stats.points, stats.culledPoints);
+	}
+}
+
+bool CloudRenderer::LoadBufferFunctions()
+{
+	if (!mFunctionsLoaded) {
+		glGenBuffersPtr = (GenBuffersProc)GetGlProc("glGenBuffers", "glGenBuffersARB");
+		glBindBufferPtr = (BindBufferProc)GetGlProc("glBindBuffer", "glBindBufferARB");
+		glBufferDataPtr = (BufferDataProc)GetGlProc("glBufferData", "glBufferDataARB");
+		glDeleteBuffersPtr = (DeleteBuffersProc)GetGlProc("glDeleteBuffers", "glDeleteBuffersARB");
+		glMultiDrawArraysPtr = (MultiDrawArraysProc)GetGlProc("glMultiDrawArrays", "glMultiDrawArraysEXT");
+		mHasBuffers = glGenBuffersPtr && glBindBufferPtr && glBufferDataPtr && glDeleteBuffersPtr;
+		mFunctionsLoaded = true;
+		if (!mHasBuffers) {
+			printf("vertex buffer objects unavailable, using client vertex arrays\n");
+		}
+	}
+	return mHasBuffers;
+}
+
+void CloudRenderer::RebuildStaging()
+{
+	mPositions.clear();
+	mColors.clear();
+	mGroups.clear();
+	mNodeRanges.clear();
+	mNodeRangeOffsets.clear();
+	mChunks.Clear();
+	mVertexCount = 0;
+	mStagedLod = mPath == RENDER_OCTREE_LOD;
+	if (mCloud == NULL || mCloud->Empty()) {
+		return;
+	}
+
+	//按尺寸分桶，同一桶的点连续存放，桶内再按空间分块排列；八叉树方式下同一节点的点连续存放，节点内再按桶排列
+	const PointsCloud& cloud = *mCloud;
+	size_t count = cloud.Size();
+	SizeBuckets buckets;
+	BuildSizeBuckets(cloud, mBucketConfig, buckets);
+	mBucketSizes = buckets.sizes;
+
+	std::vector<uint32_t> order;
+	if (mStagedLod) {
+		BuildLodOrder(buckets, order);
+		if (order.size() != count) {
+			return;
+		}
+	} else {
+		for (int b = 0; b < buckets.BucketCount(); b++) {
+			if (buckets.BucketSize(b) > 0) {
+				SizeGroup group = { buckets.sizes[b], buckets.offsets[b], buckets.BucketSize(b) };
+				mGroups.push_back(group);
+			}
+		}
+		mChunks.Build(cloud, buckets, order);
+	}
+
+	mPositions.resize(count * 3);
+	parallel_for_(Range(0, (int)((count + STAGING_BLOCK - 1) / STAGING_BLOCK)), [&](const Range& range) {
+		TRACE_SCOPE("CloudRenderer staging");
+		size_t end = MIN(count, (size_t)range.end * STAGING_BLOCK);
+		for (size_t k = (size_t)range.start * STAGING_BLOCK; k < end; k++) {
+			size_t i = order[k];
+			mPositions[k * 3] = cloud.x[i];
+			mPositions[k * 3 + 1] = cloud.y[i];
+			mPositions[k * 3 + 2] = cloud.z[i];
+		}
+	});
+
+	if (mColorMode == COLOR_INTENSITY) {
+		//强度线性映射到0~255后查JET伪彩色表
+		float lower, upper;
+		if (!ColumnMinMax(cloud.intensity.data(), count, lower, upper)) {
+			lower = upper = 0;
+		}
+		float scale = upper > lower ? 255.0f / (upper - lower) : 0;
+
+		Mat gray(1, 256, CV_8UC1), lut;
+		for (int v = 0; v < 256; v++) {
+			gray.at<uchar>(0, v) = (uchar)v;
+		}
+		applyColorMap(gray, lut, COLORMAP_JET);
+
+		mColors.resize(count * 3);
+		for (size_t k = 0; k < count; k++) {
+			int v = cvRound((cloud.intensity[order[k]] - lower) * scale);
+			const Vec3b& bgr = lut.at<Vec3b>(0, MIN(MAX(v, 0), 255));
+			mColors[k * 3] = bgr[2];
+			mColors[k * 3 + 1] = bgr[1];
+			mColors[k * 3 + 2] = bgr[0];
+		}
+	} else if (mColorMode == COLOR_RGB) {
+		//rgb字段为PCD约定的打包0x00RRGGBB，没有该字段时为白色
+		const PointField* field = cloud.FindField(RGB_FIELD_NAME);
+		const uint32_t* rgb = field && field->ElemSize() == 4 ? (const uint32_t*)field->data.data() : NULL;
+		mColors.resize(count * 3);
+		for (size_t k = 0; k < count; k++) {
+			uint32_t color = rgb ? rgb[order[k]] : 0xFFFFFF;
+			mColors[k * 3] = (unsigned char)(color >> 16);
+			mColors[k * 3 + 1] = (unsigned char)(color >> 8);
+			mColors[k * 3 + 2] = (unsigned char)color;
+		}
+	}
+	mVertexCount = count;
+}
+
+void CloudRenderer::BuildLodOrder(const SizeBuckets& buckets, std::vector<uint32_t>& order)
+{
+	if (mOctree.Empty()) {
+		int64 startTick = getTickCount();
+		mOctree.Build(*mCloud, OctreeConfig());
+		printf("build octree: %zu nodes in %.2f ms\n", mOctree.Nodes().size(),
+			(getTickCount() - startTick) * 1000 / getTickFrequency());
+	}
+	const std::vector<OctreeNode>& nodes = mOctree.Nodes();
+	if (nodes.empty()) {
+		return;
+	}
+
+	//每个点所在的尺寸桶
+	int bucketCount = buckets.BucketCount();
+	std::vector<unsigned short> ids;
+	BucketIds(buckets, ids);
+
+	//各节点内按桶做稳定的计数排序
+	const std::vector<uint32_t>& octreeOrder = mOctree.Order();
+	order.resize(octreeOrder.size());
+	parallel_for_(Range(0, (int)nodes.size()), [&](const Range& range) {
+		std::vector<size_t> offsets(bucketCount + 1);
+		for (int n = range.start; n < range.end; n++) {
+			const OctreeNode& node = nodes[n];
+			std::fill(offsets.begin(), offsets.end(), 0);
+			for (size_t k = node.first; k < node.first + node.count; k++) {
+				offsets[ids[octreeOrder[k]] + 1]++;
+			}
+			offsets[0] = node.first;
+			for (int b = 0; b < bucketCount; b++) {
+				offsets[b + 1] += offsets[b];
+			}
+			for (size_t k = node.first; k < node.first + node.count; k++) {
+				order[offsets[ids[octreeOrder[k]]]++] = octreeOrder[k];
+			}
+		}
+	});
+
+	//记录各节点内每个桶的顶点范围
+	mNodeRangeOffsets.resize(nodes.size() + 1);
+	for (size_t n = 0; n < nodes.size(); n++) {
+		mNodeRangeOffsets[n] = mNodeRanges.size();
+		const OctreeNode& node = nodes[n];
+		for (size_t k = node.first; k < node.first + node.count; k++) {
+			int bucket = ids[order[k]];
+			if (k == node.first || bucket != mNodeRanges.back().bucket) {
+				NodeRange range = { bucket, (GLint)k, 0 };
+				mNodeRanges.push_back(range);
+			}
+			mNodeRanges.back().count++;
+		}
+	}
+	mNodeRangeOffsets[nodes.size()] = mNodeRanges.size();
+}
+
+void CloudRenderer::Upload()
+{
+	RebuildStaging();
+	mDirty = false;
+	if (!LoadBufferFunctions()) {
+		return;
+	}
+
+	if (mPositionBuffer == 0) {
+		glGenBuffersPtr(1, &mPositionBuffer);
+		glGenBuffersPtr(1, &mColorBuffer);
+	}
+	glBindBufferPtr(GL_ARRAY_BUFFER, mPositionBuffer);
+	glBufferDataPtr(GL_ARRAY_BUFFER, mPositions.size() * sizeof(float), mPositions.empty() ? NULL : &mPositions[0], GL_STATIC_DRAW);
+	glBindBufferPtr(GL_ARRAY_BUFFER, mColorBuffer);
+	glBufferDataPtr(GL_ARRAY_BUFFER, mColors.size(), mColors.empty() ? NULL : &mColors[0], GL_STATIC_DRAW);
+	glBindBufferPtr(GL_ARRAY_BUFFER, 0);
+
+	//数据已在显存中，释放CPU端暂存
+	std::vector<float>().swap(mPositions);
+	std::vector<unsigned char>().swap(mColors);
+}
+
+size_t CloudRenderer::DrawImmediate(size_t& points)
+{
+	if (mCloud == NULL) {
+		return 0;
+	}
+
+	const PointsCloud& cloud = *mCloud;
+	for (size_t i = 0; i < cloud.Size(); i++) {
+		glPointSize(cloud.intensity[i]/100);
+		glBegin(GL_POINTS);
+		glColor3f(0, 1, 0);
+		glVertex3f(cloud.x[i], cloud.y[i], cloud.z[i]);
+		glEnd();
+	}
+	points = cloud.Size();
+	return cloud.Size();
+}
+
+size_t CloudRenderer::DrawGroups(size_t& points)
+{
+	size_t drawCalls = 0;
+	if (!mCulling) {
+		for (size_t g = 0; g < mGroups.size(); g++) {
+			const SizeGroup& group = mGroups[g];
+			glPointSize(group.size);
+			for (size_t first = group.first; first < group.first + group.count; first += MAX_DRAW_COUNT) {
+				size_t count = MIN((size_t)MAX_DRAW_COUNT, group.first + group.count - first);
+				glDrawArrays(GL_POINTS, (GLint)first, (GLsizei)count);
+				drawCalls++;
+			}
+		}
+		mLastCull = CullStats();
+		mLastCull.submittedPoints = mVertexCount;
+		points = mVertexCount;
+		return drawCalls;
+	}
+
+	Frustum frustum;
+	LodView view = CurrentView();
+	frustum.Extract(view.projection, view.modelview);
+	mChunks.Cull(frustum, mVisibleChunks, mLastCull);
+
+	//同一桶内相邻的可见分块首尾相接，合并为一段
+	ResetDrawRanges();
+	const std::vector<ChunkRange>& ranges = mChunks.Ranges();
+	for (size_t r = 0; r < ranges.size(); r++) {
+		const ChunkRange& range = ranges[r];
+		if (!mVisibleChunks[range.chunk]) {
+			continue;
+		}
+		std::vector<GLint>& firsts = mDrawFirsts[range.bucket];
+		std::vector<GLsizei>& counts = mDrawCounts[range.bucket];
+		if (!firsts.empty() && firsts.back() + (size_t)counts.back() == range.first
+			&& (size_t)counts.back() + range.count <= MAX_DRAW_COUNT) {
+			counts.back() += (GLsizei)range.count;
+		} else {
+			firsts.push_back((GLint)range.first);
+			counts.push_back((GLsizei)range.count);
+		}
+	}
+	points = mLastCull.submittedPoints;
+	return SubmitRanges();
+}
+
+size_t CloudRenderer::DrawLod(size_t& points)
+{
+	LodConfig config = mLod;
+	config.frustumCulling = mCulling;
+	points = mOctree.Select(CurrentView(), config, mLodNodes, &mLastCull);
+
+	//选中节点的分段按桶归并，每桶设置一次尺寸
+	ResetDrawRanges();
+	for (size_t i = 0; i < mLodNodes.size(); i++) {
+		int n = mLodNodes[i];
+		for (size_t r = mNodeRangeOffsets[n]; r < mNodeRangeOffsets[n + 1]; r++) {
+			const NodeRange& range = mNodeRanges[r];
+			mDrawFirsts[range.bucket].push_back(range.first);
+			mDrawCounts[range.bucket].push_back(range.count);
+		}
+	}
+	return SubmitRanges();
+}
+
+void CloudRenderer::ResetDrawRanges()
+{
+	mDrawFirsts.resize(mBucketSizes.size());
+	mDrawCounts.resize(mBucketSizes.size());
+	for (size_t b = 0; b < mBucketSizes.size(); b++) {
+		mDrawFirsts[b].clear();
+		mDrawCounts[b].clear();
+	}
+}
+
+size_t CloudRenderer::SubmitRanges()
+{
+	size_t drawCalls = 0;
+	for (size_t b = 0; b < mBucketSizes.size(); b++) {
+		const std::vector<GLint>& firsts = mDrawFirsts[b];
+		const std::vector<GLsizei>& counts = mDrawCounts[b];
+		if (firsts.empty()) {
+			continue;
+		}
+		glPointSize(mBucketSizes[b]);
+		if (glMultiDrawArraysPtr != NULL && firsts.size() > 1) {
+			glMultiDrawArraysPtr(GL_POINTS, &firsts[0], &counts[0], (GLsizei)firsts.size());
+			drawCalls++;
+		} else {
+			for (size_t i = 0; i < firsts.size(); i++) {
+				glDrawArrays(GL_POINTS, firsts[i], counts[i]);
+			}
+			drawCalls += firsts.size();
+		}
+	}
+	return drawCalls;
+}
+
+size_t CloudRenderer::DrawBuffers(size_t& points)
+{
+	if (mDirty || mStagedLod != (mPath == RENDER_OCTREE_LOD)) {
+		Upload();
+	}
+	if (mVertexCount == 0) {
+		mLastCull = CullStats();
+		points = 0;
+		return 0;
+	}
+
+	//有顶点缓冲时指针为缓冲内偏移，否则直接指向暂存数据
+	bool hasColors = mColorMode != COLOR_FIXED;
+	glEnableClientState(GL_VERTEX_ARRAY);
+	if (mHasBuffers) {
+		glBindBufferPtr(GL_ARRAY_BUFFER, mPositionBuffer);
+		glVertexPointer(3, GL_FLOAT, 0, NULL);
+	} else {
+		glVertexPointer(3, GL_FLOAT, 0, &mPositions[0]);
+	}
+
+	if (hasColors) {
+		glEnableClientState(GL_COLOR_ARRAY);
+		if (mHasBuffers) {
+			glBindBufferPtr(GL_ARRAY_BUFFER, mColorBuffer);
+			glColorPointer(3, GL_UNSIGNED_BYTE, 0, NULL);
+		} else {
+			glColorPointer(3, GL_UNSIGNED_BYTE, 0, &mColors[0]);
+		}
+	} else {
+		glColor3f(0, 1, 0);
+	}
+
+	size_t drawCalls = mStagedLod ? DrawLod(points) : DrawGroups(points);
+
+	if (hasColors) {
+		glDisableClientState(GL_COLOR_ARRAY);
+	}
+	glDisableClientState(GL_VERTEX_ARRAY);
+	if (mHasBuffers) {
+		glBindBufferPtr(GL_ARRAY_BUFFER, 0);
+	}
+	return drawCalls;
+}
+
+void CloudRenderer::Draw()
+{
+	TRACE_SCOPE("CloudRenderer::Draw");
+	int64 startTick = getTickCount();
+
+	size_t points = 0;
+	size_t drawCalls;
+	if (mPath == RENDER_IMMEDIATE) {
+		drawCalls = DrawImmediate(points);
+		mLastCull = CullStats();
+		mLastCull.submittedPoints = points;
+	} else {
+		drawCalls = DrawBuffers(points);
+	}
+
+	if (mTiming) {
+		glFinish();
+		FrameStats& stats = mStats[mPath];
+		stats.lastMs = (getTickCount() - startTick) * 1000 / getTickFrequency();
+		stats.totalMs += stats.lastMs;
+		stats.frames++;
+		stats.drawCalls = drawCalls;
+		stats.points = points;
+		stats.culledPoints = mLastCull.culledPoints;
+	}
+}
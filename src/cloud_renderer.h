@@ -0,0 +1,167 @@
+﻿#pragma once
+
+#include "gl_headers.h"
+#include "points_cloud.h"
+#include "size_buckets.h"
+#include "points_octree.h"
+#include "cloud_chunks.h"
+#include <vector>
+
+/* 绘制方式 */
+enum RenderPath {
+	RENDER_IMMEDIATE = 0,		//逐点glBegin/glEnd，作为对照
+	RENDER_VERTEX_BUFFER = 1,	//顶点缓冲批量绘制
+	RENDER_OCTREE_LOD = 2,		//八叉树细节层次，每帧点数受预算限制
+	RENDER_PATH_COUNT
+};
+
+const char* RenderPathName(RenderPath path);
+
+/* 着色方式 */
+enum ColorMode {
+	COLOR_FIXED = 0,			//统一绿色
+	COLOR_INTENSITY = 1,		//按强度映射伪彩色
+	COLOR_RGB = 2,				//逐点rgb字段
+	COLOR_MODE_COUNT
+};
+
+/* 帧耗时统计 */
+struct FrameStats {
+	int frames;
+	double totalMs;
+	double lastMs;
+	size_t drawCalls;			//最近一帧的绘制调用次数
+	size_t points;				//最近一帧提交的点数
+	size_t culledPoints;		//最近一帧被视锥剔除的点数
+
+	FrameStats() : frames(0), totalMs(0), lastMs(0), drawCalls(0), points(0), culledPoints(0) {}
+
+	double AverageMs() const { return frames > 0 ? totalMs / frames : 0; }
+};
+
+/**
+  * 点云绘制器，调用Draw前需设置好投影与模型视图矩阵。
+  * 顶点缓冲方式下，CPU端暂存数据只在点云变化(SetCloud/Invalidate)后重建一次并上传，
+  * 点按强度量化到有限个尺寸桶，每桶只设置一次glPointSize并调用一次glDrawArrays，
+  * 每帧的状态切换次数不超过桶数。
+  * 八叉树方式下顶点按节点、节点内再按尺寸桶存放，每帧按相机选出节点后逐桶合并绘制。
+  * 两种缓冲方式均在CPU端按分块或节点的包围盒做视锥剔除，只提交可见部分
+  */
+class CloudRenderer {
+public:
+	CloudRenderer();
+
+	/**
+	  * 设置要绘制的点云，下次绘制时重建暂存数据
+	  * @param[in] cloud 点云，绘制期间需保持有效
+	  */
+	void SetCloud(const PointsCloud* cloud);
+
+	/**
+	  * 点云内容被修改后调用，下次绘制时重建暂存数据
+	  */
+	void Invalidate();
+
+	void Draw();
+
+	void SetPath(RenderPath path) { mPath = path; }
+	RenderPath Path() const { return mPath; }
+
+	/**
+	  * 设置尺寸分桶配置，下次绘制时重建暂存数据
+	  */
+	void SetSizeBuckets(const SizeBucketConfig& config);
+	const SizeBucketConfig& BucketConfig() const { return mBucketConfig; }
+
+	/**
+	  * 设置八叉树方式的点数预算与误差阈值，每帧生效
+	  */
+	void SetLod(const LodConfig& config) { mLod = config; }
+	const LodConfig& Lod() const { return mLod; }
+
+	/**
+	  * 开关视锥剔除，逐点绘制方式始终提交全部点
+	  */
+	void SetCulling(bool enable) { mCulling = enable; }
+	bool Culling() const { return mCulling; }
+
+	/**
+	  * 最近一帧的剔除统计，未开启剔除时submittedPoints为提交的全部点数
+	  */
+	const CullStats& LastCull() const { return mLastCull; }
+
+	void SetColorMode(ColorMode mode);
+	ColorMode GetColorMode() const { return mColorMode; }
+
+	/**
+	  * 开启后每帧以glFinish结束并统计耗时
+	  */
+	void SetTiming(bool enable) { mTiming = enable; }
+	bool Timing() const { return mTiming; }
+
+	const FrameStats& Stats(RenderPath path) const { return mStats[path]; }
+	void ResetStats();
+	void PrintStats() const;
+
+private:
+	/* 尺寸相同的一组连续顶点 */
+	struct SizeGroup {
+		float size;
+		size_t first;
+		size_t count;
+	};
+
+	/* 八叉树节点内属于同一尺寸桶的一段连续顶点 */
+	struct NodeRange {
+		int bucket;
+		GLint first;
+		GLsizei count;
+	};
+
+	bool LoadBufferFunctions();
+	void RebuildStaging();
+	void BuildLodOrder(const SizeBuckets& buckets, std::vector<uint32_t>& order);
+	void Upload();
+	size_t DrawImmediate(size_t& points);
+	size_t DrawBuffers(size_t& points);
+	size_t DrawGroups(size_t& points);
+	size_t DrawLod(size_t& points);
+	void ResetDrawRanges();
+	size_t SubmitRanges();
+
+	const PointsCloud* mCloud;
+	RenderPath mPath;
+	ColorMode mColorMode;
+	SizeBucketConfig mBucketConfig;
+	bool mTiming;
+	bool mDirty;
+	bool mCulling;
+
+	std::vector<float> mPositions;
+	std::vector<unsigned char> mColors;
+	std::vector<SizeGroup> mGroups;
+	size_t mVertexCount;
+	bool mStagedLod;			//暂存数据是否按八叉树排列
+
+	PointsOctree mOctree;
+	LodConfig mLod;
+	std::vector<float> mBucketSizes;
+	std::vector<NodeRange> mNodeRanges;
+	std::vector<size_t> mNodeRangeOffsets;	//第n个节点的分段为mNodeRanges[mNodeRangeOffsets[n]]起
+	std::vector<int> mLodNodes;
+
+	CloudChunks mChunks;
+	std::vector<unsigned char> mVisibleChunks;
+	CullStats mLastCull;
+
+	//每个尺寸桶本帧要绘制的顶点范围
+	std::vector<std::vector<GLint> > mDrawFirsts;
+	std::vector<std::vector<GLsizei> > mDrawCounts;
+
+	bool mFunctionsLoaded;
+	bool mHasBuffers;
+	GLuint mPositionBuffer;
+	GLuint mColorBuffer;
+
+	FrameStats mStats[RENDER_PATH_COUNT];
+};
@@ -0,0 +1,359 @@
+﻿#include "cloud_sequence.h"
+#include "trace.h"
+#include "cloud_loader.h"
+#include "opencv2/core/utility.hpp"
+#include <algorithm>
+#include <stdio.h>
+
+using namespace cv;
+
+#define MIN_SEQUENCE_FPS		1
+#define MAX_SEQUENCE_FPS		240
+
+static bool IsCloudFile(const String& path)
+{
+	size_t dot = path.find_last_of('.');
+	if (dot == String::npos) {
+		return false;
+	}
+	std::string extension = path.substr(dot);
+	std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+	return extension == ".txt" || extension == ".xyzi" || extension == ".pcd";
+}
+
+CloudSequence::CloudSequence()
+	: mStopping(false), mNextDecode(0), mCurrent(-1), mFloor(0), mLastLate(-1),
+	mFps(DEFAULT_SEQUENCE_FPS), mPlaying(false), mBaseFrame(0), mBaseTick(0)
+{
+}
+
+CloudSequence::~CloudSequence()
+{
+	Stop();
+}
+
+bool CloudSequence::Open(const std::string& pattern)
+{
+	Stop();
+	std::vector<String> files;
+	glob(pattern, files, false);
+
+	mFiles.clear();
+	for (size_t i = 0; i < files.size(); i++) {
+		if (IsCloudFile(files[i])) {
+			mFiles.push_back(files[i]);
+		}
+	}
+	return !mFiles.empty();
+}
+
+void CloudSequence::Start(size_t ringSize, int threads)
+{
+	Stop();
+	mSlots.resize(MAX(ringSize, (size_t)1));
+	for (size_t i = 0; i < mSlots.size(); i++) {
+		mSlots[i].frame = -1;
+		mSlots[i].cancelled = false;
+		mSlots[i].state = SLOT_FREE;
+	}
+	mStopping = false;
+	mNextDecode = 0;
+	mCurrent = -1;
+	mFloor = 0;
+	mLastLate = -1;
+	mStats = SequenceStats();
+	mPlaying = true;
+	Rebase(0, getTickCount());
+
+	for (int i = 0; i < MAX(threads, 1); i++) {
+		mThreads.push_back(std::thread(&CloudSequence::Worker, this));
+	}
+}
+
+void CloudSequence::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStopping = true;
+	}
+	mCondition.notify_all();
+	for (size_t i = 0; i < mThreads.size(); i++) {
+		mThreads[i].join();
+	}
+	mThreads.clear();
+	mSlots.clear();
+}
+
+long CloudSequence::DueFrame(int64 now) const
+{
+	if (!mPlaying) {
+		return mBaseFrame;
+	}
+	return mBaseFrame + (long)((now - mBaseTick) * mFps / getTickFrequency());
+}
+
+int64 CloudSequence::DueTick(long frame) const
+{
+	return mBaseTick + (int64)((frame - mBaseFrame) * getTickFrequency() / mFps);
+}
+
+void CloudSequence::Rebase(long frame, int64 now)
+{
+	mBaseFrame = frame;
+	mBaseTick = now;
+}
+
+bool CloudSequence::InRing(long frame) const
+{
+	for (size_t i = 0; i < mSlots.size(); i++) {
+		if (mSlots[i].state != SLOT_FREE && !mSlots[i].cancelled && mSlots[i].frame == frame) {
+			return true;
+		}
+	}
+	return false;
+}
+
+size_t CloudSequence::FileIndex(long frame) const
+{
+	return (size_t)(frame % (long)mFiles.size());
+}
+
+void CloudSequence::SetFps(double fps)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	int64 now = getTickCount();
+	long due = DueFrame(now);
+	mFps = MIN(MAX(fps, (double)MIN_SEQUENCE_FPS), (double)MAX_SEQUENCE_FPS);
+	if (mPlaying) {
+		Rebase(due, now);
+	}
+}
+
+void CloudSequence::Play()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (mPlaying) {
+			return;
+		}
+		//当前帧再显示一个帧间隔后继续
+		Rebase(mCurrent >= 0 ? mCurrent : mBaseFrame, getTickCount());
+		mPlaying = true;
+	}
+	mCondition.notify_all();
+}
+
+void CloudSequence::Pause()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	if (!mPlaying) {
+		return;
+	}
+	mPlaying = false;
+	Rebase(mCurrent >= 0 ? mCurrent : mBaseFrame, getTickCount());
+}
+
+long CloudSequence::Seek(long frame)
+{
+	if (mFiles.empty()) {
+		return -1;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		long count = (long)mFiles.size();
+		frame = (frame % count + count) % count;
+		Rebase(frame, getTickCount());
+		mFloor = frame;
+		mNextDecode = frame;
+		mLastLate = -1;
+
+		//保留跳转后仍会用到的预读帧，其余丢弃
+		for (size_t i = 0; i < mSlots.size(); i++) {
+			Slot& slot = mSlots[i];
+			if (slot.state == SLOT_FREE || (slot.frame >= frame && slot.frame < frame + (long)mSlots.size())) {
+				continue;
+			}
+			if (slot.state == SLOT_READY) {
+				slot.state = SLOT_FREE;
+				slot.frame = -1;
+			} else {
+				slot.cancelled = true;
+			}
+		}
+	}
+	mCondition.notify_all();
+	return frame;
+}
+
+long CloudSequence::Step(long delta)
+{
+	Pause();
+	long current = Current();
+	return Seek((current >= 0 ? current : 0) + delta);
+}
+
+long CloudSequence::Current() const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mCurrent >= 0 ? (long)FileIndex(mCurrent) : -1;
+}
+
+bool CloudSequence::Present(PointsCloud& cloud)
+{
+	TRACE_SCOPE("CloudSequence::Present");
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		int64 now = getTickCount();
+		long due = DueFrame(now);
+
+		//已解码的帧中不晚于当前时刻的最新一帧
+		Slot* best = NULL;
+		size_t depth = 0;
+		for (size_t i = 0; i < mSlots.size(); i++) {
+			Slot& slot = mSlots[i];
+			if (slot.state != SLOT_READY) {
+				continue;
+			}
+			depth++;
+			if (slot.frame <= due && slot.frame >= mFloor && (best == NULL || slot.frame > best->frame)) {
+				best = &slot;
+			}
+		}
+		if (best == NULL) {
+			if (mPlaying && due >= mFloor && due != mLastLate) {
+				mStats.late++;
+				mLastLate = due;
+			}
+			return false;
+		}
+
+		//被超过的帧不再显示，缓冲直接回收
+		for (size_t i = 0; i < mSlots.size(); i++) {
+			Slot& slot = mSlots[i];
+			if (slot.state == SLOT_READY && slot.frame < best->frame) {
+				slot.state = SLOT_FREE;
+				slot.frame = -1;
+				mStats.dropped++;
+			}
+		}
+
+		//交换内容，显示用点云原来的内存成为空闲缓冲
+		std::swap(cloud, best->cloud);
+		mCurrent = best->frame;
+		mFloor = mCurrent + 1;
+		best->state = SLOT_FREE;
+		best->frame = -1;
+
+		double latency = MAX((now - DueTick(mCurrent)) * 1000 / getTickFrequency(), 0.0);
+		mStats.presented++;
+		mStats.queueDepth += depth;
+		mStats.maxQueueDepth = MAX(mStats.maxQueueDepth, depth);
+		mStats.presentMs += latency;
+		mStats.maxPresentMs = MAX(mStats.maxPresentMs, latency);
+	}
+	mCondition.notify_all();
+	return true;
+}
+
+int CloudSequence::WaitMs() const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	if (!mPlaying || mFiles.empty()) {
+		return -1;
+	}
+	int64 now = getTickCount();
+	int64 remain = DueTick(DueFrame(now) + 1) - now;
+	return remain > 0 ? (int)(remain * 1000 / getTickFrequency()) + 1 : 0;
+}
+
+SequenceStats CloudSequence::Stats() const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mStats;
+}
+
+void CloudSequence::ResetStats()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mStats = SequenceStats();
+}
+
+void CloudSequence::PrintStats() const
+{
+	SequenceStats stats = Stats();
+	size_t presented = MAX(stats.presented, (size_t)1);
+	printf("sequence %.0f fps: decoded %zu presented %zu dropped %zu late %zu\n", mFps, stats.decoded,
+		stats.presented, stats.dropped, stats.late);
+	printf("  decode mean %.2f ms max %.2f ms, queue depth mean %.1f max %zu, present latency mean %.2f ms max %.2f ms\n",
+		stats.decodeMs / MAX(stats.decoded, (size_t)1), stats.maxDecodeMs, (double)stats.queueDepth / presented,
+		stats.maxQueueDepth, stats.presentMs / presented, stats.maxPresentMs);
+}
+
+void CloudSequence::Worker()
+{
+	SetTraceThreadName("sequence decode");
+	std::unique_lock<std::mutex> lock(mMutex);
+	while (true) {
+		Slot* slot = NULL;
+		mCondition.wait(lock, [this, &slot] {
+			if (mStopping) {
+				return true;
+			}
+			for (size_t i = 0; i < mSlots.size() && slot == NULL; i++) {
+				if (mSlots[i].state == SLOT_FREE) {
+					slot = &mSlots[i];
+				}
+			}
+			return slot != NULL;
+		});
+		if (mStopping) {
+			return;
+		}
+
+		//从应显示的帧开始预读，已过期而未解码的帧直接跳过
+		long due = MAX(DueFrame(getTickCount()), mFloor);
+		if (mNextDecode < due) {
+			mStats.dropped += due - mNextDecode;
+			mNextDecode = due;
+		}
+		long frame = mNextDecode;
+		while (InRing(frame)) {
+			frame++;
+		}
+		mNextDecode = frame + 1;
+		slot->frame = frame;
+		slot->cancelled = false;
+		slot->state = SLOT_DECODING;
+
+		lock.unlock();
+		LoadStats stats;
+		const std::string& path = mFiles[FileIndex(frame)];
+		bool loaded;
+		{
+			TRACE_SCOPE("sequence decode");
+			loaded = LoadPointsCloud(path, slot->cloud, &stats, false);
+		}
+		if (!loaded) {
+			printf("cannot load sequence frame %s\n", path.c_str());
+		}
+		lock.lock();
+
+		if (!loaded || slot->cancelled || mStopping) {
+			slot->state = SLOT_FREE;
+			slot->frame = -1;
+			slot->cancelled = false;
+			mCondition.notify_all();
+			continue;
+		}
+		slot->state = SLOT_READY;
+		mStats.decoded++;
+		mStats.decodeMs += stats.seconds * 1000;
+		mStats.maxDecodeMs = MAX(mStats.maxDecodeMs, stats.seconds * 1000);
+
+		if (mReadyCallback) {
+			lock.unlock();
+			mReadyCallback();
+			lock.lock();
+		}
+	}
+}
@@ -0,0 +1,144 @@
+﻿#pragma once
+
+#include "points_cloud.h"
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define DEFAULT_SEQUENCE_FPS	10
+#define DEFAULT_RING_SIZE		8		//预读缓冲的点云个数
+
+/* 序列播放统计 */
+struct SequenceStats {
+	size_t decoded;
+	size_t presented;
+	size_t dropped;				//解码太慢或已被后面的帧超过而没有显示的帧数
+	size_t late;				//到显示时间时尚未解码完、继续显示上一帧的帧数
+	double decodeMs;			//解码耗时总和
+	double maxDecodeMs;
+	size_t queueDepth;			//每次显示时已解码待显示帧数的总和
+	size_t maxQueueDepth;
+	double presentMs;			//从应显示时刻到实际显示的延迟总和
+	double maxPresentMs;
+
+	SequenceStats() : decoded(0), presented(0), dropped(0), late(0), decodeMs(0), maxDecodeMs(0),
+		queueDepth(0), maxQueueDepth(0), presentMs(0), maxPresentMs(0) {}
+};
+
+/**
+  * 逐帧点云文件的序列播放。后台线程把即将显示的帧解码到固定数量、循环复用的点云缓冲中，
+  * 主循环调用Present按播放时间取出应显示的帧，与显示用点云交换内容而不拷贝。
+  * 解码跟不上时跳过过期的帧，不阻塞主循环；播放到结尾后从头循环
+  */
+class CloudSequence {
+public:
+	CloudSequence();
+	~CloudSequence();
+
+	/**
+	  * 列出序列的帧文件
+	  * @param[in] pattern 目录或通配符，如frames/frame_*.txt，按文件名排序
+	  * @return 没有找到点云文件时返回false
+	  */
+	bool Open(const std::string& pattern);
+
+	bool IsOpen() const { return !mFiles.empty(); }
+	size_t FrameCount() const { return mFiles.size(); }
+
+	/**
+	  * 启动解码线程，从第0帧开始播放
+	  * @param[in] ringSize 预读缓冲个数
+	  * @param[in] threads 解码线程数，每个文件的解析本身也是多线程的
+	  */
+	void Start(size_t ringSize = DEFAULT_RING_SIZE, int threads = 2);
+	void Stop();
+
+	/**
+	  * 设置某一帧解码完成时的通知，在解码线程中调用，需在Start之前设置
+	  */
+	void SetReadyCallback(std::function<void()> callback) { mReadyCallback = callback; }
+
+	void SetFps(double fps);
+	double Fps() const { return mFps; }
+
+	void Play();
+	void Pause();
+	bool Playing() const { return mPlaying; }
+
+	/**
+	  * 跳转到指定帧，丢弃不再需要的预读帧，播放状态不变
+	  * @return 跳转到的帧，超出范围时循环
+	  */
+	long Seek(long frame);
+
+	/**
+	  * 暂停并前后移动若干帧
+	  * @return 跳转到的帧
+	  */
+	long Step(long delta);
+
+	/**
+	  * 当前显示的帧序号，尚未显示任何帧时为-1
+	  */
+	long Current() const;
+
+	/**
+	  * 取出当前应显示的帧，与cloud交换内容，cloud原来的内存回到缓冲池中复用；帧未解码完时不等待
+	  * @return cloud是否换成了新的一帧
+	  */
+	bool Present(PointsCloud& cloud);
+
+	/**
+	  * 距下一帧应显示的毫秒数，暂停时返回-1
+	  */
+	int WaitMs() const;
+
+	SequenceStats Stats() const;
+	void ResetStats();
+	void PrintStats() const;
+
+private:
+	enum SlotState {
+		SLOT_FREE = 0,
+		SLOT_DECODING = 1,
+		SLOT_READY = 2
+	};
+
+	struct Slot {
+		PointsCloud cloud;
+		long frame;
+		bool cancelled;				//解码中被跳转取消，完成后直接丢弃
+		SlotState state;
+	};
+
+	void Worker();
+	long DueFrame(int64 now) const;
+	int64 DueTick(long frame) const;
+	void Rebase(long frame, int64 now);
+	bool InRing(long frame) const;
+	size_t FileIndex(long frame) const;
+
+	std::vector<std::string> mFiles;
+	std::vector<Slot> mSlots;
+	std::vector<std::thread> mThreads;
+	std::function<void()> mReadyCallback;
+
+	mutable std::mutex mMutex;
+	std::condition_variable mCondition;
+	bool mStopping;
+	long mNextDecode;			//下一个待解码的帧
+	long mCurrent;				//当前显示的帧
+	long mFloor;				//下一次显示的帧不早于该帧
+	long mLastLate;				//上次计为迟到的帧，避免重复计数
+
+	//播放时刻t应显示的帧为 mBaseFrame + (t - mBaseTick) * mFps
+	double mFps;
+	bool mPlaying;
+	long mBaseFrame;
+	int64 mBaseTick;
+
+	SequenceStats mStats;
+};
@@ -0,0 +1,218 @@
+﻿#include "cloud_stats.h"
+#include "simd_intrin.h"
+#include "trace.h"
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+
+#define STATS_SUM_BATCH			1024	//SIMD求和先在float中累加的点数，之后转为double
+
+using namespace cv;
+
+CloudStats::CloudStats(float histogramLower, float histogramUpper, int bins)
+	: mHistogramLower(histogramLower), mHistogramUpper(histogramUpper), mHistogram(MAX(bins, 1), 0)
+{
+	Reset();
+}
+
+void CloudStats::Reset()
+{
+	mProcessed = 0;
+	mCount = 0;
+	mLower = Point3f(FLT_MAX, FLT_MAX, FLT_MAX);
+	mUpper = Point3f(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	mSum[0] = mSum[1] = mSum[2] = 0;
+
+	mIntensityCount = 0;
+	mIntensityLower = FLT_MAX;
+	mIntensityUpper = -FLT_MAX;
+	mIntensitySum = 0;
+	std::fill(mHistogram.begin(), mHistogram.end(), 0);
+}
+
+void CloudStats::Compute(const PointsCloud& cloud)
+{
+	Reset();
+	Update(cloud);
+}
+
+void CloudStats::Update(const PointsCloud& cloud)
+{
+	if (cloud.Size() < mProcessed) {
+		Reset();
+	}
+	size_t begin = mProcessed;
+	Accumulate(cloud.x.data() + begin, cloud.y.data() + begin, cloud.z.data() + begin,
+		cloud.intensity.data() + begin, cloud.Size() - begin);
+}
+
+void CloudStats::Accumulate(const float* x, const float* y, const float* z, const float* intensity, size_t count)
+{
+	int blockCount = (int)((count + STATS_BLOCK_POINTS - 1) / STATS_BLOCK_POINTS);
+	if (blockCount <= 1) {
+		AccumulateBlock(x, y, z, intensity, count);
+		return;
+	}
+
+	//各块分别累加，按块序合并，浮点求和的结果不随线程调度变化
+	TRACE_SCOPE("CloudStats::Accumulate");
+	std::vector<CloudStats> blocks(blockCount, CloudStats(mHistogramLower, mHistogramUpper, (int)mHistogram.size()));
+	parallel_for_(Range(0, blockCount), [&](const Range& range) {
+		for (int b = range.start; b < range.end; b++) {
+			size_t begin = (size_t)b * STATS_BLOCK_POINTS;
+			size_t points = MIN(count - begin, (size_t)STATS_BLOCK_POINTS);
+			blocks[b].AccumulateBlock(x + begin, y + begin, z + begin, intensity ? intensity + begin : NULL, points);
+		}
+	});
+	for (int b = 0; b < blockCount; b++) {
+		Merge(blocks[b]);
+	}
+}
+
+void CloudStats::AccumulateBlock(const float* x, const float* y, const float* z, const float* intensity, size_t count)
+{
+	mProcessed += count;
+	int bins = (int)mHistogram.size();
+	float binScale = mHistogramUpper > mHistogramLower ? bins / (mHistogramUpper - mHistogramLower) : 0;
+	size_t i = 0;
+
+#if CV_SIMD128
+	v_float32x4 zero = v_setzero_f32(), one = v_setall_f32(1);
+	v_float32x4 lowerX = v_setall_f32(mLower.x), lowerY = v_setall_f32(mLower.y), lowerZ = v_setall_f32(mLower.z);
+	v_float32x4 upperX = v_setall_f32(mUpper.x), upperY = v_setall_f32(mUpper.y), upperZ = v_setall_f32(mUpper.z);
+	v_float32x4 intensityLower = v_setall_f32(mIntensityLower), intensityUpper = v_setall_f32(mIntensityUpper);
+	v_float32x4 histogramLower = v_setall_f32(mHistogramLower), histogramScale = v_setall_f32(binScale);
+	v_float32x4 lastBin = v_setall_f32((float)(bins - 1));
+	int CV_DECL_ALIGNED(16) ids[4];
+	size_t simdEnd = count & ~(size_t)3;
+
+	while (i < simdEnd) {
+		size_t batchEnd = MIN(simdEnd, i + STATS_SUM_BATCH);
+		v_float32x4 sumX = zero, sumY = zero, sumZ = zero, valids = zero;
+		v_float32x4 sumIntensity = zero, intensityValids = zero;
+		for (; i < batchEnd; i += 4) {
+			v_float32x4 vx = v_load(x + i);
+			v_float32x4 vy = v_load(y + i);
+			v_float32x4 vz = v_load(z + i);
+			//nan与自身不相等，任一坐标为nan的点用当前边界和0替换
+			v_float32x4 valid = (vx == vx) & (vy == vy) & (vz == vz);
+			lowerX = v_min(lowerX, v_select(valid, vx, lowerX));
+			lowerY = v_min(lowerY, v_select(valid, vy, lowerY));
+			lowerZ = v_min(lowerZ, v_select(valid, vz, lowerZ));
+			upperX = v_max(upperX, v_select(valid, vx, upperX));
+			upperY = v_max(upperY, v_select(valid, vy, upperY));
+			upperZ = v_max(upperZ, v_select(valid, vz, upperZ));
+			sumX += v_select(valid, vx, zero);
+			sumY += v_select(valid, vy, zero);
+			sumZ += v_select(valid, vz, zero);
+			valids += v_select(valid, one, zero);
+
+			if (intensity != NULL) {
+				v_float32x4 vi = v_load(intensity + i);
+				v_float32x4 intensityValid = vi == vi;
+				intensityLower = v_min(intensityLower, v_select(intensityValid, vi, intensityLower));
+				intensityUpper = v_max(intensityUpper, v_select(intensityValid, vi, intensityUpper));
+				sumIntensity += v_select(intensityValid, vi, zero);
+				intensityValids += v_select(intensityValid, one, zero);
+
+				//先在float中截断到桶的范围再取整，超大的值不会溢出int
+				v_float32x4 bin = v_min(v_max((vi - histogramLower) * histogramScale, zero), lastBin);
+				v_store_aligned(ids, v_floor(bin));
+				for (int k = 0; k < 4; k++) {
+					if (intensity[i + k] == intensity[i + k]) {
+						mHistogram[ids[k]]++;
+					}
+				}
+			}
+		}
+		mSum[0] += v_reduce_sum(sumX);
+		mSum[1] += v_reduce_sum(sumY);
+		mSum[2] += v_reduce_sum(sumZ);
+		mCount += (size_t)v_reduce_sum(valids);
+		mIntensitySum += v_reduce_sum(sumIntensity);
+		mIntensityCount += (size_t)v_reduce_sum(intensityValids);
+	}
+
+	mLower = Point3f(v_reduce_min(lowerX), v_reduce_min(lowerY), v_reduce_min(lowerZ));
+	mUpper = Point3f(v_reduce_max(upperX), v_reduce_max(upperY), v_reduce_max(upperZ));
+	mIntensityLower = v_reduce_min(intensityLower);
+	mIntensityUpper = v_reduce_max(intensityUpper);
+#endif
+	for (; i < count; i++) {
+		float px = x[i], py = y[i], pz = z[i];
+		if (px == px && py == py && pz == pz) {
+			mLower = Point3f(MIN(mLower.x, px), MIN(mLower.y, py), MIN(mLower.z, pz));
+			mUpper = Point3f(MAX(mUpper.x, px), MAX(mUpper.y, py), MAX(mUpper.z, pz));
+			mSum[0] += px;
+			mSum[1] += py;
+			mSum[2] += pz;
+			mCount++;
+		}
+
+		if (intensity != NULL && intensity[i] == intensity[i]) {
+			float value = intensity[i];
+			mIntensityLower = MIN(mIntensityLower, value);
+			mIntensityUpper = MAX(mIntensityUpper, value);
+			mIntensitySum += value;
+			mIntensityCount++;
+			float bin = MIN(MAX((value - mHistogramLower) * binScale, 0.f), (float)(bins - 1));
+			mHistogram[(int)bin]++;
+		}
+	}
+}
+
+void CloudStats::Merge(const CloudStats& other)
+{
+	CV_Assert(mHistogram.size() == other.mHistogram.size()
+		&& mHistogramLower == other.mHistogramLower && mHistogramUpper == other.mHistogramUpper);
+
+	mProcessed += other.mProcessed;
+	mCount += other.mCount;
+	mLower = Point3f(MIN(mLower.x, other.mLower.x), MIN(mLower.y, other.mLower.y), MIN(mLower.z, other.mLower.z));
+	mUpper = Point3f(MAX(mUpper.x, other.mUpper.x), MAX(mUpper.y, other.mUpper.y), MAX(mUpper.z, other.mUpper.z));
+	for (int k = 0; k < 3; k++) {
+		mSum[k] += other.mSum[k];
+	}
+
+	mIntensityCount += other.mIntensityCount;
+	mIntensityLower = MIN(mIntensityLower, other.mIntensityLower);
+	mIntensityUpper = MAX(mIntensityUpper, other.mIntensityUpper);
+	mIntensitySum += other.mIntensitySum;
+	for (size_t b = 0; b < mHistogram.size(); b++) {
+		mHistogram[b] += other.mHistogram[b];
+	}
+}
+
+Point3f CloudStats::Centroid() const
+{
+	if (!Valid()) {
+		return Point3f();
+	}
+	return Point3f((float)(mSum[0] / mCount), (float)(mSum[1] / mCount), (float)(mSum[2] / mCount));
+}
+
+float CloudStats::Radius() const
+{
+	if (!Valid()) {
+		return 0;
+	}
+	Point3f center = Centroid();
+	Point3f extent(MAX(center.x - mLower.x, mUpper.x - center.x), MAX(center.y - mLower.y, mUpper.y - center.y),
+		MAX(center.z - mLower.z, mUpper.z - center.z));
+	return (float)norm(extent);
+}
+
+void CloudStats::ApplyBoundary(PointsCloud& cloud) const
+{
+	cloud.lowerBoundary = Lower();
+	cloud.upperBoundary = Upper();
+	cloud.UpdateCenter();
+}
+
+void CloudStats::Print(const char* name) const
+{
+	Point3f lower = Lower(), upper = Upper(), centroid = Centroid();
+	printf("%s: %zu points, bounds (%.3f, %.3f, %.3f) ~ (%.3f, %.3f, %.3f), centroid (%.3f, %.3f, %.3f), "
+		"intensity %.2f ~ %.2f mean %.2f\n", name, mCount, lower.x, lower.y, lower.z, upper.x, upper.y, upper.z,
+		centroid.x, centroid.y, centroid.z, IntensityLower(), IntensityUpper(), IntensityMean());
+}
@@ -0,0 +1,100 @@
+﻿#pragma once
+
+#include "opencv2/core.hpp"
+#include "points_cloud.h"
+#include <vector>
+
+#define STATS_HISTOGRAM_BINS	64
+#define STATS_BLOCK_POINTS		65536	//并行统计时每个任务处理的点数
+
+/**
+  * 点云统计：包围盒、质心、强度的最小值/最大值/均值与直方图。
+  * 一次并行遍历按块SIMD累加各项，块结果按块序合并，结果与线程数无关；
+  * 追加点后只需累加新增部分。坐标含nan的点不参与包围盒与质心，强度为nan时不参与强度统计
+  */
+class CloudStats {
+public:
+	/**
+	  * @param[in] histogramLower, histogramUpper 强度直方图的范围，超出范围的值归入两端的桶
+	  * @param[in] bins 桶数
+	  */
+	explicit CloudStats(float histogramLower = 0, float histogramUpper = 256, int bins = STATS_HISTOGRAM_BINS);
+
+	void Reset();
+
+	/**
+	  * 重新统计整个点云
+	  */
+	void Compute(const PointsCloud& cloud);
+
+	/**
+	  * 增量统计：只累加上次统计之后追加的点，点数变少时重新统计。
+	  * 已统计的点被修改(如Transform)后需先Reset
+	  */
+	void Update(const PointsCloud& cloud);
+
+	/**
+	  * 把一段按列存放的点追加到统计中
+	  * @param[in] x, y, z 坐标列
+	  * @param[in] intensity 强度列，NULL时只统计坐标
+	  * @param[in] count 点数
+	  */
+	void Accumulate(const float* x, const float* y, const float* z, const float* intensity, size_t count);
+
+	/**
+	  * 合并另一份统计，两者的直方图范围与桶数须一致
+	  */
+	void Merge(const CloudStats& other);
+
+	size_t Processed() const { return mProcessed; }		//已累加的点数，包括含nan的点
+	size_t Count() const { return mCount; }				//参与包围盒与质心的点数
+	bool Valid() const { return mCount > 0; }
+
+	cv::Point3f Lower() const { return Valid() ? mLower : cv::Point3f(); }
+	cv::Point3f Upper() const { return Valid() ? mUpper : cv::Point3f(); }
+	cv::Point3f Centroid() const;
+
+	/**
+	  * 以质心为球心、包含整个包围盒的球半径
+	  */
+	float Radius() const;
+
+	size_t IntensityCount() const { return mIntensityCount; }
+	float IntensityLower() const { return mIntensityCount > 0 ? mIntensityLower : 0; }
+	float IntensityUpper() const { return mIntensityCount > 0 ? mIntensityUpper : 0; }
+	float IntensityMean() const { return mIntensityCount > 0 ? (float)(mIntensitySum / mIntensityCount) : 0; }
+
+	const std::vector<size_t>& Histogram() const { return mHistogram; }
+	float HistogramLower() const { return mHistogramLower; }
+	float HistogramUpper() const { return mHistogramUpper; }
+
+	/**
+	  * 把包围盒写入点云并更新尺寸与中心点
+	  */
+	void ApplyBoundary(PointsCloud& cloud) const;
+
+	/**
+	  * 打印一行统计
+	  * @param[in] name 行首名称
+	  */
+	void Print(const char* name) const;
+
+private:
+	//单线程累加一段点，SIMD处理对齐的部分
+	void AccumulateBlock(const float* x, const float* y, const float* z, const float* intensity, size_t count);
+
+	size_t mProcessed;
+	size_t mCount;
+	cv::Point3f mLower;
+	cv::Point3f mUpper;
+	double mSum[3];
+
+	size_t mIntensityCount;
+	float mIntensityLower;
+	float mIntensityUpper;
+	double mIntensitySum;
+
+	float mHistogramLower;
+	float mHistogramUpper;
+	std::vector<size_t> mHistogram;
+};
@@ -0,0 +1,187 @@
+﻿#pragma once
+
+#include <stdlib.h>
+#include <memory>
+#include <new>
+#include <algorithm>
+
+#define COLUMN_ALIGNMENT		64
+
+inline void* AlignedMalloc(size_t bytes)
+{
+#ifdef _WIN32
+	void* p = _aligned_malloc(bytes, COLUMN_ALIGNMENT);
+#else
+	void* p = NULL;
+	if (posix_memalign(&p, COLUMN_ALIGNMENT, bytes) != 0) {
+		p = NULL;
+	}
+#endif
+	if (p == NULL) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+inline void AlignedFree(void* p)
+{
+#ifdef _WIN32
+	_aligned_free(p);
+#else
+	free(p);
+#endif
+}
+
+/**
+  * 点云的一列连续数据，接口与std::vector一致，
+  * 内存按COLUMN_ALIGNMENT对齐，也可以直接引用外部内存(如内存映射的缓存文件)而不拷贝，
+  * 引用外部内存时改变长度会先拷贝为自有内存，元素须为无需析构的简单类型
+  */
+template<typename T>
+class ColumnBuffer {
+public:
+	ColumnBuffer() : mData(NULL), mSize(0), mCapacity(0) {}
+
+	ColumnBuffer(const ColumnBuffer& other) : mData(NULL), mSize(0), mCapacity(0)
+	{
+		Assign(other.begin(), other.end());
+	}
+
+	ColumnBuffer& operator=(const ColumnBuffer& other)
+	{
+		if (this != &other) {
+			ColumnBuffer copy(other);
+			swap(copy);
+		}
+		return *this;
+	}
+
+	ColumnBuffer(ColumnBuffer&& other) noexcept : mData(NULL), mSize(0), mCapacity(0)
+	{
+		swap(other);
+	}
+
+	ColumnBuffer& operator=(ColumnBuffer&& other) noexcept
+	{
+		swap(other);
+		return *this;
+	}
+
+	~ColumnBuffer()
+	{
+		Release();
+	}
+
+	size_t size() const { return mSize; }
+	size_t capacity() const { return mCapacity; }
+	bool empty() const { return mSize == 0; }
+
+	T* data() { return mData; }
+	const T* data() const { return mData; }
+	T* begin() { return mData; }
+	const T* begin() const { return mData; }
+	T* end() { return mData + mSize; }
+	const T* end() const { return mData + mSize; }
+
+	T& operator[](size_t i) { return mData[i]; }
+	const T& operator[](size_t i) const { return mData[i]; }
+
+	void reserve(size_t capacity)
+	{
+		if (capacity > mCapacity || IsBorrowed()) {
+			Reallocate(std::max(capacity, mSize));
+		}
+	}
+
+	void resize(size_t size, const T& value = T())
+	{
+		//逐步增长时按倍数扩容，避免每次都重新分配
+		if (size > mCapacity && mCapacity > 0) {
+			reserve(std::max(size, mCapacity * 2));
+		} else {
+			reserve(size);
+		}
+		for (size_t i = mSize; i < size; i++) {
+			new (mData + i) T(value);
+		}
+		mSize = size;
+	}
+
+	void push_back(const T& value)
+	{
+		if (mSize == mCapacity || IsBorrowed()) {
+			Reallocate(mCapacity < 16 ? 16 : mCapacity * 2);
+		}
+		new (mData + mSize) T(value);
+		mSize++;
+	}
+
+	void clear()
+	{
+		if (IsBorrowed()) {
+			Release();
+		}
+		mSize = 0;
+	}
+
+	void swap(ColumnBuffer& other) noexcept
+	{
+		std::swap(mData, other.mData);
+		std::swap(mSize, other.mSize);
+		std::swap(mCapacity, other.mCapacity);
+		mOwner.swap(other.mOwner);
+	}
+
+	/**
+	  * 引用外部内存，不拷贝
+	  * @param[in] data 外部数据
+	  * @param[in] size 元素个数
+	  * @param[in] owner 外部内存的持有者，引用期间保持其存活
+	  */
+	void Borrow(T* data, size_t size, const std::shared_ptr<void>& owner)
+	{
+		Release();
+		mData = data;
+		mSize = mCapacity = size;
+		mOwner = owner;
+	}
+
+	bool IsBorrowed() const { return mOwner != NULL; }
+
+private:
+	void Assign(const T* first, const T* last)
+	{
+		clear();
+		reserve(last - first);
+		std::uninitialized_copy(first, last, mData);
+		mSize = last - first;
+	}
+
+	void Reallocate(size_t capacity)
+	{
+		T* data = capacity > 0 ? (T*)AlignedMalloc(capacity * sizeof(T)) : NULL;
+		if (mSize > 0) {
+			std::uninitialized_copy(mData, mData + mSize, data);
+		}
+		size_t size = mSize;
+		Release();
+		mData = data;
+		mSize = size;
+		mCapacity = capacity;
+	}
+
+	void Release()
+	{
+		if (!IsBorrowed() && mData != NULL) {
+			AlignedFree(mData);
+		}
+		mOwner.reset();
+		mData = NULL;
+		mSize = mCapacity = 0;
+	}
+
+	T* mData;
+	size_t mSize;
+	size_t mCapacity;
+	std::shared_ptr<void> mOwner;
+};
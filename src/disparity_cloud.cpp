@@ -0,0 +1,93 @@
+﻿#include "disparity_cloud.h"
+#include "trace.h"
+#include "opencv2/core/utility.hpp"
+#include <stdint.h>
+
+using namespace cv;
+
+size_t DisparityCloud::Convert(const Mat& disparity, const Mat& image, const StereoCalibration& calibration,
+	PointsCloud& cloud, double disparityScale)
+{
+	CV_Assert(disparity.channels() == 1 && (image.empty() || image.size() == disparity.size()));
+	CV_Assert(image.empty() || image.type() == CV_8UC3 || image.type() == CV_8UC1);
+
+	//整数视差图先转为浮点，已是浮点且无缩放时直接使用
+	const Mat* source = &disparity;
+	if (disparity.type() != CV_32F || disparityScale != 1) {
+		disparity.convertTo(mDisparity, CV_32F, 1 / disparityScale);
+		source = &mDisparity;
+	}
+
+	int rows = disparity.rows, cols = disparity.cols;
+	float cx = calibration.principal.x < 0 ? (cols - 1) * 0.5f : calibration.principal.x;
+	float cy = calibration.principal.y < 0 ? (rows - 1) * 0.5f : calibration.principal.y;
+	mRayX.resize(cols);
+	mRayY.resize(rows);
+	for (int x = 0; x < cols; x++) {
+		mRayX[x] = (x - cx) / calibration.focal;
+	}
+	for (int y = 0; y < rows; y++) {
+		mRayY[y] = (y - cy) / calibration.focal;
+	}
+
+	//第一遍统计每行的有效点数，前缀和即为每行在点云中的起始位置
+	mRowOffsets.resize(rows + 1);
+	mRowOffsets[0] = 0;
+	parallel_for_(Range(0, rows), [&](const Range& range) {
+		TRACE_SCOPE("disparity count");
+		for (int y = range.start; y < range.end; y++) {
+			const float* d = source->ptr<float>(y);
+			size_t count = 0;
+			for (int x = 0; x < cols; x++) {
+				count += d[x] > 0;
+			}
+			mRowOffsets[y + 1] = count;
+		}
+	});
+	for (int y = 0; y < rows; y++) {
+		mRowOffsets[y + 1] += mRowOffsets[y];
+	}
+	size_t total = mRowOffsets[rows];
+
+	//一次性调整各列长度，容量足够时复用上一帧的内存
+	bool hasRgb = !image.empty() && image.channels() == 3;
+	PointField* field = cloud.FindField(RGB_FIELD_NAME);
+	if (field != NULL && (!hasRgb || field->depth != CV_32S)) {
+		cloud.RemoveField(RGB_FIELD_NAME);
+	}
+	cloud.Resize(total);
+	uint32_t* rgb = hasRgb ? (uint32_t*)cloud.AddField<int>(RGB_FIELD_NAME) : NULL;
+
+	//第二遍各行并行写入自己的区间，不需要同步
+	float depthScale = calibration.focal * calibration.baseline;
+	parallel_for_(Range(0, rows), [&](const Range& range) {
+		TRACE_SCOPE("disparity reproject");
+		for (int y = range.start; y < range.end; y++) {
+			const float* d = source->ptr<float>(y);
+			size_t i = mRowOffsets[y];
+			float rayY = mRayY[y];
+			for (int x = 0; x < cols; x++) {
+				if (d[x] <= 0) {
+					continue;
+				}
+				float z = depthScale / (d[x] + calibration.doffs);
+				cloud.x[i] = mRayX[x] * z;
+				cloud.y[i] = -rayY * z;
+				cloud.z[i] = -z;
+				if (image.empty()) {
+					cloud.intensity[i] = DEFAULT_INTENSITY;
+				} else if (hasRgb) {
+					const uchar* bgr = image.ptr<uchar>(y) + x * 3;
+					cloud.intensity[i] = 0.114f * bgr[0] + 0.587f * bgr[1] + 0.299f * bgr[2];
+					rgb[i] = ((uint32_t)bgr[2] << 16) | ((uint32_t)bgr[1] << 8) | bgr[0];
+				} else {
+					cloud.intensity[i] = image.ptr<uchar>(y)[x];
+				}
+				i++;
+			}
+		}
+	});
+
+	cloud.UpdateBoundary();
+	return total;
+}
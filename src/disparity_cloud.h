@@ -0,0 +1,41 @@
+﻿#pragma once
+
+#include "points_cloud.h"
+#include <vector>
+
+/**
+  * 校正后双目相机的参数，默认值为Middlebury 2006 Aloe全尺寸图像。
+  * 深度 Z = focal * baseline / (d + doffs)，输出坐标单位与baseline相同
+  */
+struct StereoCalibration {
+	float focal;				//焦距，像素
+	float baseline;				//基线长度
+	cv::Point2f principal;		//左图主点，负数时取图像中心
+	float doffs;				//左右主点的x差，像素
+
+	StereoCalibration() : focal(3740), baseline(160), principal(-1, -1), doffs(270) {}
+};
+
+/**
+  * 把视差图反投影为点云，直接写入预先分配的各列，可每帧调用并复用点云的内存。
+  * 坐标系与3d视图一致：x向右、y向上、z指向相机
+  */
+class DisparityCloud {
+public:
+	/**
+	  * @param[in] disparity 视差图，CV_32F或8位、16位整数，小于等于0的视差无效
+	  * @param[in] image 与视差图对齐的左图，CV_8UC3或CV_8UC1，为空时强度取DEFAULT_INTENSITY
+	  * @param[in] calibration 相机参数
+	  * @param[out] cloud 点云，有彩色图像时附带RGB_FIELD_NAME字段，强度为灰度值
+	  * @param[in] disparityScale 视差图像素值 = 视差 * disparityScale
+	  * @return 有效点数
+	  */
+	size_t Convert(const cv::Mat& disparity, const cv::Mat& image, const StereoCalibration& calibration,
+		PointsCloud& cloud, double disparityScale = 1);
+
+private:
+	std::vector<float> mRayX;			//每列的 (x - cx) / focal
+	std::vector<float> mRayY;			//每行的 (y - cy) / focal
+	std::vector<size_t> mRowOffsets;	//每行第一个点在点云中的序号
+	cv::Mat mDisparity;
+};
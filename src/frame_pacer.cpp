@@ -0,0 +1,59 @@
+﻿#include "frame_pacer.h"
+#include "opencv2/core/utility.hpp"
+#include <stdio.h>
+
+using namespace cv;
+
+FramePacer::FramePacer(double targetFps)
+	: mTargetFps(0), mIntervalTicks(0), mLastPresentTick(0), mDirty(false)
+{
+	SetTargetFps(targetFps);
+}
+
+void FramePacer::SetTargetFps(double fps)
+{
+	mTargetFps = MIN(MAX(fps, (double)MIN_TARGET_FPS), (double)MAX_TARGET_FPS);
+	mIntervalTicks = (int64)(getTickFrequency() / mTargetFps);
+}
+
+void FramePacer::OnEvent(bool changed)
+{
+	mStats.events++;
+	if (!changed) {
+		mStats.dropped++;
+	} else if (mDirty) {
+		mStats.coalesced++;
+	} else {
+		mDirty = true;
+	}
+}
+
+bool FramePacer::ShouldPresent()
+{
+	if (!mDirty) {
+		return false;
+	}
+	int64 now = getTickCount();
+	if (now - mLastPresentTick < mIntervalTicks) {
+		return false;
+	}
+	mLastPresentTick = now;
+	mDirty = false;
+	mStats.frames++;
+	return true;
+}
+
+int FramePacer::WaitMs() const
+{
+	if (!mDirty) {
+		return -1;
+	}
+	int64 remain = mLastPresentTick + mIntervalTicks - getTickCount();
+	return remain > 0 ? (int)(remain * 1000 / getTickFrequency()) + 1 : 0;
+}
+
+void FramePacer::PrintStats() const
+{
+	printf("target %.0f fps events %zu coalesced %zu dropped %zu frames %zu\n",
+		mTargetFps, mStats.events, mStats.coalesced, mStats.dropped, mStats.frames);
+}
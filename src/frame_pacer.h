@@ -0,0 +1,61 @@
+﻿#pragma once
+
+#include "opencv2/core.hpp"
+
+#define DEFAULT_TARGET_FPS		60
+#define MIN_TARGET_FPS			5
+#define MAX_TARGET_FPS			240
+
+/* 交互事件与重绘统计 */
+struct PacerStats {
+	size_t events;				//收到的事件数
+	size_t coalesced;			//并入已等待中的重绘、没有单独触发重绘的事件数
+	size_t dropped;				//没有改变状态、直接丢弃的事件数
+	size_t frames;				//实际重绘次数
+
+	PacerStats() : events(0), coalesced(0), dropped(0), frames(0) {}
+};
+
+/**
+  * 重绘节拍控制。事件回调只修改状态并调用OnEvent标记需要重绘，
+  * 主循环调用ShouldPresent，距上次重绘不足一个帧间隔时推迟，多个事件合并为一次用最新状态的重绘
+  */
+class FramePacer {
+public:
+	explicit FramePacer(double targetFps = DEFAULT_TARGET_FPS);
+
+	void SetTargetFps(double fps);
+	double TargetFps() const { return mTargetFps; }
+
+	/**
+	  * 记录一个交互事件
+	  * @param[in] changed 事件是否改变了需要绘制的状态
+	  */
+	void OnEvent(bool changed);
+
+	/**
+	  * 非交互的状态变化(如按键切换绘制方式)，下次检查时重绘
+	  */
+	void Invalidate() { mDirty = true; }
+
+	/**
+	  * 是否应当现在重绘，返回true时视为已重绘并清除标记
+	  */
+	bool ShouldPresent();
+
+	/**
+	  * 距下次允许重绘的毫秒数，没有待重绘的状态时返回-1
+	  */
+	int WaitMs() const;
+
+	const PacerStats& Stats() const { return mStats; }
+	void ResetStats() { mStats = PacerStats(); }
+	void PrintStats() const;
+
+private:
+	double mTargetFps;
+	int64 mIntervalTicks;
+	int64 mLastPresentTick;
+	bool mDirty;
+	PacerStats mStats;
+};
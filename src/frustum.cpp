@@ -0,0 +1,37 @@
+﻿#include "frustum.h"
+
+using namespace cv;
+
+void Frustum::Extract(const Matx44f& projection, const Matx44f& modelview)
+{
+	//裁剪坐标满足 -w <= x、y、z <= w，各平面为矩阵第4行与前3行的和或差
+	Matx44f clip = projection * modelview;
+	for (int axis = 0; axis < 3; axis++) {
+		for (int j = 0; j < 4; j++) {
+			planes[axis * 2][j] = clip(3, j) + clip(axis, j);
+			planes[axis * 2 + 1][j] = clip(3, j) - clip(axis, j);
+		}
+	}
+}
+
+FrustumTest Frustum::TestBox(const Point3f& lower, const Point3f& upper) const
+{
+	FrustumTest result = FRUSTUM_INSIDE;
+	for (int i = 0; i < 6; i++) {
+		const Vec4f& plane = planes[i];
+		//沿法向最远与最近的顶点
+		float farthest = plane[0] * (plane[0] > 0 ? upper.x : lower.x)
+			+ plane[1] * (plane[1] > 0 ? upper.y : lower.y)
+			+ plane[2] * (plane[2] > 0 ? upper.z : lower.z) + plane[3];
+		if (farthest < 0) {
+			return FRUSTUM_OUTSIDE;
+		}
+		float nearest = plane[0] * (plane[0] > 0 ? lower.x : upper.x)
+			+ plane[1] * (plane[1] > 0 ? lower.y : upper.y)
+			+ plane[2] * (plane[2] > 0 ? lower.z : upper.z) + plane[3];
+		if (nearest < 0) {
+			result = FRUSTUM_INTERSECT;
+		}
+	}
+	return result;
+}
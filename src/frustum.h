@@ -0,0 +1,42 @@
+﻿#pragma once
+
+#include "opencv2/core.hpp"
+
+/* 包围盒与视锥的关系 */
+enum FrustumTest {
+	FRUSTUM_OUTSIDE = 0,
+	FRUSTUM_INTERSECT = 1,
+	FRUSTUM_INSIDE = 2
+};
+
+/* 每帧的剔除统计 */
+struct CullStats {
+	size_t testedBoxes;			//做过视锥判断的包围盒数
+	size_t visibleChunks;		//可见的分块或节点数
+	size_t culledChunks;
+	size_t submittedPoints;
+	size_t culledPoints;
+
+	CullStats() : testedBoxes(0), visibleChunks(0), culledChunks(0), submittedPoints(0), culledPoints(0) {}
+};
+
+/**
+  * 视锥，6个平面的法向指向视锥内部，平面方程为 a*x + b*y + c*z + d >= 0
+  */
+struct Frustum {
+	cv::Vec4f planes[6];
+
+	/**
+	  * 从投影矩阵与模型视图矩阵中提取平面，得到的平面位于模型坐标系
+	  * @param[in] projection 投影矩阵，行主序
+	  * @param[in] modelview 模型视图矩阵，行主序
+	  */
+	void Extract(const cv::Matx44f& projection, const cv::Matx44f& modelview);
+
+	/**
+	  * 判断轴对齐包围盒与视锥的关系，保守判断，可能把视锥外靠近角落的包围盒判为相交
+	  * @param[in] lower 包围盒下边界
+	  * @param[in] upper 包围盒上边界
+	  */
+	FrustumTest TestBox(const cv::Point3f& lower, const cv::Point3f& upper) const;
+};
@@ -0,0 +1,64 @@
+﻿#include "image_pyramid.h"
+#include "trace.h"
+#include "opencv2/imgproc.hpp"
+
+using namespace cv;
+
+ImagePyramid::~ImagePyramid()
+{
+	Wait();
+}
+
+void ImagePyramid::Build(const Mat& source)
+{
+	Wait();
+	mLevels.clear();
+
+	//各层尺寸为上一层的一半(向下取整)，先分配好，后台线程只写入像素
+	mLevels.push_back(source);
+	Size size = source.size();
+	while (size.width / 2 >= MIN_PYRAMID_SIZE && size.height / 2 >= MIN_PYRAMID_SIZE) {
+		size = Size(size.width / 2, size.height / 2);
+		mLevels.push_back(Mat(size, source.type()));
+	}
+
+	mReadyLevels.store(1);
+	if (mLevels.size() > 1) {
+		mThread = std::thread(&ImagePyramid::BuildLevels, this);
+	}
+}
+
+void ImagePyramid::Wait()
+{
+	if (mThread.joinable()) {
+		mThread.join();
+	}
+}
+
+void ImagePyramid::BuildLevels()
+{
+	SetTraceThreadName("pyramid build");
+	TRACE_SCOPE("ImagePyramid::BuildLevels");
+	for (size_t l = 1; l < mLevels.size(); l++) {
+		Downsample(mLevels[l - 1], mLevels[l]);
+		mReadyLevels.store((int)l + 1, std::memory_order_release);
+	}
+}
+
+void ImagePyramid::Downsample(const Mat& finer, Mat& coarser)
+{
+	//上一层裁到恰为2倍大小，INTER_AREA即为2x2平均
+	Rect source(0, 0, coarser.cols * 2, coarser.rows * 2);
+	resize(finer(source), coarser, coarser.size(), 0, 0, INTER_AREA);
+}
+
+const Mat& ImagePyramid::Select(double scale, double& levelScale) const
+{
+	int ready = mReadyLevels.load(std::memory_order_acquire);
+	int level = 0;
+	while (level + 1 < ready && scale <= 1.0 / (1 << (level + 1))) {
+		level++;
+	}
+	levelScale = 1.0 / (1 << level);
+	return mLevels[level];
+}
@@ -0,0 +1,47 @@
+﻿#pragma once
+
+#include "opencv2/core.hpp"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#define MIN_PYRAMID_SIZE		32
+
+/**
+  * 图像金字塔缓存，第l层为源图像的1/2^l，每层由上一层做2x2区域平均得到。
+  * Build后在后台线程逐层构建，未构建完的层级不会被选用；源图像修改后需重新Build
+  */
+class ImagePyramid {
+public:
+	ImagePyramid() : mReadyLevels(0) {}
+	~ImagePyramid();
+
+	/**
+	  * 开始为源图像构建金字塔，源图像在金字塔使用期间需保持有效
+	  * @param[in] source 源图像
+	  */
+	void Build(const cv::Mat& source);
+
+	/**
+	  * 等待后台构建结束，修改源图像前需调用
+	  */
+	void Wait();
+
+	/**
+	  * 选择分辨率不低于scale的最粗层级，剩余的缩放倍数在(0.5, 1]之间
+	  * @param[in] scale 相对源图像的缩放倍数
+	  * @param[out] levelScale 所选层级相对源图像的倍数
+	  * @return 所选层级，第0层为源图像
+	  */
+	const cv::Mat& Select(double scale, double& levelScale) const;
+
+	int LevelCount() const { return (int)mLevels.size(); }
+
+private:
+	void BuildLevels();
+	static void Downsample(const cv::Mat& finer, cv::Mat& coarser);
+
+	std::vector<cv::Mat> mLevels;
+	std::thread mThread;
+	std::atomic<int> mReadyLevels;		//已构建完成的层数，包括第0层
+};
@@ -0,0 +1,97 @@
+﻿#include "input_trace.h"
+#include "opencv2/core/utility.hpp"
+#include <string.h>
+
+bool InputRecorder::Open(const std::string& path, int width2d, int height2d, int width3d, int height3d)
+{
+	Close();
+	mFile = fopen(path.c_str(), "wb");
+	if (mFile == NULL) {
+		return false;
+	}
+
+	InputTraceHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, INPUT_TRACE_MAGIC, sizeof(header.magic));
+	header.version = INPUT_TRACE_VERSION;
+	header.recordBytes = sizeof(InputRecord);
+	header.viewSizes[INPUT_VIEW_2D][0] = width2d;
+	header.viewSizes[INPUT_VIEW_2D][1] = height2d;
+	header.viewSizes[INPUT_VIEW_3D][0] = width3d;
+	header.viewSizes[INPUT_VIEW_3D][1] = height3d;
+	if (fwrite(&header, sizeof(header), 1, mFile) != 1) {
+		Close();
+		return false;
+	}
+	mLastTick = cv::getTickCount();
+	mCount = 0;
+	return true;
+}
+
+void InputRecorder::Close()
+{
+	if (mFile != NULL) {
+		fclose(mFile);
+		mFile = NULL;
+	}
+}
+
+void InputRecorder::Record(InputView view, int event, int x, int y, int flags)
+{
+	if (mFile == NULL) {
+		return;
+	}
+
+	//记录相邻事件的间隔，文件可以任意长
+	int64_t tick = cv::getTickCount();
+	InputRecord record;
+	record.deltaUs = (uint32_t)((tick - mLastTick) * 1000000 / cv::getTickFrequency());
+	record.flags = flags;
+	record.x = (int16_t)x;
+	record.y = (int16_t)y;
+	record.view = (uint8_t)view;
+	record.event = (uint8_t)event;
+	record.reserved = 0;
+	mLastTick = tick;
+	if (fwrite(&record, sizeof(record), 1, mFile) == 1) {
+		mCount++;
+	}
+}
+
+bool ReadInputTrace(const std::string& path, std::vector<InputEvent>& events, InputTraceHeader* header)
+{
+	events.clear();
+	FILE* file = fopen(path.c_str(), "rb");
+	if (file == NULL) {
+		return false;
+	}
+
+	InputTraceHeader fileHeader;
+	if (fread(&fileHeader, sizeof(fileHeader), 1, file) != 1
+		|| memcmp(fileHeader.magic, INPUT_TRACE_MAGIC, sizeof(fileHeader.magic)) != 0
+		|| fileHeader.version != INPUT_TRACE_VERSION || fileHeader.recordBytes != sizeof(InputRecord)) {
+		fclose(file);
+		return false;
+	}
+
+	//录制中途退出时最后一条记录可能不完整，忽略即可
+	InputRecord record;
+	double timeMs = 0;
+	while (fread(&record, sizeof(record), 1, file) == 1) {
+		timeMs += record.deltaUs / 1000.0;
+		InputEvent event;
+		event.timeMs = timeMs;
+		event.view = record.view;
+		event.event = record.event;
+		event.x = record.x;
+		event.y = record.y;
+		event.flags = record.flags;
+		events.push_back(event);
+	}
+	fclose(file);
+
+	if (header != NULL) {
+		*header = fileHeader;
+	}
+	return true;
+}
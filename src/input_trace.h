@@ -0,0 +1,86 @@
+﻿#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#define INPUT_TRACE_MAGIC		"OVINPUT"
+#define INPUT_TRACE_VERSION		1
+
+/* 输入记录的视图编号 */
+enum InputView {
+	INPUT_VIEW_2D = 0,
+	INPUT_VIEW_3D = 1
+};
+
+/**
+  * 输入记录文件头，之后为依次排列的InputRecord，所有字段均为小端序
+  */
+struct InputTraceHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t recordBytes;		//sizeof(InputRecord)
+	int32_t viewSizes[2][2];	//录制时2d、3d视图的宽高
+};
+
+/* 一次鼠标回调，16字节 */
+struct InputRecord {
+	uint32_t deltaUs;			//与上一条记录的间隔，微秒
+	int32_t flags;				//CV_EVENT_FLAG_*，滚轮事件的高16位为滚动量
+	int16_t x;
+	int16_t y;
+	uint8_t view;				//InputView
+	uint8_t event;				//CV_EVENT_*
+	uint16_t reserved;
+};
+
+/* 读入内存的一次鼠标回调 */
+struct InputEvent {
+	double timeMs;				//相对录制开始
+	int view;
+	int event;
+	int x;
+	int y;
+	int flags;					//与回调参数一致，包括滚轮的滚动量
+};
+
+/**
+  * 录制2d、3d视图鼠标回调的参数与时刻，写入紧凑的二进制文件，用于无显示环境下的回放
+  */
+class InputRecorder {
+public:
+	InputRecorder() : mFile(NULL), mLastTick(0), mCount(0) {}
+	~InputRecorder() { Close(); }
+
+	/**
+	  * 创建记录文件
+	  * @param[in] path 文件路径
+	  * @param[in] width2d, height2d 2d视图尺寸
+	  * @param[in] width3d, height3d 3d视图尺寸
+	  */
+	bool Open(const std::string& path, int width2d, int height2d, int width3d, int height3d);
+	void Close();
+	bool IsOpen() const { return mFile != NULL; }
+
+	/**
+	  * 记录一次鼠标回调，参数与setMouseCallback的回调一致
+	  */
+	void Record(InputView view, int event, int x, int y, int flags);
+
+	size_t Count() const { return mCount; }
+
+private:
+	FILE* mFile;
+	int64_t mLastTick;
+	size_t mCount;
+};
+
+/**
+  * 读取记录文件
+  * @param[in] path 文件路径
+  * @param[out] events 按时间排列的鼠标回调
+  * @param[out] header 可选，文件头
+  * @return 文件不存在或格式不符时返回false
+  */
+bool ReadInputTrace(const std::string& path, std::vector<InputEvent>& events, InputTraceHeader* header = NULL);
@@ -0,0 +1,86 @@
+﻿#include "latency_stats.h"
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+
+static void PrintLatency(const char* name, size_t count, double mean, double p50, double p95, double p99, double max)
+{
+	printf("%s: %zu samples, mean %.2f ms p50 %.2f ms p95 %.2f ms p99 %.2f ms max %.2f ms\n", name, count,
+		mean, p50, p95, p99, max);
+}
+
+double LatencyStats::Percentile(double q) const
+{
+	if (mSamples.empty()) {
+		return 0;
+	}
+	std::vector<float> sorted = mSamples;
+	size_t k = std::min((size_t)(q * sorted.size()), sorted.size() - 1);
+	std::nth_element(sorted.begin(), sorted.begin() + k, sorted.end());
+	return sorted[k];
+}
+
+double LatencyStats::Mean() const
+{
+	double total = 0;
+	for (size_t i = 0; i < mSamples.size(); i++) {
+		total += mSamples[i];
+	}
+	return mSamples.empty() ? 0 : total / mSamples.size();
+}
+
+void LatencyStats::Print(const char* name) const
+{
+	if (mSamples.empty()) {
+		return;
+	}
+	PrintLatency(name, mSamples.size(), Mean(), Percentile(0.5), Percentile(0.95), Percentile(0.99),
+		*std::max_element(mSamples.begin(), mSamples.end()));
+}
+
+void LatencyHistogram::Add(double ms)
+{
+	int bin = 0;
+	if (ms > LATENCY_MIN_MS) {
+		bin = (int)std::min(log2(ms / LATENCY_MIN_MS) * LATENCY_BINS_PER_OCTAVE, (double)(mBins.size() - 1));
+	}
+	mBins[bin]++;
+	mCount++;
+	mTotal += ms;
+	mMax = std::max(mMax, ms);
+}
+
+void LatencyHistogram::Reset()
+{
+	std::fill(mBins.begin(), mBins.end(), 0);
+	mCount = 0;
+	mTotal = 0;
+	mMax = 0;
+}
+
+double LatencyHistogram::Percentile(double q) const
+{
+	if (mCount == 0) {
+		return 0;
+	}
+	//与LatencyStats相同，取排序后第k个采样所在的桶
+	size_t k = std::min((size_t)(q * mCount), mCount - 1);
+	size_t seen = 0;
+	size_t bin = 0;
+	for (; bin + 1 < mBins.size(); bin++) {
+		seen += mBins[bin];
+		if (seen > k) {
+			break;
+		}
+	}
+	double center = LATENCY_MIN_MS * exp2((bin + 0.5) / LATENCY_BINS_PER_OCTAVE);
+	return std::min(center, mMax);
+}
+
+void LatencyHistogram::Print(const char* name) const
+{
+	if (mCount == 0) {
+		return;
+	}
+	PrintLatency(name, mCount, Mean(), Percentile(0.5), Percentile(0.95), Percentile(0.99), mMax);
+}
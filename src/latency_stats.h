@@ -0,0 +1,66 @@
+﻿#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+#define LATENCY_MIN_MS				0.001	//直方图第一个桶的下界，更小的值归入第一个桶
+#define LATENCY_BINS_PER_OCTAVE		16		//每2倍区间的桶数，分位数的相对误差约2%
+#define LATENCY_OCTAVES				24		//直方图覆盖0.001 ms ~ 16.7 s，更大的值归入最后一个桶
+
+/**
+  * 延迟采样，保存全部采样，打印均值、分位数与最大值；用于采样数有限的基准测试
+  */
+class LatencyStats {
+public:
+	void Add(double ms) { mSamples.push_back((float)ms); }
+	void Reset() { mSamples.clear(); }
+	size_t Count() const { return mSamples.size(); }
+
+	/**
+	  * 分位数
+	  * @param[in] q 0~1
+	  */
+	double Percentile(double q) const;
+	double Mean() const;
+
+	/**
+	  * 打印一行统计，没有采样时不输出
+	  * @param[in] name 行首名称
+	  */
+	void Print(const char* name) const;
+
+private:
+	std::vector<float> mSamples;		//毫秒
+};
+
+/**
+  * 固定分桶的延迟直方图，桶按对数等分，内存不随采样数增长；用于长时间运行时的统计。
+  * 均值与最大值是精确的，分位数取所在桶的几何中点
+  */
+class LatencyHistogram {
+public:
+	LatencyHistogram() : mBins(LATENCY_BINS_PER_OCTAVE * LATENCY_OCTAVES, 0) { Reset(); }
+
+	void Add(double ms);
+	void Reset();
+	size_t Count() const { return mCount; }
+
+	/**
+	  * 分位数
+	  * @param[in] q 0~1
+	  */
+	double Percentile(double q) const;
+	double Mean() const { return mCount > 0 ? mTotal / mCount : 0; }
+
+	/**
+	  * 打印一行统计，没有采样时不输出
+	  * @param[in] name 行首名称
+	  */
+	void Print(const char* name) const;
+
+private:
+	std::vector<size_t> mBins;
+	size_t mCount;
+	double mTotal;					//毫秒
+	double mMax;					//毫秒
+};
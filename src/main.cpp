@@ -1,309 +1,822 @@
 ﻿#include "opencv2/opencv.hpp"
-#include <Windows.h>
-#include <gl/GL.h>
 #include <vector>
+#include "points_cloud.h"
+#include "xyzi_loader.h"
+#include "cloud_loader.h"
+#include "cloud_renderer.h"
+#include "splat_renderer.h"
+#include "redraw_scheduler.h"
+#include "viewer_2d.h"
+#include "viewer_3d.h"
+#include "strip_stereo.h"
+#include "disparity_cloud.h"
+#include "cloud_sequence.h"
+#include "shm_ring.h"
+#include "latency_stats.h"
+#include "cloud_stats.h"
+#include "voxel_filter.h"
+#include "trace.h"
+#include "input_trace.h"
+#include <memory>
+#include <thread>
 
-#define PI						3.1415926535
 #define WIDTH					800
 #define HEIGHT					800
-#define SCALE_STEP_2D			0.1
-#define SCALE_STEP_3D			20
-#define MAX_LINE_BUFFER_SIZE	128
+#define XYZI_FILE_PATH			"../data/xyzi.txt"
+#define ALOE_LEFT_PATH			"../data/aloeL.jpg"
+#define ALOE_RIGHT_PATH			"../data/aloeR.jpg"
+#define ALOE_GT_PATH			"../data/aloeGT.png"
+#define SHM_POLL_MS				5		//接收共享内存点云时主循环的最长等待
+#define INPUT_KIND_COUNT		3		//回放统计时的事件分类：移动、按键、滚轮
 
 using namespace cv;
 
 String gWindow2dName = "2d visualizer";
 String gWindow3dName = "3d visualizer";
 
+RedrawScheduler gScheduler;		//输入与后台通知只标记重绘，由主循环合并执行
+
 /* 2d visualization */
-float gScale2d = 1;
+Viewer2d gViewer2d(gWindow2dName);
+std::vector<std::unique_ptr<Viewer2d> > gExtraViewers;	//--views打开的其他2d视图，与gViewer2d显示同一图像
+TiledImage gTiledImage;			//打开分块图像时代替普通图像
+TileCache gTileCache;
+std::vector<Mat> gStereoViews;	//左图、块匹配视差、半全局匹配视差与真值视差
+std::vector<Mat> gStereoDisparities;	//与gStereoViews对应的浮点视差，左图处为空
+int gStereoView = 0;
 
-Point gTargetPoint;
-Rect gRoiRect2d(0, 0, WIDTH, HEIGHT);
+/* 3d visualization */
+PointsCloud gPointsCloud;
+Viewer3d gViewer3d(gWindow3dName);
+ShmRing gShmRing;				//从其他进程接收点云，各列直接引用共享内存
+int64_t gShmPublishTick = 0;	//已接收、尚未绘制的帧的发布时刻
+LatencyHistogram gShmLatency;
+InputRecorder gInputRecorder;	//--record时录制两个视图的鼠标回调
+bool gVoxelEnabled = false;		//3d视图显示体素降采样后的点云
+float gVoxelLeaf = 0;			//体素边长，0为按点云尺寸自动选取
+float gVoxelAutoLeaf = 0;		//自动选取的体素边长，加载新点云时重新计算
+PointsCloud gVoxelCloud;
 
-Mat gSrcImg(Size(WIDTH, HEIGHT), CV_8UC3, Scalar(100, 100, 100));
-Mat gScaleImg(Size(WIDTH, HEIGHT), CV_8UC3, Scalar(100, 100, 100));
-Mat gResultImg(Size(WIDTH, HEIGHT), CV_8UC3, Scalar(100, 100, 100));
+/**
+  * 用CPU绘制器绘制当前视图并统计耗时
+  * @param[in] camera 相机参数
+  * @param[in] repeat 重复次数
+  * @param[out] image 绘制结果
+  */
+void RenderSplats(const ViewCamera& camera, int repeat, Mat& image)
+{
+	SplatConfig config;
+	config.intensityColors = gViewer3d.Renderer().GetColorMode() == COLOR_INTENSITY;
+	config.rgbColors = gViewer3d.Renderer().GetColorMode() == COLOR_RGB;
+	//开启体素降采样时绘制的是降采样后的点云
+	size_t points = gViewer3d.Cloud() != NULL ? gViewer3d.Cloud()->Size() : 0;
+	double totalMs = 0;
+	for (int i = 0; i < repeat; i++) {
+		totalMs += gViewer3d.RenderSplats(camera, config, image);
+	}
+	printf("cpu render %zu points at %dx%d in %.2f ms (%d threads)\n", points, WIDTH, HEIGHT,
+		totalMs / repeat, getNumThreads());
+}
 
 /**
-  * 绘制十字
-  * @param[in] img 目标图像
-  * @param[in] point 十字中心点
-  * @param[in] color 颜色
-  * @param[in] size 十字尺寸
-  * @param[in] thickness 粗细
+  * 当前使用的体素边长，自动选取时按gPointsCloud计算一次，序列与共享内存沿用第一帧的值
   */
-void drawCross(Mat img, CvPoint point, CvScalar color, int size, int thickness)
+float VoxelLeaf()
 {
-	//绘制横线
-	line(img, Point(point.x - size / 2, point.y), Point(point.x + size / 2, point.y), color, thickness, 8, 0);
-	//绘制竖线
-	line(img, Point(point.x, point.y - size / 2), Point(point.x, point.y + size / 2), color, thickness, 8, 0);
+	if (gVoxelLeaf > 0) {
+		return gVoxelLeaf;
+	}
+	if (gVoxelAutoLeaf <= 0) {
+		gVoxelAutoLeaf = AutoVoxelLeafSize(gPointsCloud);
+	}
+	return gVoxelAutoLeaf;
 }
 
-void Update2d()
+/**
+  * 把gPointsCloud交给3d视图，开启体素降采样时显示降采样后的点云
+  * @param[in] verbose 打印降采样前后的点数与耗时，逐帧更新时关闭
+  */
+void ShowCloud(bool verbose)
 {
-	resize(gSrcImg, gScaleImg, Size(gSrcImg.cols*gScale2d, gSrcImg.rows*gScale2d), 0, 0, InterpolationFlags::INTER_AREA);
+	if (!gVoxelEnabled) {
+		gViewer3d.SetCloud(&gPointsCloud);
+		return;
+	}
+	float leaf = VoxelLeaf();
+	int64 startTick = getTickCount();
+	if (!VoxelGridDownsample(gPointsCloud, leaf, gVoxelCloud)) {
+		printf("voxel leaf %g is too small for this cloud\n", leaf);
+		gViewer3d.SetCloud(&gPointsCloud);
+		return;
+	}
+	double seconds = (getTickCount() - startTick) / getTickFrequency();
+	if (verbose) {
+		printf("voxel grid leaf %g: %zu -> %zu points in %.2f ms (%.1f Mpoints/s)\n", leaf, gPointsCloud.Size(),
+			gVoxelCloud.Size(), seconds * 1000, seconds > 0 ? gPointsCloud.Size() / seconds / 1e6 : 0);
+	}
+	gViewer3d.SetCloud(&gVoxelCloud);
+}
 
-	Mat transformMat = Mat::zeros(2, 3, CV_32FC1);		//定义仿射变形矩阵
-	transformMat.at<float>(0, 0) = 1;
-	transformMat.at<float>(0, 2) = gRoiRect2d.x; //水平平移量
-	transformMat.at<float>(1, 1) = 1;
-	transformMat.at<float>(1, 2) = gRoiRect2d.y; //竖直平移量
+bool LoadData(const String& path)
+{
+	TRACE_SCOPE("LoadData");
+	LoadStats stats;
+	if (!LoadPointsCloud(path, gPointsCloud, &stats)) {
+		return false;
+	}
 
-	warpAffine(gScaleImg, gResultImg, transformMat, gResultImg.size());//根据平移矩阵进行仿射变换
+	printf("load %zu points in %.2f ms (%.2f MB/s)%s\n", stats.points, stats.seconds * 1000, stats.Throughput(),
+		stats.fromCache ? " from cache" : "");
+	gVoxelAutoLeaf = 0;
+	gViewer3d.ClearFit();
+	ShowCloud(true);
+	return true;
+}
 
-	char text[128];
-	sprintf(text, "ROI RECT X = %d, Y = %d", gRoiRect2d.x, gRoiRect2d.y);
-	putText(gResultImg, text, cv::Point(50, 50), cv::FONT_HERSHEY_COMPLEX, 0.5, Scalar(0, 255, 255));
+DisparityCloud gDisparityCloud;
+CloudSequence gSequence;		//逐帧点云序列，显示的帧交换到gPointsCloud中
 
-	imshow(gWindow2dName, gResultImg);
+/**
+  * 用视差图反投影得到的点云代替当前点云，颜色取自左图
+  * @param[in] disparity 视差图，小于等于0为无效
+  * @param[in] image 左图
+  * @return 没有有效视差时返回false
+  */
+bool LoadStereoCloud(const Mat& disparity, const Mat& image)
+{
+	int64 startTick = getTickCount();
+	size_t points = gDisparityCloud.Convert(disparity, image, StereoCalibration(), gPointsCloud);
+	printf("reproject %dx%d disparity to %zu points in %.2f ms\n", disparity.cols, disparity.rows, points,
+		(getTickCount() - startTick) * 1000 / getTickFrequency());
+	gVoxelAutoLeaf = 0;
+	gViewer3d.ClearFit();
+	ShowCloud(true);
+	return points > 0;
 }
 
-void OnMouse2d(int event, int x, int y, int flags, void* userdata)
+/**
+  * 对双目图像做条带并行的块匹配与半全局匹配，打印各条带耗时与真值比较结果
+  * @param[in] strips 条带数，0为CPU核数
+  * @return 图像读取失败时返回false
+  */
+bool RunStereo(int strips)
 {
-	if (x < 0 || x > WIDTH - 1 || y < 0 || y > HEIGHT - 1)
-		return;
+	TRACE_SCOPE("RunStereo");
+	Mat left = imread(ALOE_LEFT_PATH);
+	Mat right = imread(ALOE_RIGHT_PATH);
+	Mat truth = imread(ALOE_GT_PATH, IMREAD_UNCHANGED);
+	if (left.empty() || right.empty()) {
+		printf("failed to read %s and %s\n", ALOE_LEFT_PATH, ALOE_RIGHT_PATH);
+		return false;
+	}
 
-	static int startRoiX = 0;
-	static int startRoiY = 0;
-	static Point startPoint = Point(0, 0);
+	gStereoViews.clear();
+	gStereoViews.push_back(left);
+	gStereoDisparities.assign(1, Mat());
+	printf("stereo %dx%d on %d cpus\n", left.cols, left.rows, getNumberOfCPUs());
+	for (int method = STEREO_BM; method <= STEREO_SGBM; method++) {
+		StereoConfig config;
+		config.method = (StereoMethod)method;
+		config.blockSize = method == STEREO_BM ? 15 : 5;
+		config.strips = strips;
+
+		Mat disparity;
+		StereoStats stats;
+		ComputeDisparity(left, right, config, disparity, &stats);
+		printf("%s: %zu strips in %.2f ms\n", StereoMethodName(config.method), stats.strips.size(), stats.totalMs);
+		for (size_t i = 0; i < stats.strips.size(); i++) {
+			printf("  rows %4d - %4d %8.2f ms\n", stats.strips[i].firstRow,
+				stats.strips[i].firstRow + stats.strips[i].rows, stats.strips[i].ms);
+		}
+		if (!truth.empty()) {
+			DisparityScore score = ScoreDisparity(disparity, truth);
+			printf("  bad > %.0f px %.2f%%, rmse %.2f px, %zu of %zu pixels matched\n", BAD_PIXEL_THRESHOLD,
+				score.badRate * 100, score.rmse, score.matched, score.groundTruth);
+		}
 
-	//左键按下，记录开始移动时的位置
-	if (event == CV_EVENT_LBUTTONDOWN) {
-		startPoint = Point(x, y);
-		startRoiX = gRoiRect2d.x;
-		startRoiY = gRoiRect2d.y;
+		Mat image;
+		ColorizeDisparity(disparity, config, image);
+		gStereoViews.push_back(image);
+		gStereoDisparities.push_back(disparity);
 	}
 
-	//左键按下且鼠标移动中，记录移动的距离
-	if (event == CV_EVENT_MOUSEMOVE && (flags & CV_EVENT_LBUTTONDOWN)) {
-		int dx = x - startPoint.x;
-		int dy = y - startPoint.y;
-		gRoiRect2d.x = startRoiX + dx;
-		gRoiRect2d.y = startRoiY + dy;
+	//真值中0为未知视差
+	if (!truth.empty()) {
+		Mat disparity, image;
+		truth.convertTo(disparity, CV_32F);
+		disparity.setTo(Scalar::all(-1), truth == 0);
+		ColorizeDisparity(disparity, StereoConfig(), image);
+		gStereoViews.push_back(image);
+		gStereoDisparities.push_back(disparity);
 	}
+	gStereoView = STEREO_SGBM + 1;
+	return true;
+}
 
-	//右键按下，在图像中画一个点
-	if (event == CV_EVENT_RBUTTONDOWN) {
-		gTargetPoint.x = (float)(x - gRoiRect2d.x) / gScale2d;
-		gTargetPoint.y = (float)(y - gRoiRect2d.y) / gScale2d;
-		circle(gSrcImg, Point(gTargetPoint.x, gTargetPoint.y), 1, Scalar(0, 0, 255), 4);
+/**
+  * 不创建窗口，接收共享内存中的帧并用CPU绘制器绘制，统计从发布到接收、到绘制完成的延迟
+  * @param[in] name 共享内存名称
+  * @param[in] frames 统计的帧数
+  */
+int BenchmarkShm(const String& name, int frames)
+{
+	ShmRing ring;
+	if (!ring.Open(name)) {
+		printf("cannot open shared memory %s, start shm_producer first\n", name.c_str());
+		return 1;
 	}
 
-	//滚轮滚动，对图像进行缩放
-	if (event == CV_EVENT_MOUSEWHEEL) {
-		int value = getMouseWheelDelta(flags);
-		float scaleStep = 0;
-		if (value > 0)
-			scaleStep = SCALE_STEP_2D;
-		else if (value < 0)
-			scaleStep = -SCALE_STEP_2D;
-		gScale2d *= (1 + scaleStep);
-		gRoiRect2d.x = x + (gRoiRect2d.x - x)*(1 + scaleStep);
-		gRoiRect2d.y = y + (gRoiRect2d.y - y)*(1 + scaleStep);
+	LatencyStats acquireLatency, drawLatency;
+	SplatConfig config;
+	Mat image;
+	gViewer3d.SetCloud(&gPointsCloud);
+	uint64_t lastFrame = 0;
+	size_t skipped = 0;
+	int64 lastTick = getTickCount();
+	for (int n = 0; n < frames; ) {
+		uint64_t frame;
+		int64_t publishTick;
+		if (!ring.Acquire(gPointsCloud, &frame, &publishTick)) {
+			//写端停止超过5秒时结束
+			if ((getTickCount() - lastTick) > 5 * getTickFrequency()) {
+				break;
+			}
+			std::this_thread::yield();
+			continue;
+		}
+		acquireLatency.Add((getTickCount() - publishTick) * 1000 / getTickFrequency());
+		gViewer3d.SetCloud(&gPointsCloud);
+		gViewer3d.RenderSplats(config, image);
+		drawLatency.Add((getTickCount() - publishTick) * 1000 / getTickFrequency());
+
+		skipped += lastFrame != 0 ? (size_t)(frame - lastFrame - 1) : 0;
+		lastFrame = frame;
+		lastTick = getTickCount();
+		n++;
 	}
 
-	Update2d();
+	printf("%zu frames of %zu points, %zu frames skipped while drawing\n", acquireLatency.Count(), gPointsCloud.Size(), skipped);
+	acquireLatency.Print("publish to acquire");
+	drawLatency.Print("publish to first draw");
+	return 0;
 }
 
-/* 3d visualization */
-float gViewYaw = 0.0;
-float gViewPitch = 0.0;
-float gViewTransX = 0.0;
-float gViewTransY = 0.0;
-float gViewDistance = 1000.0;
-
-float gLastX = 0.0;
-float gLastY = 0.0;
-
-struct PointsCloud {
-	std::vector<Point3f> points;
-	std::vector<float> intensity;
-
-	Point3f lowerBoundary;
-	Point3f upperBoundary;
-	Point3f centerPoint;
-	float width, height, depth;
-
-	void Reset()
-	{
-		points.clear();
-		intensity.clear();
-		lowerBoundary = Point3f();
-		upperBoundary = Point3f();
-		centerPoint = Point3f();
-		width = height = depth = 0;
-	}
-} gPointsCloud;
-
-void OnMouse3d(int event, int x, int y, int flags, void* param)
+/**
+  * 不创建窗口，多个3d视图共用同一点云，各自在独立线程中旋转相机并用CPU绘制器绘制，
+  * 与单个视图的耗时对比，检查视图之间是否互相等待
+  * @param[in] path 点云文件路径
+  * @param[in] views 视图数
+  * @param[in] frames 每个视图绘制的帧数
+  */
+int BenchmarkViews(const String& path, int views, int frames)
 {
-	if (event == CV_EVENT_RBUTTONDOWN) {
-		gLastX = x;
-		gLastY = y;
+	if (!LoadData(path)) {
+		return 1;
 	}
 
-	if (event == CV_EVENT_MOUSEMOVE && (flags & CV_EVENT_RBUTTONDOWN))   //右键按下，鼠标移动时
-	{
-		gViewTransX += (x - gLastX) * 1.0;
-		gViewTransY += (y - gLastY)	* 1.0;
-		gLastX = x;
-		gLastY = y;
+	std::vector<std::unique_ptr<Viewer3d> > viewers;
+	for (int i = 0; i < views; i++) {
+		viewers.push_back(std::unique_ptr<Viewer3d>(new Viewer3d(format("view %d", i), Size(WIDTH / 2, HEIGHT / 2))));
+		viewers.back()->SetCloud(&gPointsCloud);
 	}
 
-	if (event == CV_EVENT_LBUTTONDOWN) {
-		gLastX = x;
-		gLastY = y;
-	}
-
-	if (event == CV_EVENT_MOUSEMOVE && (flags & CV_EVENT_LBUTTONDOWN))   //左键按下，鼠标移动时
-	{
-		gViewYaw -= (x - gLastX) * 1.0;
-		if (gViewYaw < 0.0) {
-			gViewYaw += 360.0;
-		} else if (gViewYaw > 360.0) {
-			gViewYaw -= 360.0;
+	//每个视图只由自己的线程修改相机与绘制，视图之间不共享可变状态
+	std::vector<double> totalMs(views, 0);
+	auto run = [&](int view) {
+		SplatConfig config;
+		Mat image;
+		ViewCamera camera = viewers[view]->Camera();
+		for (int n = 0; n < frames; n++) {
+			camera.yaw = (float)((view * 360 / views + n * 3) % 360);
+			viewers[view]->SetCamera(camera);
+			totalMs[view] += viewers[view]->RenderSplats(config, image);
 		}
+	};
 
-		gViewPitch -= (y - gLastY) * 1.0;
-		if (gViewPitch < 0.0) {
-			gViewPitch += 360.0;
-		} else if (gViewPitch > 360.0) {
-			gViewPitch -= 360.0;
-		}
+	int64 startTick = getTickCount();
+	run(0);
+	double singleMs = (getTickCount() - startTick) * 1000 / getTickFrequency();
 
-		gLastX = x;
-		gLastY = y;
+	std::fill(totalMs.begin(), totalMs.end(), 0.0);
+	std::vector<std::thread> threads;
+	startTick = getTickCount();
+	for (int i = 0; i < views; i++) {
+		threads.push_back(std::thread(run, i));
 	}
-
-	if (event == CV_EVENT_MOUSEWHEEL) {
-		int value = getMouseWheelDelta(flags);
-		if (value > 0) {
-			gViewDistance += SCALE_STEP_3D;
-		} else if (value < 0) {
-			gViewDistance -= SCALE_STEP_3D;
-		}
-
-		if (gViewDistance < 1.0) {
-			gViewDistance = 1.0;
-		} else if (gViewDistance > 2000) {
-			gViewDistance = 2000;
-		}
+	for (size_t i = 0; i < threads.size(); i++) {
+		threads[i].join();
 	}
+	double allMs = (getTickCount() - startTick) * 1000 / getTickFrequency();
 
-	updateWindow(gWindow3dName);
+	printf("1 view: %d frames in %.2f ms (%.1f fps)\n", frames, singleMs, frames * 1000 / singleMs);
+	printf("%d views: %d frames in %.2f ms (%.1f fps total) on %d cpus\n", views, views * frames, allMs,
+		views * frames * 1000 / allMs, getNumberOfCPUs());
+	for (int i = 0; i < views; i++) {
+		printf("  %s %8.2f ms per frame\n", viewers[i]->Name().c_str(), totalMs[i] / frames);
+	}
+	return 0;
 }
 
-void gluPerspective(GLdouble fovy, GLdouble aspect, GLdouble zNear, GLdouble zFar)
-{
-	GLdouble xmin, xmax, ymin, ymax;
-
-	ymax = zNear * tan(fovy * PI / 360.0);
-	ymin = -ymax;
-	xmin = ymin * aspect;
-	xmax = ymax * aspect;
-
-	glFrustum(xmin, xmax, ymin, ymax, zNear, zFar);
+/**
+  * 鼠标事件的分类，0为移动，1为按键，2为滚轮
+  */
+static int InputKind(int event)
+{
+	if (event == CV_EVENT_MOUSEMOVE)
+		return 0;
+	if (event == CV_EVENT_MOUSEWHEEL || event == CV_EVENT_MOUSEHWHEEL)
+		return 2;
+	return 1;
 }
 
-void OnOpengl(void* param)
+/**
+  * 不创建窗口，把录制的鼠标事件依次交给与窗口相同的处理函数，状态改变时用CPU绘制一帧，
+  * 按视图与事件分类统计处理耗时与从事件到绘制完成的耗时
+  * @param[in] path 录制文件
+  * @param[in] cloudPath 点云文件路径
+  * @param[in] imagePath 2d视图的图像，为空时为灰色背景，否则与--stereo、--image一样缩放到窗口内
+  */
+int ReplayInput(const String& path, const String& cloudPath, const String& imagePath)
 {
-	glViewport(0, 0, WIDTH, HEIGHT);
-	glMatrixMode(GL_PROJECTION);
-	glLoadIdentity();
-	gluPerspective(45, (double)WIDTH / HEIGHT, 1, 5000);
-
-	glMatrixMode(GL_MODELVIEW);
-	glLoadIdentity();
-	glTranslatef(-gPointsCloud.centerPoint.x, -gPointsCloud.centerPoint.y, -gPointsCloud.centerPoint.z);
-	glTranslatef(gViewTransX, -gViewTransY, -gViewDistance);
-	glRotatef(-gViewPitch, 1, 0, 0);
-	glRotatef(-gViewYaw, 0, 1, 0);
-
-	for (size_t i = 0; i < gPointsCloud.points.size(); i++) {
-		glPointSize(gPointsCloud.intensity[i]/100);
-		glBegin(GL_POINTS);
-		glColor3f(0, 1, 0);
-		glVertex3f(gPointsCloud.points[i].x, gPointsCloud.points[i].y, gPointsCloud.points[i].z);
-		glEnd();
-	}
-	
-	glFlush();
-}
+	std::vector<InputEvent> events;
+	InputTraceHeader header;
+	if (!ReadInputTrace(path, events, &header)) {
+		printf("cannot read input trace %s\n", path.c_str());
+		return 1;
+	}
+	if (!LoadData(cloudPath)) {
+		return 1;
+	}
+
+	Viewer2d viewer2d("replay 2d", Size(header.viewSizes[INPUT_VIEW_2D][0], header.viewSizes[INPUT_VIEW_2D][1]));
+	if (!imagePath.empty()) {
+		Mat image = imread(imagePath);
+		if (image.empty()) {
+			printf("cannot read %s\n", imagePath.c_str());
+			return 1;
+		}
+		viewer2d.SetImage(image);
+		viewer2d.FitToWindow();
+	}
+	Viewer3d viewer3d("replay 3d", Size(header.viewSizes[INPUT_VIEW_3D][0], header.viewSizes[INPUT_VIEW_3D][1]));
+	viewer3d.SetCloud(&gPointsCloud);
+
+	const char* viewNames[] = { "2d", "3d" };
+	const char* kindNames[INPUT_KIND_COUNT] = { "move", "button", "wheel" };
+	LatencyStats handleLatency[2][INPUT_KIND_COUNT];
+	LatencyStats frameLatency[2][INPUT_KIND_COUNT];
+	SplatConfig config;
+	Mat image;
+	size_t frames = 0;
+	int64 startTick = getTickCount();
+	for (size_t i = 0; i < events.size(); i++) {
+		const InputEvent& event = events[i];
+		int view = event.view == INPUT_VIEW_3D ? 1 : 0;
+		int kind = InputKind(event.event);
+
+		int64 eventTick = getTickCount();
+		bool changed = view == 0 ? viewer2d.InjectMouse(event.event, event.x, event.y, event.flags)
+			: viewer3d.InjectMouse(event.event, event.x, event.y, event.flags);
+		handleLatency[view][kind].Add((getTickCount() - eventTick) * 1000 / getTickFrequency());
+		if (!changed) {
+			continue;
+		}
 
-bool LoadData()
-{
-	FILE *file = fopen("../data/xyzi.txt", "r");
-	if (file == NULL) {
-		return false;
-	}
-
-	char line_buffer[MAX_LINE_BUFFER_SIZE];
-	float x = 0, y = 0, z = 0, i = 0;
-	gPointsCloud.Reset();
-
-	bool isFirstIn = true;
-	while (fgets(line_buffer, MAX_LINE_BUFFER_SIZE, file)) {
-		if (sscanf(line_buffer, "%f %f %f %f", &x, &y, &z, &i) == 4) {
-			gPointsCloud.points.push_back(Point3f(x, y, z));
-			gPointsCloud.intensity.push_back(i);
-
-			if (isFirstIn) {
-				gPointsCloud.lowerBoundary.x = gPointsCloud.upperBoundary.x = x;
-				gPointsCloud.lowerBoundary.y = gPointsCloud.upperBoundary.y = y;
-				gPointsCloud.lowerBoundary.z = gPointsCloud.upperBoundary.z = z;
-				isFirstIn = false;
-			}
-			gPointsCloud.lowerBoundary.x = MIN(gPointsCloud.lowerBoundary.x, x);
-			gPointsCloud.lowerBoundary.y = MIN(gPointsCloud.lowerBoundary.y, y);
-			gPointsCloud.lowerBoundary.z = MIN(gPointsCloud.lowerBoundary.z, z);
-
-			gPointsCloud.upperBoundary.x = MAX(gPointsCloud.upperBoundary.x, x);
-			gPointsCloud.upperBoundary.y = MAX(gPointsCloud.upperBoundary.y, y);
-			gPointsCloud.upperBoundary.z = MAX(gPointsCloud.upperBoundary.z, z);
-		}
-	}
-	fclose(file);
-
-	gPointsCloud.width = gPointsCloud.upperBoundary.x - gPointsCloud.lowerBoundary.x;
-	gPointsCloud.height = gPointsCloud.upperBoundary.y - gPointsCloud.lowerBoundary.y;
-	gPointsCloud.depth = gPointsCloud.upperBoundary.z - gPointsCloud.lowerBoundary.z;
-
-	gPointsCloud.centerPoint.x = (gPointsCloud.upperBoundary.x + gPointsCloud.lowerBoundary.x)/2;
-	gPointsCloud.centerPoint.y = (gPointsCloud.upperBoundary.y + gPointsCloud.lowerBoundary.y)/2;
-	gPointsCloud.centerPoint.z = (gPointsCloud.upperBoundary.z + gPointsCloud.lowerBoundary.z)/2;
-
-	return true;
+		if (view == 0)
+			viewer2d.Render(image);
+		else
+			viewer3d.RenderSplats(config, image);
+		frameLatency[view][kind].Add((getTickCount() - eventTick) * 1000 / getTickFrequency());
+		frames++;
+	}
+	double totalMs = (getTickCount() - startTick) * 1000 / getTickFrequency();
+
+	printf("replay %zu events (%.1f s recorded) in %.2f ms, %zu frames drawn\n", events.size(),
+		events.empty() ? 0 : events.back().timeMs / 1000, totalMs, frames);
+	for (int view = 0; view < 2; view++) {
+		for (int kind = 0; kind < INPUT_KIND_COUNT; kind++) {
+			handleLatency[view][kind].Print(format("%s %s handle", viewNames[view], kindNames[kind]).c_str());
+			frameLatency[view][kind].Print(format("%s %s to frame", viewNames[view], kindNames[kind]).c_str());
+		}
+	}
+	return 0;
 }
 
-int main()
+int main(int argc, char** argv)
 {
-	namedWindow(gWindow2dName, WINDOW_AUTOSIZE);
-	setMouseCallback(gWindow2dName, OnMouse2d);
+	SetTraceThreadName("main");
 
-	if (LoadData()) {
-		namedWindow(gWindow3dName, WINDOW_OPENGL);
-		resizeWindow(gWindow3dName, WIDTH, HEIGHT);
-		setOpenGlContext(gWindow3dName);
-		setMouseCallback(gWindow3dName, OnMouse3d);
-		setOpenGlDrawCallback(gWindow3dName, OnOpengl);
+	//--bench [path]：对比文本点云解析吞吐量后退出
+	if (argc > 1 && String(argv[1]) == "--bench") {
+		return BenchmarkXyziTxt(argc > 2 ? argv[2] : XYZI_FILE_PATH, 5) ? 0 : 1;
+	}
+
+	//--shm-bench name [frames]：统计共享内存点云从发布到绘制的延迟后退出
+	if (argc > 2 && String(argv[1]) == "--shm-bench") {
+		return BenchmarkShm(argv[2], argc > 3 ? atoi(argv[3]) : 300);
+	}
+
+	//--view-bench path [views] [frames]：多个视图在各自线程中同时绘制后退出
+	if (argc > 2 && String(argv[1]) == "--view-bench") {
+		return BenchmarkViews(argv[2], argc > 3 ? atoi(argv[3]) : 16, argc > 4 ? atoi(argv[4]) : 20);
+	}
+
+	//--replay trace [cloud] [image]：不创建窗口，回放--record录制的鼠标事件并统计延迟后退出
+	if (argc > 2 && String(argv[1]) == "--replay") {
+		return ReplayInput(argv[2], argc > 3 ? argv[3] : XYZI_FILE_PATH, argc > 4 ? argv[4] : "");
+	}
+
+	//--render path output [yaw pitch distance]：不创建窗口，用CPU绘制器绘制一帧并保存
+	if (argc > 3 && String(argv[1]) == "--render") {
+		if (!LoadData(argv[2])) {
+			return 1;
+		}
+		ViewCamera camera = gViewer3d.Camera();
+		if (argc > 6) {
+			camera.yaw = (float)atof(argv[4]);
+			camera.pitch = (float)atof(argv[5]);
+			camera.distance = (float)atof(argv[6]);
+		}
+		Mat image;
+		RenderSplats(camera, 5, image);
+		return imwrite(argv[3], image) ? 0 : 1;
+	}
+
+	//可选参数为点云文件路径，支持xyzi文本与pcd；--image path.dzi在2d窗口中浏览分块图像
+	String cloudPath = XYZI_FILE_PATH;
+	bool stereo = false;
+	bool stereoCloud = false;
+	String sequencePath;
+	String shmName;
+	String recordPath;
+	int strips = 0;
+	int views = 1;
+	for (int i = 1; i < argc; i++) {
+		if (String(argv[i]) == "--image" && i + 1 < argc) {
+			if (gTiledImage.Open(argv[++i])) {
+				//新分块解码完成后重绘，逐步细化
+				gTileCache.SetArrivalCallback([] {
+					gScheduler.Post(gViewer2d.ViewId());
+					for (size_t k = 0; k < gExtraViewers.size(); k++) {
+						gScheduler.Post(gExtraViewers[k]->ViewId());
+					}
+				});
+				gTileCache.Start(&gTiledImage);
+			}
+		} else if (String(argv[i]) == "--stereo") {
+			stereo = true;
+		} else if (String(argv[i]) == "--stereo-cloud") {
+			stereoCloud = true;
+		} else if (String(argv[i]) == "--sequence" && i + 1 < argc) {
+			sequencePath = argv[++i];
+		} else if (String(argv[i]) == "--shm" && i + 1 < argc) {
+			shmName = argv[++i];
+		} else if (String(argv[i]) == "--record" && i + 1 < argc) {
+			recordPath = argv[++i];
+		} else if (String(argv[i]) == "--views" && i + 1 < argc) {
+			views = atoi(argv[++i]);
+		} else if (String(argv[i]) == "--strips" && i + 1 < argc) {
+			strips = atoi(argv[++i]);
+		} else if (String(argv[i]) == "--voxel" && i + 1 < argc) {
+			gVoxelEnabled = true;
+			gVoxelLeaf = (float)atof(argv[++i]);
+		} else {
+			cloudPath = argv[i];
+		}
+	}
+
+	//--stereo：计算双目视差并在2d窗口中显示，按d键切换
+	if (stereo && RunStereo(strips)) {
+		gViewer2d.SetImage(gStereoViews[gStereoView]);
+		gViewer2d.FitToWindow();
+	}
+	if (gTiledImage.IsOpen()) {
+		//整幅图像缩放到窗口内显示
+		gViewer2d.SetTiledImage(&gTiledImage, &gTileCache);
+		gViewer2d.FitToWindow();
+	}
+	gViewer2d.Open(&gScheduler);
+
+	//--views n：再打开n-1个半尺寸的2d视图，各自独立平移、缩放与标注
+	for (int i = 1; i < views; i++) {
+		gExtraViewers.push_back(std::unique_ptr<Viewer2d>(new Viewer2d(format("%s %d", gWindow2dName.c_str(), i + 1),
+			Size(WIDTH / 2, HEIGHT / 2))));
+		Viewer2d& viewer = *gExtraViewers.back();
+		if (gTiledImage.IsOpen())
+			viewer.SetTiledImage(&gTiledImage, &gTileCache);
+		else if (!gStereoViews.empty())
+			viewer.SetImage(gStereoViews[gStereoView]);
+		viewer.FitToWindow();
+		viewer.Open(&gScheduler);
+	}
+
+	//--stereo-cloud：3d视图显示真值视差反投影得到的点云，代替点云文件
+	//--sequence dir|pattern：按帧播放点云序列，代替单个点云文件
+	//--shm name：显示其他进程通过共享内存发布的点云
+	bool hasCloud;
+	if (!shmName.empty()) {
+		hasCloud = gShmRing.Open(shmName);
+		if (!hasCloud) {
+			printf("cannot open shared memory %s\n", shmName.c_str());
+		}
+		gViewer3d.SetCloud(&gPointsCloud);
+	} else if (!sequencePath.empty()) {
+		hasCloud = gSequence.Open(sequencePath);
+		if (hasCloud) {
+			printf("sequence %s: %zu frames\n", sequencePath.c_str(), gSequence.FrameCount());
+			gSequence.SetReadyCallback([] { gScheduler.Post(gViewer3d.ViewId()); });
+			gSequence.Start();
+			gViewer3d.SetCloud(&gPointsCloud);
+		}
+	} else if (stereoCloud) {
+		Mat disparity = imread(ALOE_GT_PATH, IMREAD_UNCHANGED);
+		hasCloud = !disparity.empty() && LoadStereoCloud(disparity, imread(ALOE_LEFT_PATH));
+		gViewer3d.Renderer().SetColorMode(COLOR_RGB);
+	} else {
+		hasCloud = LoadData(cloudPath);
+	}
+	if (hasCloud) {
+		gViewer3d.Open(&gScheduler);
+
+		//共享内存中的帧从发布到第一次绘制的延迟
+		gViewer3d.SetDrawCallback([] {
+			if (gShmPublishTick != 0) {
+				gShmLatency.Add((getTickCount() - gShmPublishTick) * 1000 / getTickFrequency());
+				gShmPublishTick = 0;
+			}
+		});
+	}
+
+	//--record path：录制两个视图的鼠标回调，供--replay回放
+	if (!recordPath.empty()) {
+		if (gInputRecorder.Open(recordPath, WIDTH, HEIGHT, WIDTH, HEIGHT)) {
+			gViewer2d.SetInputRecorder(&gInputRecorder);
+			gViewer3d.SetInputRecorder(&gInputRecorder);
+		} else {
+			printf("cannot create %s\n", recordPath.c_str());
+		}
 	}
 
 	bool runFlag = true;
 	while (runFlag) {
-		int key = waitKey(2);
+		//到显示时间且已解码的帧换入gPointsCloud，未解码完时继续显示上一帧
+		if (gSequence.IsOpen() && gSequence.Present(gPointsCloud)) {
+			ShowCloud(false);
+			gViewer3d.Invalidate();
+		}
+
+		//共享内存中有新的一帧时直接引用，不拷贝
+		int64_t publishTick;
+		if (gShmRing.IsOpen() && gShmRing.Acquire(gPointsCloud, NULL, &publishTick)) {
+			gShmPublishTick = publishTick;
+			ShowCloud(false);
+			gViewer3d.Invalidate();
+		}
+
+		//没有待重绘的视图时休眠到下次输入、通知或序列的下一帧，不再每2ms轮询一次
+		gScheduler.Dispatch();
+		int wait = gScheduler.WaitMs();
+		if (gShmRing.IsOpen()) {
+			wait = MIN(wait, SHM_POLL_MS);
+		}
+		int sequenceWait = gSequence.IsOpen() ? gSequence.WaitMs() : -1;
+		if (sequenceWait >= 0) {
+			wait = MIN(wait, MAX(sequenceWait, 1));
+		}
+		int key = waitKey(wait);
 		switch (key) {
 		case 'q':
 		{
 			runFlag = false;
 			break;
 		}
+		//依次切换逐点绘制、顶点缓冲绘制与八叉树细节层次绘制
+		case 'r':
+		{
+			gViewer3d.Renderer().SetPath((RenderPath)((gViewer3d.Renderer().Path() + 1) % RENDER_PATH_COUNT));
+			printf("render path: %s\n", RenderPathName(gViewer3d.Renderer().Path()));
+			gViewer3d.Invalidate();
+			break;
+		}
+		//依次切换统一绿色、强度伪彩色与逐点rgb颜色
+		case 'c':
+		{
+			gViewer3d.Renderer().SetColorMode((ColorMode)((gViewer3d.Renderer().GetColorMode() + 1) % COLOR_MODE_COUNT));
+			gViewer3d.Invalidate();
+			break;
+		}
+		//减少、增加点尺寸分桶数
+		case '[':
+		case ']':
+		{
+			SizeBucketConfig config = gViewer3d.Renderer().BucketConfig();
+			config.bucketCount = key == '[' ? MAX(config.bucketCount / 2, 1) : MIN(config.bucketCount * 2, MAX_SIZE_BUCKETS);
+			gViewer3d.Renderer().SetSizeBuckets(config);
+			printf("size buckets: %d\n", config.bucketCount);
+			gViewer3d.Invalidate();
+			break;
+		}
+		//用CPU绘制器绘制当前视图，用于与OpenGL结果对比
+		case 'p':
+		{
+			Mat image;
+			RenderSplats(gViewer3d.Camera(), 1, image);
+			imshow("cpu render", image);
+			break;
+		}
+		//开关视锥剔除
+		case 'v':
+		{
+			gViewer3d.Renderer().SetCulling(!gViewer3d.Renderer().Culling());
+			printf("frustum culling: %s\n", gViewer3d.Renderer().Culling() ? "on" : "off");
+			gViewer3d.Invalidate();
+			break;
+		}
+		//降低、提高3d视图的目标帧率
+		case ',':
+		case '.':
+		{
+			if (gViewer3d.ViewId() >= 0) {
+				FramePacer& pacer = gScheduler.Pacer(gViewer3d.ViewId());
+				pacer.SetTargetFps(pacer.TargetFps() + (key == ',' ? -10 : 10));
+				printf("target fps: %.0f\n", pacer.TargetFps());
+			}
+			break;
+		}
+		//减少、增加八叉树方式的每帧点数预算
+		case '-':
+		case '=':
+		{
+			LodConfig config = gViewer3d.Renderer().Lod();
+			config.pointBudget = key == '-' ? MAX(config.pointBudget / 2, (size_t)1000) : config.pointBudget * 2;
+			gViewer3d.Renderer().SetLod(config);
+			printf("point budget: %zu\n", config.pointBudget);
+			gViewer3d.Invalidate();
+			break;
+		}
+		//开关体素降采样，降低、提高体素边长为一半、两倍，自动选取的边长调整后不再随点云变化
+		case 'o':
+		case '9':
+		case '0':
+		{
+			if (key == 'o')
+				gVoxelEnabled = !gVoxelEnabled;
+			else
+				gVoxelLeaf = key == '9' ? VoxelLeaf() / 2 : VoxelLeaf() * 2;
+			printf("voxel grid: %s, leaf %g%s\n", gVoxelEnabled ? "on" : "off", VoxelLeaf(), gVoxelLeaf > 0 ? "" : " (auto)");
+			//关闭时调整边长不需要重新显示，序列与共享内存的点云在下一帧生效
+			if ((gVoxelEnabled || key == 'o') && gViewer3d.ViewId() >= 0 && !gSequence.IsOpen() && !gShmRing.IsOpen()) {
+				ShowCloud(true);
+				gViewer3d.Invalidate();
+			}
+			break;
+		}
+		//统计当前点云并自动适配3d视图的相机
+		case 'a':
+		{
+			if (gViewer3d.Cloud() == NULL)
+				break;
+			CloudStats stats;
+			int64 startTick = getTickCount();
+			stats.Compute(*gViewer3d.Cloud());
+			double ms = (getTickCount() - startTick) * 1000 / getTickFrequency();
+			stats.Print("cloud stats");
+			printf("stats computed in %.2f ms\n", ms);
+			gViewer3d.FitCamera(stats);
+			break;
+		}
+		//切换点尺寸分桶的线性、对数映射
+		case 'm':
+		{
+			SizeBucketConfig config = gViewer3d.Renderer().BucketConfig();
+			config.mapping = config.mapping == SIZE_MAPPING_LINEAR ? SIZE_MAPPING_LOG : SIZE_MAPPING_LINEAR;
+			gViewer3d.Renderer().SetSizeBuckets(config);
+			printf("size mapping: %s\n", config.mapping == SIZE_MAPPING_LINEAR ? "linear" : "log");
+			gViewer3d.Invalidate();
+			break;
+		}
+		//开始统计帧耗时，再次按下时打印各绘制方式的对比
+		case 'f':
+		{
+			if (gViewer3d.Renderer().Timing()) {
+				gViewer3d.Renderer().PrintStats();
+				gScheduler.PrintStats();
+				if (gSequence.IsOpen()) {
+					gSequence.PrintStats();
+				}
+				gShmLatency.Print("shared memory publish to first draw");
+				gViewer3d.Renderer().SetTiming(false);
+			} else {
+				gViewer3d.Renderer().ResetStats();
+				gScheduler.ResetStats();
+				gSequence.ResetStats();
+				gShmLatency.Reset();
+				gViewer3d.Renderer().SetTiming(true);
+			}
+			break;
+		}
+		//序列播放、暂停
+		case ' ':
+		{
+			if (gSequence.Playing())
+				gSequence.Pause();
+			else
+				gSequence.Play();
+			break;
+		}
+		//暂停并后退、前进一帧，大写时移动序列长度的1/10
+		case 'j':
+		case 'k':
+		case 'J':
+		case 'K':
+		{
+			if (gSequence.IsOpen()) {
+				long step = (key == 'J' || key == 'K') ? MAX((long)gSequence.FrameCount() / 10, 1L) : 1;
+				printf("sequence frame: %ld\n", gSequence.Step(key == 'j' || key == 'J' ? -step : step));
+			}
+			break;
+		}
+		//降低、提高序列播放帧率
+		case '<':
+		case '>':
+		{
+			gSequence.SetFps(gSequence.Fps() + (key == '<' ? -5 : 5));
+			printf("sequence fps: %.0f\n", gSequence.Fps());
+			break;
+		}
+		//添加一万个随机标注并统计绘制耗时
+		case 'n':
+		{
+			Size imageSize = gViewer2d.ImageSize();
+			gViewer2d.EditAnnotations([&](AnnotationLayer& layer) {
+				RNG rng;
+				for (int i = 0; i < 10000; i++) {
+					Point2f point(rng.uniform(0.f, (float)imageSize.width), rng.uniform(0.f, (float)imageSize.height));
+					Point2f extent(rng.uniform(-20.f, 20.f), rng.uniform(-20.f, 20.f));
+					switch (i % 4) {
+					case 0: layer.AddPoint(point, Scalar(0, 0, 255)); break;
+					case 1: layer.AddCross(point, Scalar(0, 255, 0)); break;
+					case 2: layer.AddLine(point, point + extent, Scalar(255, 0, 0)); break;
+					default: layer.AddBox(point, point + extent, Scalar(0, 255, 255)); break;
+					}
+				}
+			});
+			Mat image(Size(WIDTH, HEIGHT), CV_8UC3, Scalar(100, 100, 100));
+			int64 start = getTickCount();
+			size_t drawn = gViewer2d.DrawAnnotations(image);
+			printf("annotations: %zu, drawn %zu in %.2f ms\n", gViewer2d.AnnotationCount(), drawn,
+				(getTickCount() - start) * 1000.0 / getTickFrequency());
+			gViewer2d.Invalidate();
+			break;
+		}
+		//在左图、块匹配视差、半全局匹配视差与真值视差之间切换
+		case 'd':
+		{
+			if (!gStereoViews.empty() && !gTiledImage.IsOpen()) {
+				gStereoView = (gStereoView + 1) % (int)gStereoViews.size();
+				gViewer2d.SetImage(gStereoViews[gStereoView]);
+				gViewer2d.Invalidate();
+			}
+			break;
+		}
+		//把2d窗口当前显示的视差反投影到3d视图
+		case 'g':
+		{
+			if (gViewer3d.ViewId() >= 0 && gStereoView < (int)gStereoDisparities.size() && !gStereoDisparities[gStereoView].empty()) {
+				LoadStereoCloud(gStereoDisparities[gStereoView], gStereoViews[0]);
+				gViewer3d.Invalidate();
+			}
+			break;
+		}
+		//把各线程最近的追踪事件写为Chrome/Perfetto JSON
+		case 't':
+		{
+			static int traceCount = 0;
+			String path = format("trace_%d.json", traceCount++);
+			size_t events = 0;
+			if (DumpTrace(path, &events))
+				printf("trace: %zu events written to %s\n", events, path.c_str());
+			else
+				printf("cannot write %s\n", path.c_str());
+			break;
+		}
+		//清除全部标注
+		case 'x':
+		{
+			gViewer2d.ClearAnnotations();
+			gViewer2d.Invalidate();
+			break;
+		}
 		default:
 			break;
 		}
+
 	}
 
+	if (gInputRecorder.IsOpen()) {
+		printf("recorded %zu mouse events to %s\n", gInputRecorder.Count(), recordPath.c_str());
+		gInputRecorder.Close();
+	}
 	destroyAllWindows();
 	return 0;
 }
\ No newline at end of file
@@ -0,0 +1,136 @@
+﻿#include "mapped_file.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+	: mData(NULL), mSize(0), mIsOpen(false), mCopyOnWrite(false)
+#ifdef _WIN32
+	, mFileHandle(INVALID_HANDLE_VALUE), mMappingHandle(NULL)
+#else
+	, mFd(-1)
+#endif
+{
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+#ifdef _WIN32
+bool MappedFile::Open(const std::string& path, bool copyOnWrite)
+{
+	Close();
+
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || (unsigned long long)size.QuadPart > (size_t)-1) {
+		CloseHandle(file);
+		return false;
+	}
+
+	mFileHandle = file;
+	mSize = (size_t)size.QuadPart;
+	mIsOpen = true;
+	//空文件无法创建映射
+	if (mSize == 0) {
+		return true;
+	}
+
+	mMappingHandle = CreateFileMappingA(file, NULL, copyOnWrite ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, NULL);
+	if (mMappingHandle == NULL) {
+		Close();
+		return false;
+	}
+
+	mData = (const char*)MapViewOfFile(mMappingHandle, copyOnWrite ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0);
+	if (mData == NULL) {
+		Close();
+		return false;
+	}
+	mCopyOnWrite = copyOnWrite;
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (mData != NULL) {
+		UnmapViewOfFile(mData);
+	}
+	if (mMappingHandle != NULL) {
+		CloseHandle(mMappingHandle);
+	}
+	if (mFileHandle != INVALID_HANDLE_VALUE) {
+		CloseHandle(mFileHandle);
+	}
+	mData = NULL;
+	mSize = 0;
+	mIsOpen = false;
+	mCopyOnWrite = false;
+	mFileHandle = INVALID_HANDLE_VALUE;
+	mMappingHandle = NULL;
+}
+#else
+bool MappedFile::Open(const std::string& path, bool copyOnWrite)
+{
+	Close();
+
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		return false;
+	}
+
+	mFd = fd;
+	mSize = (size_t)st.st_size;
+	mIsOpen = true;
+	//空文件无法创建映射
+	if (mSize == 0) {
+		return true;
+	}
+
+	int protection = copyOnWrite ? PROT_READ | PROT_WRITE : PROT_READ;
+	void* data = mmap(NULL, mSize, protection, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED) {
+		Close();
+		return false;
+	}
+	//顺序扫描为主，提示内核加大预读
+	madvise(data, mSize, MADV_SEQUENTIAL);
+	mData = (const char*)data;
+	mCopyOnWrite = copyOnWrite;
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (mData != NULL) {
+		munmap((void*)mData, mSize);
+	}
+	if (mFd >= 0) {
+		close(mFd);
+	}
+	mData = NULL;
+	mSize = 0;
+	mIsOpen = false;
+	mCopyOnWrite = false;
+	mFd = -1;
+}
+#endif
@@ -0,0 +1,42 @@
+﻿#pragma once
+
+#include <string>
+#include <stddef.h>
+
+/**
+  * 只读内存映射文件
+  */
+class MappedFile {
+public:
+	MappedFile();
+	~MappedFile();
+
+	/**
+	  * 映射整个文件
+	  * @param[in] path 文件路径
+	  * @param[in] copyOnWrite 为true时映射可写，写入只影响本进程的私有页面，不会写回文件
+	  * @return 成功返回true，空文件同样返回true且Data()为NULL
+	  */
+	bool Open(const std::string& path, bool copyOnWrite = false);
+	void Close();
+
+	const char* Data() const { return mData; }
+	char* WritableData() const { return mCopyOnWrite ? (char*)mData : NULL; }
+	size_t Size() const { return mSize; }
+	bool IsOpen() const { return mIsOpen; }
+
+private:
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+
+	const char* mData;
+	size_t mSize;
+	bool mIsOpen;
+	bool mCopyOnWrite;
+#ifdef _WIN32
+	void* mFileHandle;
+	void* mMappingHandle;
+#else
+	int mFd;
+#endif
+};
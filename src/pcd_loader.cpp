@@ -0,0 +1,440 @@
+﻿#include "pcd_loader.h"
+#include "xyzi_loader.h"
+#include "mapped_file.h"
+#include "opencv2/core/utility.hpp"
+#include <stdlib.h>
+#include <string.h>
+#include <cmath>
+#include <sstream>
+
+#define PCD_BLOCK_POINTS		(64 * 1024)
+
+using namespace cv;
+
+namespace {
+
+/* 按字段类型读取一个元素并转换为float */
+struct FieldReader {
+	const unsigned char* base;
+	size_t stride;
+	int size;
+	char type;
+
+	inline float Read(size_t i) const
+	{
+		const unsigned char* p = base + i * stride;
+		switch (type) {
+		case 'F':
+			if (size == 4) {
+				float v;
+				memcpy(&v, p, 4);
+				return v;
+			} else {
+				double v;
+				memcpy(&v, p, 8);
+				return (float)v;
+			}
+		case 'I':
+			if (size == 1) {
+				return (float)*(const signed char*)p;
+			} else if (size == 2) {
+				short v;
+				memcpy(&v, p, 2);
+				return v;
+			} else {
+				int v;
+				memcpy(&v, p, 4);
+				return (float)v;
+			}
+		default:
+			if (size == 1) {
+				return *p;
+			} else if (size == 2) {
+				unsigned short v;
+				memcpy(&v, p, 2);
+				return v;
+			} else {
+				unsigned int v;
+				memcpy(&v, p, 4);
+				return (float)v;
+			}
+		}
+	}
+};
+
+/* 附加字段按原始字节拷贝 */
+struct RawReader {
+	const unsigned char* base;
+	size_t stride;
+	size_t size;
+	unsigned char* target;
+};
+
+bool IsValidField(const PcdField& field)
+{
+	if (field.count <= 0) {
+		return false;
+	}
+	if (field.type == 'F') {
+		return field.size == 4 || field.size == 8;
+	}
+	if (field.type == 'I' || field.type == 'U') {
+		return field.size == 1 || field.size == 2 || field.size == 4;
+	}
+	return false;
+}
+
+/**
+  * 字段对应的OpenCV深度，OpenCV没有32位无符号深度，U4按位存为CV_32S
+  */
+int FieldDepth(const PcdField& field)
+{
+	if (field.type == 'F') {
+		return field.size == 4 ? CV_32F : CV_64F;
+	}
+	if (field.type == 'I') {
+		return field.size == 1 ? CV_8S : field.size == 2 ? CV_16S : CV_32S;
+	}
+	return field.size == 1 ? CV_8U : field.size == 2 ? CV_16U : CV_32S;
+}
+
+/**
+  * 将binary数据(行主序)或解压后的binary_compressed数据(列主序)转换为点云，
+  * x、y、z、intensity转换为float列，其余COUNT为1的字段作为附加字段原样拷贝
+  */
+void ConvertBinary(const PcdHeader& header, const unsigned char* data, bool columnMajor, PointsCloud& cloud)
+{
+	const char* names[4] = { "x", "y", "z", "intensity" };
+	FieldReader readers[4];
+	bool hasIntensity = header.FindField("intensity") >= 0;
+	size_t points = header.points;
+
+	//按POINTS预分配，各块直接写入自己的区间
+	cloud.Resize(points);
+
+	std::vector<RawReader> extras;
+	for (size_t f = 0; f < header.fields.size(); f++) {
+		const PcdField& field = header.fields[f];
+		const unsigned char* base = columnMajor ? data + field.offset * points : data + field.offset;
+		size_t stride = columnMajor ? field.size * field.count : header.pointStep;
+
+		int k = 0;
+		while (k < 4 && field.name != names[k]) {
+			k++;
+		}
+		if (k < 4) {
+			readers[k].base = base;
+			readers[k].stride = stride;
+			readers[k].size = field.size;
+			readers[k].type = field.type;
+		} else if (field.count == 1 && cloud.FindField(field.name) == NULL) {
+			cloud.AddField(field.name, FieldDepth(field));
+			RawReader reader = { base, stride, (size_t)field.size, NULL };
+			extras.push_back(reader);
+		}
+	}
+	//字段全部注册后再取数据地址，注册过程中字段表可能重新分配
+	for (size_t e = 0; e < extras.size(); e++) {
+		extras[e].target = cloud.fields[e].data.data();
+	}
+
+	float* px = cloud.x.data();
+	float* py = cloud.y.data();
+	float* pz = cloud.z.data();
+	float* pi = cloud.intensity.data();
+
+	int blockCount = (int)((points + PCD_BLOCK_POINTS - 1) / PCD_BLOCK_POINTS);
+	std::vector<size_t> valid(blockCount, 0);
+	parallel_for_(Range(0, blockCount), [&](const Range& range) {
+		for (int b = range.start; b < range.end; b++) {
+			size_t begin = (size_t)b * PCD_BLOCK_POINTS;
+			size_t end = MIN(points, begin + PCD_BLOCK_POINTS);
+
+			//无效点前移压实，块内保持原有顺序
+			size_t out = begin;
+			for (size_t i = begin; i < end; i++) {
+				float vx = readers[0].Read(i), vy = readers[1].Read(i), vz = readers[2].Read(i);
+				if (!std::isfinite(vx) || !std::isfinite(vy) || !std::isfinite(vz)) {
+					continue;
+				}
+				px[out] = vx;
+				py[out] = vy;
+				pz[out] = vz;
+				pi[out] = hasIntensity ? readers[3].Read(i) : DEFAULT_INTENSITY;
+				for (size_t e = 0; e < extras.size(); e++) {
+					const RawReader& extra = extras[e];
+					memcpy(extra.target + out * extra.size, extra.base + i * extra.stride, extra.size);
+				}
+				out++;
+			}
+			valid[b] = out - begin;
+		}
+	}, blockCount);
+
+	//存在无效点时把块间空洞压实
+	size_t total = 0;
+	for (int b = 0; b < blockCount; b++) {
+		size_t begin = (size_t)b * PCD_BLOCK_POINTS;
+		size_t count = valid[b];
+		if (total != begin && count > 0) {
+			memmove(px + total, px + begin, count * sizeof(float));
+			memmove(py + total, py + begin, count * sizeof(float));
+			memmove(pz + total, pz + begin, count * sizeof(float));
+			memmove(pi + total, pi + begin, count * sizeof(float));
+			for (size_t e = 0; e < extras.size(); e++) {
+				const RawReader& extra = extras[e];
+				memmove(extra.target + total * extra.size, extra.target + begin * extra.size, count * extra.size);
+			}
+		}
+		total += count;
+	}
+	cloud.Resize(total);
+	cloud.UpdateBoundary();
+}
+
+bool LoadPcdAscii(const PcdHeader& header, const char* data, size_t size, PointsCloud& cloud)
+{
+	const char* names[4] = { "x", "y", "z", "intensity" };
+	TextColumns columns;
+	columns.count = 0;
+	columns.skipNonFinite = true;
+	for (int k = 0; k < 4; k++) {
+		int index = header.FindField(names[k]);
+		if (index < 0) {
+			columns.index[k] = -1;
+			continue;
+		}
+		//ascii中每个元素占一列，字段的列号为之前所有字段COUNT之和
+		int column = 0;
+		for (int f = 0; f < index; f++) {
+			column += header.fields[f].count;
+		}
+		columns.index[k] = column;
+		columns.count = MAX(columns.count, column + 1);
+	}
+
+	cloud.Reserve(header.points);
+	return ParseXyziText(data + header.dataOffset, size - header.dataOffset, columns, cloud);
+}
+
+bool LoadPcdBinary(const PcdHeader& header, const char* data, size_t size, PointsCloud& cloud)
+{
+	if ((size - header.dataOffset) / header.pointStep < header.points) {
+		return false;
+	}
+	ConvertBinary(header, (const unsigned char*)data + header.dataOffset, false, cloud);
+	return true;
+}
+
+bool LoadPcdCompressed(const PcdHeader& header, const char* data, size_t size, PointsCloud& cloud)
+{
+	//数据区：压缩字节数(uint32) + 解压字节数(uint32) + LZF数据
+	if (size - header.dataOffset < 8) {
+		return false;
+	}
+	unsigned int compressedSize, uncompressedSize;
+	memcpy(&compressedSize, data + header.dataOffset, 4);
+	memcpy(&uncompressedSize, data + header.dataOffset + 4, 4);
+	if (compressedSize > size - header.dataOffset - 8 || uncompressedSize != header.points * header.pointStep) {
+		return false;
+	}
+
+	std::vector<unsigned char> buffer(uncompressedSize);
+	if (uncompressedSize > 0) {
+		const unsigned char* in = (const unsigned char*)data + header.dataOffset + 8;
+		if (LzfDecompress(in, compressedSize, &buffer[0], uncompressedSize) != uncompressedSize) {
+			return false;
+		}
+	}
+	ConvertBinary(header, buffer.empty() ? NULL : &buffer[0], true, cloud);
+	return true;
+}
+
+}
+
+int PcdHeader::FindField(const std::string& name) const
+{
+	for (size_t i = 0; i < fields.size(); i++) {
+		if (fields[i].name == name) {
+			return (int)i;
+		}
+	}
+	return -1;
+}
+
+bool ParsePcdHeader(const char* data, size_t size, PcdHeader& header)
+{
+	header = PcdHeader();
+	std::vector<int> sizes, counts;
+	std::vector<std::string> types;
+	bool hasPoints = false;
+
+	const char* p = data;
+	const char* end = data + size;
+	while (p < end) {
+		const char* lineEnd = (const char*)memchr(p, '\n', end - p);
+		if (lineEnd == NULL) {
+			lineEnd = end;
+		}
+		std::istringstream line(std::string(p, lineEnd));
+		p = lineEnd < end ? lineEnd + 1 : end;
+
+		std::string key;
+		if (!(line >> key) || key[0] == '#') {
+			continue;
+		}
+
+		if (key == "FIELDS" || key == "COLUMNS") {
+			std::string name;
+			while (line >> name) {
+				PcdField field;
+				field.name = name;
+				field.size = 4;
+				field.type = 'F';
+				field.count = 1;
+				field.offset = 0;
+				header.fields.push_back(field);
+			}
+		} else if (key == "SIZE") {
+			int value;
+			while (line >> value) {
+				sizes.push_back(value);
+			}
+		} else if (key == "TYPE") {
+			std::string value;
+			while (line >> value) {
+				types.push_back(value);
+			}
+		} else if (key == "COUNT") {
+			int value;
+			while (line >> value) {
+				counts.push_back(value);
+			}
+		} else if (key == "WIDTH") {
+			line >> header.width;
+		} else if (key == "HEIGHT") {
+			line >> header.height;
+		} else if (key == "POINTS") {
+			line >> header.points;
+			hasPoints = true;
+		} else if (key == "DATA") {
+			line >> header.data;
+			header.dataOffset = p - data;
+			break;
+		}
+	}
+
+	if (header.data.empty() || header.fields.empty()) {
+		return false;
+	}
+	if (sizes.size() != header.fields.size() || types.size() != header.fields.size()) {
+		return false;
+	}
+	if (!counts.empty() && counts.size() != header.fields.size()) {
+		return false;
+	}
+	if (!hasPoints) {
+		header.points = header.width * header.height;
+	}
+
+	for (size_t i = 0; i < header.fields.size(); i++) {
+		PcdField& field = header.fields[i];
+		field.size = sizes[i];
+		field.type = types[i].size() == 1 ? types[i][0] : '?';
+		field.count = counts.empty() ? 1 : counts[i];
+		field.offset = header.pointStep;
+		if (!IsValidField(field)) {
+			return false;
+		}
+		header.pointStep += field.size * field.count;
+	}
+
+	if (header.FindField("x") < 0 || header.FindField("y") < 0 || header.FindField("z") < 0) {
+		return false;
+	}
+	return header.data == "ascii" || header.data == "binary" || header.data == "binary_compressed";
+}
+
+size_t LzfDecompress(const unsigned char* in, size_t inSize, unsigned char* out, size_t outSize)
+{
+	const unsigned char* ip = in;
+	const unsigned char* inEnd = in + inSize;
+	unsigned char* op = out;
+	unsigned char* outEnd = out + outSize;
+
+	while (ip < inEnd) {
+		unsigned int ctrl = *ip++;
+
+		//字面量：长度为ctrl+1
+		if (ctrl < (1 << 5)) {
+			ctrl++;
+			if ((size_t)(outEnd - op) < ctrl || (size_t)(inEnd - ip) < ctrl) {
+				return 0;
+			}
+			memcpy(op, ip, ctrl);
+			op += ctrl;
+			ip += ctrl;
+			continue;
+		}
+
+		//回溯引用：高3位为长度，低5位与下一字节为距离
+		unsigned int length = ctrl >> 5;
+		if (length == 7) {
+			if (ip >= inEnd) {
+				return 0;
+			}
+			length += *ip++;
+		}
+		if (ip >= inEnd) {
+			return 0;
+		}
+		size_t distance = ((size_t)(ctrl & 0x1f) << 8) + *ip++ + 1;
+		length += 2;
+		if (distance > (size_t)(op - out) || (size_t)(outEnd - op) < length) {
+			return 0;
+		}
+
+		//源与目标可能重叠，逐字节拷贝
+		const unsigned char* ref = op - distance;
+		for (unsigned int k = 0; k < length; k++) {
+			*op++ = *ref++;
+		}
+	}
+	return op - out;
+}
+
+bool LoadPcd(const std::string& path, PointsCloud& cloud, LoadStats* stats)
+{
+	int64 startTick = getTickCount();
+
+	MappedFile file;
+	if (!file.Open(path)) {
+		return false;
+	}
+
+	PcdHeader header;
+	if (!ParsePcdHeader(file.Data(), file.Size(), header)) {
+		return false;
+	}
+
+	cloud.Reset();
+	bool result = false;
+	if (header.data == "ascii") {
+		result = LoadPcdAscii(header, file.Data(), file.Size(), cloud);
+	} else if (header.data == "binary") {
+		result = LoadPcdBinary(header, file.Data(), file.Size(), cloud);
+	} else {
+		result = LoadPcdCompressed(header, file.Data(), file.Size(), cloud);
+	}
+	if (!result) {
+		cloud.Reset();
+		return false;
+	}
+
+	if (stats != NULL) {
+		stats->bytes = file.Size();
+		stats->points = cloud.Size();
+		stats->seconds = (getTickCount() - startTick) / getTickFrequency();
+	}
+	return true;
+}
@@ -0,0 +1,63 @@
+﻿#pragma once
+
+#include "points_cloud.h"
+#include <string>
+#include <vector>
+
+/* PCD文件头中的一个字段 */
+struct PcdField {
+	std::string name;
+	int size;			//单个元素字节数
+	char type;			//'F'浮点、'I'有符号整数、'U'无符号整数
+	int count;			//元素个数
+	size_t offset;		//binary格式下在一个点中的字节偏移
+};
+
+/* PCD v0.7文件头 */
+struct PcdHeader {
+	std::vector<PcdField> fields;
+	size_t width;
+	size_t height;
+	size_t points;
+	size_t pointStep;	//一个点的字节数
+	std::string data;	//ascii、binary或binary_compressed
+	size_t dataOffset;	//数据区在文件中的起始位置
+
+	PcdHeader() : width(0), height(0), points(0), pointStep(0), dataOffset(0) {}
+
+	/**
+	  * 查找字段
+	  * @return 字段下标，不存在返回-1
+	  */
+	int FindField(const std::string& name) const;
+};
+
+/**
+  * 解析PCD文件头
+  * @param[in] data 文件内容
+  * @param[in] size 文件字节数
+  * @param[out] header 文件头
+  * @return 文件头不完整或不支持返回false
+  */
+bool ParsePcdHeader(const char* data, size_t size, PcdHeader& header);
+
+/**
+  * 加载PCD点云，支持DATA ascii、binary与binary_compressed，
+  * 读取x、y、z与intensity字段，缺少intensity时使用默认强度，跳过坐标非有限值的点，
+  * binary与binary_compressed中其余COUNT为1的字段作为附加字段保留
+  * @param[in] path 文件路径
+  * @param[out] cloud 输出点云，包含边界与中心点
+  * @param[out] stats 耗时统计，可为NULL
+  * @return 文件打开失败或格式错误返回false
+  */
+bool LoadPcd(const std::string& path, PointsCloud& cloud, LoadStats* stats = NULL);
+
+/**
+  * LZF解压
+  * @param[in] in 压缩数据
+  * @param[in] inSize 压缩数据字节数
+  * @param[out] out 输出缓冲
+  * @param[in] outSize 输出缓冲字节数
+  * @return 解压后的字节数，数据损坏或缓冲不足返回0
+  */
+size_t LzfDecompress(const unsigned char* in, size_t inSize, unsigned char* out, size_t outSize);
@@ -0,0 +1,158 @@
+﻿#include "points_cloud.h"
+#include "cloud_stats.h"
+#include "simd_intrin.h"
+#include <string.h>
+
+using namespace cv;
+
+void PointsCloud::Reserve(size_t count)
+{
+	x.reserve(count);
+	y.reserve(count);
+	z.reserve(count);
+	intensity.reserve(count);
+	for (size_t i = 0; i < fields.size(); i++) {
+		fields[i].data.reserve(count * fields[i].ElemSize());
+	}
+}
+
+void PointsCloud::Resize(size_t count)
+{
+	x.resize(count);
+	y.resize(count);
+	z.resize(count);
+	intensity.resize(count);
+	for (size_t i = 0; i < fields.size(); i++) {
+		fields[i].data.resize(count * fields[i].ElemSize());
+	}
+}
+
+void PointsCloud::PushBack(const Point3f& point, float value)
+{
+	x.push_back(point.x);
+	y.push_back(point.y);
+	z.push_back(point.z);
+	intensity.push_back(value);
+	for (size_t i = 0; i < fields.size(); i++) {
+		fields[i].data.resize(x.size() * fields[i].ElemSize());
+	}
+}
+
+PointField* PointsCloud::AddField(const std::string& name, int depth)
+{
+	PointField* field = FindField(name);
+	if (field != NULL) {
+		return field->depth == depth ? field : NULL;
+	}
+
+	fields.push_back(PointField());
+	field = &fields.back();
+	field->name = name;
+	field->depth = depth;
+	field->data.resize(Size() * field->ElemSize());
+	return field;
+}
+
+PointField* PointsCloud::FindField(const std::string& name)
+{
+	for (size_t i = 0; i < fields.size(); i++) {
+		if (fields[i].name == name) {
+			return &fields[i];
+		}
+	}
+	return NULL;
+}
+
+const PointField* PointsCloud::FindField(const std::string& name) const
+{
+	return const_cast<PointsCloud*>(this)->FindField(name);
+}
+
+void PointsCloud::RemoveField(const std::string& name)
+{
+	for (size_t i = 0; i < fields.size(); i++) {
+		if (fields[i].name == name) {
+			fields.erase(fields.begin() + i);
+			return;
+		}
+	}
+}
+
+void PointsCloud::UpdateBoundary()
+{
+	//只统计坐标，三列在同一次并行遍历中完成
+	CloudStats stats;
+	stats.Accumulate(x.data(), y.data(), z.data(), NULL, Size());
+	stats.ApplyBoundary(*this);
+}
+
+void PointsCloud::Transform(const Matx34f& transform)
+{
+	const Matx34f& m = transform;
+	float* px = x.data();
+	float* py = y.data();
+	float* pz = z.data();
+	size_t count = Size();
+	size_t i = 0;
+
+#if CV_SIMD128
+	v_float32x4 m00 = v_setall_f32(m(0, 0)), m01 = v_setall_f32(m(0, 1)), m02 = v_setall_f32(m(0, 2)), m03 = v_setall_f32(m(0, 3));
+	v_float32x4 m10 = v_setall_f32(m(1, 0)), m11 = v_setall_f32(m(1, 1)), m12 = v_setall_f32(m(1, 2)), m13 = v_setall_f32(m(1, 3));
+	v_float32x4 m20 = v_setall_f32(m(2, 0)), m21 = v_setall_f32(m(2, 1)), m22 = v_setall_f32(m(2, 2)), m23 = v_setall_f32(m(2, 3));
+	for (; i + 4 <= count; i += 4) {
+		v_float32x4 vx = v_load(px + i);
+		v_float32x4 vy = v_load(py + i);
+		v_float32x4 vz = v_load(pz + i);
+		v_store(px + i, v_muladd(m00, vx, v_muladd(m01, vy, v_muladd(m02, vz, m03))));
+		v_store(py + i, v_muladd(m10, vx, v_muladd(m11, vy, v_muladd(m12, vz, m13))));
+		v_store(pz + i, v_muladd(m20, vx, v_muladd(m21, vy, v_muladd(m22, vz, m23))));
+	}
+#endif
+	for (; i < count; i++) {
+		float vx = px[i], vy = py[i], vz = pz[i];
+		px[i] = m(0, 0) * vx + (m(0, 1) * vy + (m(0, 2) * vz + m(0, 3)));
+		py[i] = m(1, 0) * vx + (m(1, 1) * vy + (m(1, 2) * vz + m(1, 3)));
+		pz[i] = m(2, 0) * vx + (m(2, 1) * vy + (m(2, 2) * vz + m(2, 3)));
+	}
+
+	UpdateBoundary();
+}
+
+bool ColumnMinMax(const float* data, size_t count, float& minValue, float& maxValue)
+{
+	//以第一个非nan元素为初值
+	size_t i = 0;
+	while (i < count && data[i] != data[i]) {
+		i++;
+	}
+	if (i == count) {
+		return false;
+	}
+	float lower = data[i], upper = data[i];
+
+#if CV_SIMD128
+	v_float32x4 vlower = v_setall_f32(lower), vupper = v_setall_f32(upper);
+	for (; i + 4 <= count; i += 4) {
+		v_float32x4 v = v_load(data + i);
+		//nan与自身不相等，用当前边界替换后不影响结果
+		v_float32x4 valid = v == v;
+		vlower = v_min(vlower, v_select(valid, v, vlower));
+		vupper = v_max(vupper, v_select(valid, v, vupper));
+	}
+	lower = v_reduce_min(vlower);
+	upper = v_reduce_max(vupper);
+#endif
+	for (; i < count; i++) {
+		float v = data[i];
+		if (v < lower) {
+			lower = v;
+		}
+		if (v > upper) {
+			upper = v;
+		}
+	}
+
+	minValue = lower;
+	maxValue = upper;
+	return true;
+}
@@ -0,0 +1,160 @@
+﻿#pragma once
+
+#include "opencv2/core.hpp"
+#include "column_buffer.h"
+#include <string>
+#include <vector>
+
+#define DEFAULT_INTENSITY		100
+#define RGB_FIELD_NAME			"rgb"		//打包为0x00RRGGBB的逐点颜色，与PCD约定一致
+
+/* 加载耗时统计 */
+struct LoadStats {
+	size_t bytes;
+	size_t points;
+	double seconds;
+	bool fromCache;
+
+	LoadStats() : bytes(0), points(0), seconds(0), fromCache(false) {}
+
+	double Throughput() const
+	{
+		return seconds > 0 ? bytes / (1024.0 * 1024.0) / seconds : 0;
+	}
+};
+
+/**
+  * 附加的逐点字段，如ring、timestamp，
+  * 按OpenCV深度(CV_8U、CV_32F等)记录类型，数据为一列连续存放的元素
+  */
+struct PointField {
+	std::string name;
+	int depth;
+	ColumnBuffer<unsigned char> data;
+
+	size_t ElemSize() const { return CV_ELEM_SIZE1(depth); }
+
+	template<typename T>
+	T* Data() { return cv::DataType<T>::depth == depth ? (T*)data.data() : NULL; }
+
+	template<typename T>
+	const T* Data() const { return cv::DataType<T>::depth == depth ? (const T*)data.data() : NULL; }
+};
+
+/**
+  * 点云，按列(SoA)存放x、y、z、intensity以及附加字段，
+  * 各列按COLUMN_ALIGNMENT对齐、长度一致，便于SIMD逐列处理
+  */
+struct PointsCloud {
+	ColumnBuffer<float> x;
+	ColumnBuffer<float> y;
+	ColumnBuffer<float> z;
+	ColumnBuffer<float> intensity;
+	std::vector<PointField> fields;
+
+	cv::Point3f lowerBoundary;
+	cv::Point3f upperBoundary;
+	cv::Point3f centerPoint;
+	float width, height, depth;
+
+	PointsCloud() : width(0), height(0), depth(0) {}
+
+	size_t Size() const { return x.size(); }
+	bool Empty() const { return x.empty(); }
+
+	cv::Point3f Point(size_t i) const { return cv::Point3f(x[i], y[i], z[i]); }
+
+	void Reset()
+	{
+		x.clear();
+		y.clear();
+		z.clear();
+		intensity.clear();
+		fields.clear();
+		lowerBoundary = cv::Point3f();
+		upperBoundary = cv::Point3f();
+		centerPoint = cv::Point3f();
+		width = height = depth = 0;
+	}
+
+	/**
+	  * 为所有列(包括附加字段)预留空间
+	  */
+	void Reserve(size_t count);
+
+	/**
+	  * 调整所有列(包括附加字段)的长度，新增元素为0
+	  */
+	void Resize(size_t count);
+
+	/**
+	  * 追加一个点，附加字段补0
+	  */
+	void PushBack(const cv::Point3f& point, float value);
+
+	/**
+	  * 注册附加字段，长度与点数一致并初始化为0，同名同类型字段已存在时返回原字段
+	  * @param[in] name 字段名
+	  * @param[in] depth OpenCV深度
+	  * @return 字段，与已有字段类型冲突时返回NULL
+	  */
+	PointField* AddField(const std::string& name, int depth);
+
+	template<typename T>
+	T* AddField(const std::string& name)
+	{
+		PointField* field = AddField(name, cv::DataType<T>::depth);
+		return field ? field->Data<T>() : NULL;
+	}
+
+	/**
+	  * 查找附加字段
+	  * @return 不存在返回NULL
+	  */
+	PointField* FindField(const std::string& name);
+	const PointField* FindField(const std::string& name) const;
+
+	template<typename T>
+	T* Field(const std::string& name)
+	{
+		PointField* field = FindField(name);
+		return field ? field->Data<T>() : NULL;
+	}
+
+	void RemoveField(const std::string& name);
+
+	/**
+	  * 用CloudStats并行SIMD计算上下边界并更新尺寸与中心点，忽略坐标含nan的点
+	  */
+	void UpdateBoundary();
+
+	/**
+	  * 对所有点做仿射变换 p' = R * p + t，逐列SIMD计算，完成后更新边界
+	  * @param[in] transform 3x4变换矩阵[R|t]
+	  */
+	void Transform(const cv::Matx34f& transform);
+
+	/**
+	  * 根据上下边界更新尺寸与中心点
+	  */
+	void UpdateCenter()
+	{
+		width = upperBoundary.x - lowerBoundary.x;
+		height = upperBoundary.y - lowerBoundary.y;
+		depth = upperBoundary.z - lowerBoundary.z;
+
+		centerPoint.x = (upperBoundary.x + lowerBoundary.x) / 2;
+		centerPoint.y = (upperBoundary.y + lowerBoundary.y) / 2;
+		centerPoint.z = (upperBoundary.z + lowerBoundary.z) / 2;
+	}
+};
+
+/**
+  * 计算一列数据的最小值与最大值，忽略nan
+  * @param[in] data 数据
+  * @param[in] count 元素个数
+  * @param[out] minValue 最小值
+  * @param[out] maxValue 最大值
+  * @return 全部为nan或count为0时返回false
+  */
+bool ColumnMinMax(const float* data, size_t count, float& minValue, float& maxValue);
@@ -0,0 +1,281 @@
+﻿#include "points_octree.h"
+#include "opencv2/core/utility.hpp"
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+#include <queue>
+
+#define OWN_POINT				8
+
+using namespace cv;
+
+namespace {
+
+inline int GridCell(float value, int grid)
+{
+	//nan归入第0格
+	int cell = value > 0 ? (int)value : 0;
+	return MIN(cell, grid - 1);
+}
+
+/**
+  * 节点采样间距投影到屏幕上的像素数，相机位于节点包围球内时返回FLT_MAX
+  */
+float ProjectedSpacing(const OctreeNode& node, const LodView& view, float projScale)
+{
+	float half = node.size / 2;
+	Vec4f center = view.modelview * Vec4f(node.lower.x + half, node.lower.y + half, node.lower.z + half, 1);
+	float distance = sqrtf(center[0] * center[0] + center[1] * center[1] + center[2] * center[2]) - half * 1.7320508f;
+	return distance > 0 ? node.spacing * projScale / distance : FLT_MAX;
+}
+
+/* 待细化的节点，inside表示节点已确定完全在视锥内 */
+struct Candidate {
+	float error;
+	int node;
+	bool inside;
+
+	bool operator<(const Candidate& other) const { return error < other.error; }
+};
+
+}
+
+void PointsOctree::Clear()
+{
+	std::vector<OctreeNode>().swap(mNodes);
+	std::vector<uint32_t>().swap(mOrder);
+}
+
+void PointsOctree::Build(const PointsCloud& cloud, const OctreeConfig& config)
+{
+	Clear();
+	size_t count = cloud.Size();
+	if (count == 0 || count > UINT32_MAX) {
+		return;
+	}
+
+	//以最长边为边长的立方体作为根节点
+	float size = MAX(cloud.width, MAX(cloud.height, cloud.depth));
+	OctreeNode root;
+	root.lower = cloud.lowerBoundary;
+	root.size = size > 0 ? size : 1;
+	root.spacing = root.size / config.sampleGrid;
+	root.level = 0;
+	for (int c = 0; c < 8; c++) {
+		root.children[c] = -1;
+	}
+	root.first = 0;
+	root.count = 0;
+	root.totalCount = count;
+	mNodes.push_back(root);
+
+	mOrder.resize(count);
+	for (size_t i = 0; i < count; i++) {
+		mOrder[i] = (uint32_t)i;
+	}
+
+	//先逐层细分出足够多的子树，子树的点范围互不重叠，再并行构建各子树
+	size_t taskCount = (size_t)MAX(getNumThreads(), 1) * 4;
+	std::vector<Task> pending(1), next;
+	pending[0].node = 0;
+	pending[0].begin = 0;
+	pending[0].end = count;
+	{
+		Scratch scratch;
+		while (!pending.empty() && pending.size() < taskCount) {
+			next.clear();
+			for (size_t t = 0; t < pending.size(); t++) {
+				SplitNode(cloud, config, pending[t], mNodes, next, scratch);
+			}
+			pending.swap(next);
+		}
+	}
+
+	std::vector<std::vector<OctreeNode> > subtrees(pending.size());
+	parallel_for_(Range(0, (int)pending.size()), [&](const Range& range) {
+		Scratch scratch;
+		for (int t = range.start; t < range.end; t++) {
+			//子树在局部数组中以0号节点为根
+			Task task = pending[t];
+			subtrees[t].push_back(mNodes[task.node]);
+			task.node = 0;
+			BuildSubtree(cloud, config, task, subtrees[t], scratch);
+		}
+	});
+
+	//合并子树并重映射子节点下标
+	for (size_t t = 0; t < pending.size(); t++) {
+		std::vector<OctreeNode>& subtree = subtrees[t];
+		int base = (int)mNodes.size() - 1;
+		for (size_t i = 0; i < subtree.size(); i++) {
+			for (int c = 0; c < 8; c++) {
+				if (subtree[i].children[c] > 0) {
+					subtree[i].children[c] += base;
+				}
+			}
+		}
+		mNodes[pending[t].node] = subtree[0];
+		mNodes.insert(mNodes.end(), subtree.begin() + 1, subtree.end());
+	}
+}
+
+void PointsOctree::BuildSubtree(const PointsCloud& cloud, const OctreeConfig& config, const Task& root,
+	std::vector<OctreeNode>& nodes, Scratch& scratch)
+{
+	std::vector<Task> stack(1, root);
+	while (!stack.empty()) {
+		Task task = stack.back();
+		stack.pop_back();
+		SplitNode(cloud, config, task, nodes, stack, scratch);
+	}
+}
+
+void PointsOctree::SplitNode(const PointsCloud& cloud, const OctreeConfig& config, const Task& task,
+	std::vector<OctreeNode>& nodes, std::vector<Task>& children, Scratch& scratch)
+{
+	size_t count = task.end - task.begin;
+	OctreeNode node = nodes[task.node];
+	node.first = task.begin;
+	node.count = count;
+	node.totalCount = count;
+	if (count <= config.nodeCapacity || node.level >= config.maxDepth) {
+		nodes[task.node] = node;
+		return;
+	}
+
+	//每个采样格保留第一个落入的点作为代表点，其余点按卦限下放
+	int grid = config.sampleGrid;
+	size_t cellCount = (size_t)grid * grid * grid;
+	if (scratch.stamps.size() != cellCount) {
+		scratch.stamps.assign(cellCount, 0);
+		scratch.stamp = 0;
+	}
+	if (++scratch.stamp == 0) {
+		std::fill(scratch.stamps.begin(), scratch.stamps.end(), 0);
+		scratch.stamp = 1;
+	}
+	scratch.codes.resize(count);
+	scratch.buffer.resize(count);
+
+	uint32_t* order = &mOrder[task.begin];
+	float half = node.size / 2;
+	Point3f middle(node.lower.x + half, node.lower.y + half, node.lower.z + half);
+	float cellScale = grid / node.size;
+	size_t counts[OWN_POINT + 1] = { 0 };
+	for (size_t k = 0; k < count; k++) {
+		uint32_t i = order[k];
+		float x = cloud.x[i], y = cloud.y[i], z = cloud.z[i];
+		size_t cell = ((size_t)GridCell((z - node.lower.z) * cellScale, grid) * grid
+			+ GridCell((y - node.lower.y) * cellScale, grid)) * grid
+			+ GridCell((x - node.lower.x) * cellScale, grid);
+		unsigned char code;
+		if (scratch.stamps[cell] != scratch.stamp) {
+			scratch.stamps[cell] = scratch.stamp;
+			code = OWN_POINT;
+		} else {
+			code = (unsigned char)((x >= middle.x ? 1 : 0) | (y >= middle.y ? 2 : 0) | (z >= middle.z ? 4 : 0));
+		}
+		scratch.codes[k] = code;
+		counts[code]++;
+	}
+
+	//稳定分组：代表点在前，其后依次为8个卦限
+	size_t offsets[OWN_POINT + 1];
+	offsets[OWN_POINT] = 0;
+	size_t position = counts[OWN_POINT];
+	for (int c = 0; c < 8; c++) {
+		offsets[c] = position;
+		position += counts[c];
+	}
+	for (size_t k = 0; k < count; k++) {
+		scratch.buffer[offsets[scratch.codes[k]]++] = order[k];
+	}
+	std::copy(scratch.buffer.begin(), scratch.buffer.begin() + count, order);
+
+	node.count = counts[OWN_POINT];
+	size_t begin = task.begin + node.count;
+	for (int c = 0; c < 8; c++) {
+		if (counts[c] == 0) {
+			continue;
+		}
+		OctreeNode child;
+		child.lower = Point3f(node.lower.x + (c & 1 ? half : 0), node.lower.y + (c & 2 ? half : 0), node.lower.z + (c & 4 ? half : 0));
+		child.size = half;
+		child.spacing = half / grid;
+		child.level = node.level + 1;
+		for (int g = 0; g < 8; g++) {
+			child.children[g] = -1;
+		}
+		child.first = begin;
+		child.count = counts[c];
+		child.totalCount = counts[c];
+
+		Task childTask;
+		childTask.node = (int)nodes.size();
+		childTask.begin = begin;
+		childTask.end = begin + counts[c];
+		node.children[c] = childTask.node;
+		nodes.push_back(child);
+		children.push_back(childTask);
+		begin += counts[c];
+	}
+	nodes[task.node] = node;
+}
+
+size_t PointsOctree::Select(const LodView& view, const LodConfig& config, std::vector<int>& nodes, CullStats* stats) const
+{
+	nodes.clear();
+	CullStats cull;
+	if (mNodes.empty()) {
+		if (stats != NULL) {
+			*stats = cull;
+		}
+		return 0;
+	}
+
+	Frustum frustum;
+	frustum.Extract(view.projection, view.modelview);
+
+	//按投影误差从大到小细化，误差大的通常是离相机近的节点
+	float projScale = view.projection(1, 1) * view.viewportHeight / 2;
+	std::priority_queue<Candidate> queue;
+	Candidate root = { ProjectedSpacing(mNodes[0], view, projScale), 0, !config.frustumCulling };
+	queue.push(root);
+	while (!queue.empty()) {
+		Candidate candidate = queue.top();
+		queue.pop();
+
+		const OctreeNode& node = mNodes[candidate.node];
+		if (!candidate.inside) {
+			cull.testedBoxes++;
+			Point3f upper(node.lower.x + node.size, node.lower.y + node.size, node.lower.z + node.size);
+			FrustumTest test = frustum.TestBox(node.lower, upper);
+			if (test == FRUSTUM_OUTSIDE) {
+				cull.culledChunks++;
+				cull.culledPoints += node.count;
+				continue;
+			}
+			candidate.inside = test == FRUSTUM_INSIDE;
+		}
+
+		if (!nodes.empty() && cull.submittedPoints + node.count > config.pointBudget) {
+			break;
+		}
+		nodes.push_back(candidate.node);
+		cull.visibleChunks++;
+		cull.submittedPoints += node.count;
+
+		if (candidate.error > config.errorThreshold) {
+			for (int c = 0; c < 8; c++) {
+				if (node.children[c] >= 0) {
+					Candidate child = { ProjectedSpacing(mNodes[node.children[c]], view, projScale), node.children[c], candidate.inside };
+					queue.push(child);
+				}
+			}
+		}
+	}
+	if (stats != NULL) {
+		*stats = cull;
+	}
+	return cull.submittedPoints;
+}
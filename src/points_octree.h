@@ -0,0 +1,110 @@
+﻿#pragma once
+
+#include "points_cloud.h"
+#include "frustum.h"
+#include <stdint.h>
+#include <vector>
+
+#define DEFAULT_NODE_CAPACITY	8192
+#define DEFAULT_SAMPLE_GRID		64
+#define DEFAULT_MAX_DEPTH		20
+#define DEFAULT_POINT_BUDGET	(2 * 1000 * 1000)
+#define DEFAULT_LOD_ERROR		1.0f
+
+/* 八叉树构建参数 */
+struct OctreeConfig {
+	size_t nodeCapacity;		//点数不超过该值的节点不再细分
+	int sampleGrid;				//每个节点在各轴上划分的采样格数，每格保留一个代表点
+	int maxDepth;
+
+	OctreeConfig() : nodeCapacity(DEFAULT_NODE_CAPACITY), sampleGrid(DEFAULT_SAMPLE_GRID), maxDepth(DEFAULT_MAX_DEPTH) {}
+};
+
+/* 细节层次选择参数 */
+struct LodConfig {
+	size_t pointBudget;			//每帧最多提交的点数
+	float errorThreshold;		//节点采样间距投影到屏幕上小于该像素数时不再细化
+	bool frustumCulling;		//跳过视锥外的节点及其子树
+
+	LodConfig() : pointBudget(DEFAULT_POINT_BUDGET), errorThreshold(DEFAULT_LOD_ERROR), frustumCulling(true) {}
+};
+
+/* 相机参数，矩阵均为行主序 */
+struct LodView {
+	cv::Matx44f modelview;
+	cv::Matx44f projection;
+	int viewportHeight;
+};
+
+/**
+  * 八叉树节点，节点自身的代表点为order[first]到order[first + count - 1]，
+  * 子树的全部点紧随其后连续存放
+  */
+struct OctreeNode {
+	cv::Point3f lower;			//立方体下边界
+	float size;					//立方体边长
+	float spacing;				//代表点的采样间距
+	int level;
+	int children[8];			//不存在为-1
+	size_t first;
+	size_t count;
+	size_t totalCount;			//子树点数
+};
+
+/**
+  * 基于点云边界的八叉树，每个节点按采样格保留一组在空间上均匀分布的代表点，
+  * 其余点下放到子节点。绘制根节点到任意深度的节点时点密度逐级加密，每个点只属于一个节点
+  */
+class PointsOctree {
+public:
+	/**
+	  * 构建八叉树，点云需已更新边界，点数不超过2^32
+	  * @param[in] cloud 点云
+	  * @param[in] config 构建参数
+	  */
+	void Build(const PointsCloud& cloud, const OctreeConfig& config);
+
+	void Clear();
+	bool Empty() const { return mNodes.empty(); }
+
+	const std::vector<OctreeNode>& Nodes() const { return mNodes; }
+	const std::vector<uint32_t>& Order() const { return mOrder; }
+
+	/**
+	  * 由近及远遍历八叉树，选出需要绘制的节点，
+	  * 投影误差大的节点优先细化，达到点数预算或误差低于阈值时停止。
+	  * 开启剔除时视锥外的节点连同子树一起跳过，完全在视锥内的节点其子树不再判断
+	  * @param[in] view 相机参数
+	  * @param[in] config 细节层次参数
+	  * @param[out] nodes 选中的节点，按优先级排列
+	  * @param[out] stats 剔除统计，culledPoints为被剔除的候选节点自身的点数，可为NULL
+	  * @return 选中的点数
+	  */
+	size_t Select(const LodView& view, const LodConfig& config, std::vector<int>& nodes, CullStats* stats = NULL) const;
+
+private:
+	/* 待细分的节点及其点在order中的范围 */
+	struct Task {
+		int node;
+		size_t begin;
+		size_t end;
+	};
+
+	/* 单个线程细分节点时使用的临时空间 */
+	struct Scratch {
+		std::vector<uint32_t> buffer;
+		std::vector<unsigned char> codes;
+		std::vector<uint32_t> stamps;	//采样格最近一次被占用时的标记
+		uint32_t stamp;
+
+		Scratch() : stamp(0) {}
+	};
+
+	void BuildSubtree(const PointsCloud& cloud, const OctreeConfig& config, const Task& root,
+		std::vector<OctreeNode>& nodes, Scratch& scratch);
+	void SplitNode(const PointsCloud& cloud, const OctreeConfig& config, const Task& task,
+		std::vector<OctreeNode>& nodes, std::vector<Task>& children, Scratch& scratch);
+
+	std::vector<OctreeNode> mNodes;
+	std::vector<uint32_t> mOrder;
+};
@@ -0,0 +1,138 @@
+﻿#include "redraw_scheduler.h"
+#include "trace.h"
+#include "opencv2/core/utility.hpp"
+#include <stdio.h>
+
+using namespace cv;
+
+RedrawScheduler::RedrawScheduler()
+	: mLastActiveTick(0), mStatsTick(getTickCount()), mWakeups(0)
+{
+}
+
+int RedrawScheduler::AddView(const std::string& name, PresentFunc present, double targetFps)
+{
+	View view;
+	view.name = name;
+	view.present = present;
+	view.pacer.SetTargetFps(targetFps);
+	view.wakeTick = 0;
+	mViews.push_back(view);
+	mPosted.push_back(0);
+	return (int)mViews.size() - 1;
+}
+
+void RedrawScheduler::Wake(int view, int64 tick)
+{
+	if (mViews[view].wakeTick == 0) {
+		mViews[view].wakeTick = tick;
+	}
+	mLastActiveTick = MAX(mLastActiveTick, tick);
+}
+
+void RedrawScheduler::OnEvent(int view, bool changed)
+{
+	if (view < 0) {
+		return;
+	}
+	int64 now = getTickCount();
+	mViews[view].pacer.OnEvent(changed);
+	mLastActiveTick = now;
+	if (changed) {
+		Wake(view, now);
+	}
+}
+
+void RedrawScheduler::Invalidate(int view)
+{
+	if (view < 0) {
+		return;
+	}
+	mViews[view].pacer.Invalidate();
+	Wake(view, getTickCount());
+}
+
+void RedrawScheduler::Post(int view)
+{
+	if (view < 0) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(mPostMutex);
+	if (mPosted[view] == 0) {
+		mPosted[view] = getTickCount();
+	}
+}
+
+int RedrawScheduler::Dispatch()
+{
+	TRACE_SCOPE("RedrawScheduler::Dispatch");
+	{
+		std::lock_guard<std::mutex> lock(mPostMutex);
+		for (size_t i = 0; i < mPosted.size(); i++) {
+			if (mPosted[i] != 0) {
+				mViews[i].pacer.Invalidate();
+				Wake((int)i, mPosted[i]);
+				mPosted[i] = 0;
+			}
+		}
+	}
+
+	int presented = 0;
+	for (size_t i = 0; i < mViews.size(); i++) {
+		View& view = mViews[i];
+		if (!view.pacer.ShouldPresent()) {
+			continue;
+		}
+		view.present();
+		int64 now = getTickCount();
+		if (view.wakeTick != 0) {
+			view.latency.Add((now - view.wakeTick) * 1000 / getTickFrequency());
+		}
+		view.wakeTick = 0;
+		mLastActiveTick = now;
+		presented++;
+	}
+	return presented;
+}
+
+int RedrawScheduler::WaitMs()
+{
+	mWakeups++;
+
+	//刚有过活动时按帧间隔唤醒，以便及时发现后台线程的通知与推迟的重绘；否则长时间休眠
+	int64 now = getTickCount();
+	int wait = IDLE_WAIT_MS;
+	for (size_t i = 0; i < mViews.size(); i++) {
+		if ((now - mLastActiveTick) * 1000 < ACTIVE_PERIOD_MS * getTickFrequency()) {
+			wait = MIN(wait, (int)(1000 / mViews[i].pacer.TargetFps()));
+		}
+		int viewWait = mViews[i].pacer.WaitMs();
+		if (viewWait >= 0) {
+			wait = MIN(wait, viewWait);
+		}
+	}
+	//waitKey(0)会一直等待按键
+	return MAX(wait, 1);
+}
+
+void RedrawScheduler::ResetStats()
+{
+	for (size_t i = 0; i < mViews.size(); i++) {
+		mViews[i].pacer.ResetStats();
+		mViews[i].latency.Reset();
+	}
+	mWakeups = 0;
+	mStatsTick = getTickCount();
+}
+
+void RedrawScheduler::PrintStats() const
+{
+	double seconds = (getTickCount() - mStatsTick) / getTickFrequency();
+	printf("main loop wakeups %zu in %.1f s (%.1f/s)\n", mWakeups, seconds, mWakeups / MAX(seconds, 1e-3));
+	for (size_t i = 0; i < mViews.size(); i++) {
+		const View& view = mViews[i];
+		printf("%-16s ", view.name.c_str());
+		view.pacer.PrintStats();
+		view.latency.Print("  wake to present");
+	}
+}
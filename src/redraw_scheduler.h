@@ -0,0 +1,82 @@
+﻿#pragma once
+
+#include "frame_pacer.h"
+#include "latency_stats.h"
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define ACTIVE_PERIOD_MS		500		//最后一次活动后仍按帧间隔唤醒的时长
+#define IDLE_WAIT_MS			100		//空闲时的最长等待，用于发现后台线程的通知
+
+/**
+  * 按需重绘的调度器，代替主循环的固定间隔轮询。
+  * 每个窗口注册为一个视图，输入回调、按键与后台线程只标记视图需要重绘，
+  * Dispatch按各自的帧间隔合并为一次重绘，没有待重绘的视图时主循环长时间休眠。
+  * 记录从第一次标记到重绘完成的延迟
+  */
+class RedrawScheduler {
+public:
+	typedef std::function<void()> PresentFunc;
+
+	RedrawScheduler();
+
+	/**
+	  * 注册视图，需在后台线程开始通知之前调用
+	  * @param[in] name 视图名称，用于打印统计
+	  * @param[in] present 重绘函数，在主线程调用
+	  * @return 视图序号
+	  */
+	int AddView(const std::string& name, PresentFunc present, double targetFps = DEFAULT_TARGET_FPS);
+
+	FramePacer& Pacer(int view) { return mViews[view].pacer; }
+
+	/**
+	  * 记录视图的输入事件，只能在主线程调用，view小于0时忽略
+	  * @param[in] changed 事件是否改变了需要绘制的状态
+	  */
+	void OnEvent(int view, bool changed);
+
+	/**
+	  * 非交互的状态变化，只能在主线程调用
+	  */
+	void Invalidate(int view);
+
+	/**
+	  * 后台工作完成后的通知，可在任意线程调用
+	  */
+	void Post(int view);
+
+	/**
+	  * 重绘已到帧间隔的视图
+	  * @return 重绘的视图数
+	  */
+	int Dispatch();
+
+	/**
+	  * 下次需要唤醒的毫秒数，作为waitKey的参数
+	  */
+	int WaitMs();
+
+	void ResetStats();
+	void PrintStats() const;
+
+private:
+	struct View {
+		std::string name;
+		PresentFunc present;
+		FramePacer pacer;
+		int64 wakeTick;					//第一次标记需要重绘的时刻，0为没有待重绘
+		LatencyHistogram latency;		//每次重绘的延迟
+	};
+
+	void Wake(int view, int64 tick);
+
+	std::vector<View> mViews;
+	std::mutex mPostMutex;
+	std::vector<int64> mPosted;			//后台线程通知的时刻，0为没有通知
+	int64 mLastActiveTick;
+	int64 mStatsTick;
+	size_t mWakeups;					//主循环被唤醒的次数
+};
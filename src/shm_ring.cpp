@@ -0,0 +1,303 @@
+﻿#include "shm_ring.h"
+#include "cloud_stats.h"
+#include "opencv2/core/utility.hpp"
+#include <new>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define SHM_SLOT_HEADER_BYTES	64
+
+static uint64_t AlignUp(uint64_t value)
+{
+	return (value + SHM_RING_ALIGNMENT - 1) / SHM_RING_ALIGNMENT * SHM_RING_ALIGNMENT;
+}
+
+static uint64_t ColumnBytes(uint64_t capacity)
+{
+	return AlignUp(capacity * sizeof(float));
+}
+
+/* 映射的共享内存，析构时解除映射 */
+struct ShmRing::Mapping {
+	char* data;
+	size_t size;
+#ifdef _WIN32
+	HANDLE handle;
+
+	Mapping() : data(NULL), size(0), handle(NULL) {}
+	~Mapping()
+	{
+		if (data != NULL) {
+			UnmapViewOfFile(data);
+		}
+		if (handle != NULL) {
+			CloseHandle(handle);
+		}
+	}
+#else
+	Mapping() : data(NULL), size(0) {}
+	~Mapping()
+	{
+		if (data != NULL) {
+			munmap(data, size);
+		}
+	}
+#endif
+};
+
+#ifdef _WIN32
+static std::string ShmName(const std::string& name)
+{
+	return "Local\\" + name;
+}
+#else
+static std::string ShmName(const std::string& name)
+{
+	return "/" + name;
+}
+#endif
+
+ShmRing::ShmRing()
+	: mHeader(NULL), mLastFrame(0), mOwner(false)
+{
+}
+
+ShmRing::~ShmRing()
+{
+	Close();
+}
+
+bool ShmRing::Create(const std::string& name, uint32_t slotCount, uint64_t slotCapacity)
+{
+	Close();
+	slotCount = MAX(slotCount, 3u);
+	uint64_t headerBytes = AlignUp(sizeof(ShmRingHeader));
+	uint64_t slotBytes = SHM_SLOT_HEADER_BYTES + ColumnBytes(slotCapacity) * SHM_COLUMN_COUNT;
+	uint64_t size = headerBytes + slotBytes * slotCount;
+
+	std::shared_ptr<Mapping> mapping(new Mapping());
+	mapping->size = (size_t)size;
+#ifdef _WIN32
+	mapping->handle = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, (DWORD)(size >> 32),
+		(DWORD)size, ShmName(name).c_str());
+	if (mapping->handle == NULL) {
+		return false;
+	}
+	mapping->data = (char*)MapViewOfFile(mapping->handle, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+#else
+	shm_unlink(ShmName(name).c_str());
+	int fd = shm_open(ShmName(name).c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+	if (fd < 0) {
+		return false;
+	}
+	if (ftruncate(fd, (off_t)size) != 0) {
+		close(fd);
+		shm_unlink(ShmName(name).c_str());
+		return false;
+	}
+	void* data = mmap(NULL, mapping->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	mapping->data = data == MAP_FAILED ? NULL : (char*)data;
+#endif
+	if (mapping->data == NULL) {
+		return false;
+	}
+
+	//先初始化各槽，最后写入magic，读端看到magic时布局已完整
+	ShmRingHeader* header = new (mapping->data) ShmRingHeader();
+	header->version = SHM_RING_VERSION;
+	header->slotCount = slotCount;
+	header->headerBytes = (uint32_t)headerBytes;
+	header->slotCapacity = slotCapacity;
+	header->slotBytes = slotBytes;
+	header->published.store(0);
+	header->publishedSlot.store(0);
+	header->pinnedSlot.store(0);
+	mMapping = mapping;
+	mHeader = header;
+	for (uint32_t i = 0; i < slotCount; i++) {
+		ShmSlotHeader* slot = new (Slot(i)) ShmSlotHeader();
+		slot->sequence.store(0);
+		slot->pointCount = 0;
+		slot->publishTick = 0;
+	}
+	std::atomic_thread_fence(std::memory_order_release);
+	header->magic = SHM_RING_MAGIC;
+
+	mOwner = true;
+	mName = name;
+	return true;
+}
+
+bool ShmRing::Open(const std::string& name)
+{
+	Close();
+	std::shared_ptr<Mapping> mapping(new Mapping());
+#ifdef _WIN32
+	mapping->handle = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, ShmName(name).c_str());
+	if (mapping->handle == NULL) {
+		return false;
+	}
+	mapping->data = (char*)MapViewOfFile(mapping->handle, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+	MEMORY_BASIC_INFORMATION info;
+	if (mapping->data == NULL || VirtualQuery(mapping->data, &info, sizeof(info)) == 0) {
+		return false;
+	}
+	mapping->size = info.RegionSize;
+#else
+	int fd = shm_open(ShmName(name).c_str(), O_RDWR, 0600);
+	if (fd < 0) {
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ShmRingHeader)) {
+		close(fd);
+		return false;
+	}
+	mapping->size = (size_t)st.st_size;
+	void* data = mmap(NULL, mapping->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	mapping->data = data == MAP_FAILED ? NULL : (char*)data;
+#endif
+	if (mapping->data == NULL) {
+		return false;
+	}
+
+	ShmRingHeader* header = (ShmRingHeader*)mapping->data;
+	if (header->magic != SHM_RING_MAGIC || header->version != SHM_RING_VERSION
+		|| header->headerBytes + header->slotBytes * header->slotCount > mapping->size) {
+		return false;
+	}
+	std::atomic_thread_fence(std::memory_order_acquire);
+
+	mMapping = mapping;
+	mHeader = header;
+	mLastFrame = 0;
+	mOwner = false;
+	mName = name;
+	return true;
+}
+
+void ShmRing::Close()
+{
+	if (mHeader != NULL && !mOwner) {
+		mHeader->pinnedSlot.store(0);
+	}
+#ifndef _WIN32
+	if (mOwner) {
+		shm_unlink(ShmName(mName).c_str());
+	}
+#endif
+	//点云仍引用各列时映射由点云持有，最后一个引用释放时解除映射
+	mMapping.reset();
+	mHeader = NULL;
+	mOwner = false;
+	mName.clear();
+}
+
+ShmSlotHeader* ShmRing::Slot(uint32_t slot) const
+{
+	return (ShmSlotHeader*)(mMapping->data + mHeader->headerBytes + mHeader->slotBytes * slot);
+}
+
+float* ShmRing::Column(uint32_t slot, int column) const
+{
+	return (float*)((char*)Slot(slot) + SHM_SLOT_HEADER_BYTES + ColumnBytes(mHeader->slotCapacity) * column);
+}
+
+ShmFrame ShmRing::BeginWrite()
+{
+	uint64_t frame = mHeader->published.load() + 1;
+	uint32_t last = mHeader->publishedSlot.load();
+
+	//先标记写入中再检查读端是否持有，与读端先持有再检查sequence配对，两者至少有一方能看到对方
+	ShmFrame result;
+	result.slot = (last + 1) % mHeader->slotCount;
+	for (uint32_t k = 1; k <= mHeader->slotCount; k++) {
+		uint32_t slot = (last + k) % mHeader->slotCount;
+		ShmSlotHeader* header = Slot(slot);
+		uint64_t previous = header->sequence.load();
+		header->sequence.store(frame * 2 + 1);
+		if (mHeader->pinnedSlot.load() == slot + 1) {
+			header->sequence.store(previous);
+			continue;
+		}
+		result.slot = slot;
+		break;
+	}
+	result.frame = frame;
+	result.x = Column(result.slot, 0);
+	result.y = Column(result.slot, 1);
+	result.z = Column(result.slot, 2);
+	result.intensity = Column(result.slot, 3);
+	result.capacity = (size_t)mHeader->slotCapacity;
+	return result;
+}
+
+void ShmRing::EndWrite(const ShmFrame& frame, size_t count)
+{
+	ShmSlotHeader* header = Slot(frame.slot);
+	count = MIN(count, frame.capacity);
+	CloudStats stats;
+	stats.Accumulate(frame.x, frame.y, frame.z, NULL, count);
+	cv::Point3f lower = stats.Lower(), upper = stats.Upper();
+	header->lower[0] = lower.x;
+	header->lower[1] = lower.y;
+	header->lower[2] = lower.z;
+	header->upper[0] = upper.x;
+	header->upper[1] = upper.y;
+	header->upper[2] = upper.z;
+	header->pointCount = count;
+	header->publishTick = cv::getTickCount();
+	header->sequence.store(frame.frame * 2, std::memory_order_release);
+	mHeader->publishedSlot.store(frame.slot);
+	mHeader->published.store(frame.frame, std::memory_order_release);
+}
+
+bool ShmRing::Acquire(PointsCloud& cloud, uint64_t* frame, int64_t* publishTick)
+{
+	if (mHeader == NULL) {
+		return false;
+	}
+
+	while (true) {
+		uint64_t published = mHeader->published.load(std::memory_order_acquire);
+		if (published == 0 || published == mLastFrame) {
+			return false;
+		}
+		//持有后再确认槽没有在写入中，否则写端已经绕回该槽，重新读取最新的帧
+		uint32_t slot = mHeader->publishedSlot.load();
+		mHeader->pinnedSlot.store(slot + 1);
+		ShmSlotHeader* header = Slot(slot);
+		uint64_t sequence = header->sequence.load();
+		if ((sequence & 1) || sequence / 2 <= mLastFrame) {
+			continue;
+		}
+
+		size_t count = (size_t)header->pointCount;
+		cloud.Reset();
+		cloud.x.Borrow(Column(slot, 0), count, mMapping);
+		cloud.y.Borrow(Column(slot, 1), count, mMapping);
+		cloud.z.Borrow(Column(slot, 2), count, mMapping);
+		cloud.intensity.Borrow(Column(slot, 3), count, mMapping);
+		cloud.lowerBoundary = cv::Point3f(header->lower[0], header->lower[1], header->lower[2]);
+		cloud.upperBoundary = cv::Point3f(header->upper[0], header->upper[1], header->upper[2]);
+		cloud.UpdateCenter();
+
+		mLastFrame = sequence / 2;
+		if (frame != NULL) {
+			*frame = mLastFrame;
+		}
+		if (publishTick != NULL) {
+			*publishTick = header->publishTick;
+		}
+		return true;
+	}
+}
@@ -0,0 +1,122 @@
+﻿#pragma once
+
+#include "points_cloud.h"
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+#include <string>
+
+#define SHM_RING_MAGIC			0x5253564F		//"OVSR"
+#define SHM_RING_VERSION		1
+#define SHM_RING_ALIGNMENT		64
+#define DEFAULT_SHM_SLOTS		4
+#define SHM_COLUMN_COUNT		4				//x、y、z、intensity
+
+/*
+ * 共享内存布局，所有偏移均为SHM_RING_ALIGNMENT的倍数：
+ *
+ *   [ShmRingHeader，填充到headerBytes]
+ *   [槽0][槽1]...[槽slotCount-1]，每个槽slotBytes字节：
+ *       [ShmSlotHeader，填充到64字节]
+ *       [x: slotCapacity个float，填充到64字节倍数]
+ *       [y][z][intensity]，与x相同
+ *
+ * 写端(生产者)每次选一个未被读端持有的槽写入，写入期间槽的sequence为奇数，
+ * 写完后sequence = 帧号 * 2，再更新头部的publishedSlot与published。
+ * 读端(唯一)把持有的槽号+1写入pinnedSlot后重新检查sequence，为偶数则该槽在重新持有其他槽之前不会被覆盖，
+ * 各列直接引用共享内存，不拷贝。写端至少需要3个槽才能在读端持有一个槽时不阻塞
+ */
+
+/* 共享内存头部 */
+struct ShmRingHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t slotCount;
+	uint32_t headerBytes;			//槽0的偏移
+	uint64_t slotCapacity;			//每个槽最多的点数
+	uint64_t slotBytes;				//相邻两个槽的间隔
+	std::atomic<uint64_t> published;		//最新发布的帧号，从1开始，0为尚未发布
+	std::atomic<uint32_t> publishedSlot;	//最新发布的帧所在的槽
+	std::atomic<uint32_t> pinnedSlot;		//读端持有的槽号+1，0为未持有
+};
+
+/* 每个槽的头部 */
+struct ShmSlotHeader {
+	std::atomic<uint64_t> sequence;	//写入中为奇数，写完为帧号*2
+	uint64_t pointCount;
+	int64_t publishTick;			//发布时刻，cv::getTickCount()，同一台机器上跨进程可比较
+	float lower[3];					//点云边界，由写端计算
+	float upper[3];
+};
+
+/* 写端正在填写的一帧 */
+struct ShmFrame {
+	uint32_t slot;
+	uint64_t frame;
+	float* x;
+	float* y;
+	float* z;
+	float* intensity;
+	size_t capacity;
+};
+
+/**
+  * 共享内存点云环形缓冲，POSIX为shm_open/mmap，Windows为命名文件映射。
+  * 写端Create后逐帧BeginWrite/EndWrite，读端Open后轮询Acquire取最新一帧
+  */
+class ShmRing {
+public:
+	ShmRing();
+	~ShmRing();
+
+	/**
+	  * 写端创建共享内存，同名的旧共享内存会被替换
+	  * @param[in] name 名称，不含'/'
+	  * @param[in] slotCount 槽数，至少为3
+	  * @param[in] slotCapacity 每帧最多的点数
+	  */
+	bool Create(const std::string& name, uint32_t slotCount, uint64_t slotCapacity);
+
+	/**
+	  * 读端打开已创建的共享内存
+	  * @return 不存在或布局版本不一致时返回false
+	  */
+	bool Open(const std::string& name);
+	void Close();
+
+	bool IsOpen() const { return mHeader != NULL; }
+	const ShmRingHeader* Header() const { return mHeader; }
+
+	/**
+	  * 写端取一个未被读端持有的槽，直接在共享内存中填写各列
+	  */
+	ShmFrame BeginWrite();
+
+	/**
+	  * 写端完成一帧并发布，边界由各列计算
+	  * @param[in] frame BeginWrite返回的帧
+	  * @param[in] count 点数，不超过capacity
+	  */
+	void EndWrite(const ShmFrame& frame, size_t count);
+
+	/**
+	  * 读端持有最新发布的一帧，cloud的各列直接引用共享内存，在下次Acquire或Close前有效
+	  * @param[out] cloud 点云，包含边界与中心点
+	  * @param[out] frame 可选，帧号
+	  * @param[out] publishTick 可选，发布时刻
+	  * @return 没有比上次更新的帧时返回false，cloud不变
+	  */
+	bool Acquire(PointsCloud& cloud, uint64_t* frame = NULL, int64_t* publishTick = NULL);
+
+private:
+	struct Mapping;
+
+	ShmSlotHeader* Slot(uint32_t slot) const;
+	float* Column(uint32_t slot, int column) const;
+
+	std::shared_ptr<Mapping> mMapping;	//同时作为点云各列引用的持有者
+	ShmRingHeader* mHeader;
+	uint64_t mLastFrame;
+	bool mOwner;
+	std::string mName;
+};
@@ -0,0 +1,9 @@
+﻿#pragma once
+
+#include "opencv2/core.hpp"
+
+//OpenCV 3.4.0在库外部包含intrin.hpp时缺少CV_CPU_HAS_SUPPORT_SSE2
+#if CV_SSE2 && !defined CV_CPU_HAS_SUPPORT_SSE2
+#define CV_CPU_HAS_SUPPORT_SSE2 1
+#endif
+#include "opencv2/core/hal/intrin.hpp"
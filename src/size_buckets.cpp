@@ -0,0 +1,103 @@
+﻿#include "size_buckets.h"
+#include "opencv2/core/utility.hpp"
+#include <cmath>
+
+#define MIN_POINT_SIZE			0.01f
+#define MIN_CHUNK_POINTS		(64 * 1024)
+
+using namespace cv;
+
+namespace {
+
+inline float MapSize(float size, SizeMapping mapping)
+{
+	size = MAX(size, MIN_POINT_SIZE);
+	return mapping == SIZE_MAPPING_LOG ? std::log(size) : size;
+}
+
+inline float UnmapSize(float value, SizeMapping mapping)
+{
+	return mapping == SIZE_MAPPING_LOG ? std::exp(value) : value;
+}
+
+}
+
+void BuildSizeBuckets(const PointsCloud& cloud, const SizeBucketConfig& config, SizeBuckets& buckets)
+{
+	int bucketCount = MIN(MAX(config.bucketCount, 1), MAX_SIZE_BUCKETS);
+	SizeMapping mapping = config.mapping;
+	size_t count = cloud.Size();
+	const float* intensity = cloud.intensity.data();
+
+	//映射空间中的尺寸范围
+	float lower = 0, upper = 0;
+	if (!ColumnMinMax(intensity, count, lower, upper)) {
+		lower = upper = 0;
+	}
+	float mappedLower = MapSize(lower * config.intensityScale, mapping);
+	float mappedUpper = MapSize(upper * config.intensityScale, mapping);
+	float bucketWidth = (mappedUpper - mappedLower) / bucketCount;
+	float invWidth = bucketWidth > 0 ? 1 / bucketWidth : 0;
+
+	buckets.sizes.resize(bucketCount);
+	for (int b = 0; b < bucketCount; b++) {
+		buckets.sizes[b] = UnmapSize(mappedLower + bucketWidth * (b + 0.5f), mapping);
+	}
+
+	//各块分别统计直方图，按块序累加出每块在每个桶中的写入位置，保证桶内点序稳定
+	int chunkCount = (int)MIN((size_t)MAX(getNumThreads(), 1) * 4, count / MIN_CHUNK_POINTS + 1);
+	size_t chunkSize = (count + chunkCount - 1) / chunkCount;
+	std::vector<unsigned short> ids(count);
+	std::vector<size_t> histograms((size_t)chunkCount * bucketCount, 0);
+
+	parallel_for_(Range(0, chunkCount), [&](const Range& range) {
+		for (int c = range.start; c < range.end; c++) {
+			size_t* histogram = &histograms[(size_t)c * bucketCount];
+			size_t end = MIN(count, (c + 1) * chunkSize);
+			for (size_t i = c * chunkSize; i < end; i++) {
+				float value = (MapSize(intensity[i] * config.intensityScale, mapping) - mappedLower) * invWidth;
+				//nan及超出范围的值归入两端的桶
+				int b = value > 0 ? (int)value : 0;
+				b = MIN(b, bucketCount - 1);
+				ids[i] = (unsigned short)b;
+				histogram[b]++;
+			}
+		}
+	}, chunkCount);
+
+	buckets.offsets.assign(bucketCount + 1, 0);
+	size_t position = 0;
+	for (int b = 0; b < bucketCount; b++) {
+		buckets.offsets[b] = position;
+		for (int c = 0; c < chunkCount; c++) {
+			size_t& slot = histograms[(size_t)c * bucketCount + b];
+			size_t bucketPoints = slot;
+			slot = position;
+			position += bucketPoints;
+		}
+	}
+	buckets.offsets[bucketCount] = position;
+
+	buckets.order.resize(count);
+	parallel_for_(Range(0, chunkCount), [&](const Range& range) {
+		for (int c = range.start; c < range.end; c++) {
+			size_t* cursor = &histograms[(size_t)c * bucketCount];
+			size_t end = MIN(count, (c + 1) * chunkSize);
+			for (size_t i = c * chunkSize; i < end; i++) {
+				buckets.order[cursor[ids[i]]++] = (uint32_t)i;
+			}
+		}
+	}, chunkCount);
+}
+
+void BucketIds(const SizeBuckets& buckets, std::vector<unsigned short>& ids)
+{
+	ids.resize(buckets.order.size());
+	parallel_for_(Range(0, buckets.BucketCount()), [&](const Range& range) {
+		for (int b = range.start; b < range.end; b++) {
+			for (size_t k = buckets.offsets[b]; k < buckets.offsets[b + 1]; k++) {
+				ids[buckets.order[k]] = (unsigned short)b;
+			}
+		}
+	});
+}
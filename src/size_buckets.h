@@ -0,0 +1,53 @@
+﻿#pragma once
+
+#include "points_cloud.h"
+#include <stdint.h>
+#include <vector>
+
+#define DEFAULT_SIZE_BUCKETS	16
+#define MAX_SIZE_BUCKETS		1024
+
+/* 点尺寸到分桶的映射方式 */
+enum SizeMapping {
+	SIZE_MAPPING_LINEAR = 0,	//尺寸范围均匀划分
+	SIZE_MAPPING_LOG = 1,		//尺寸取对数后均匀划分，小尺寸的桶更细
+	SIZE_MAPPING_COUNT
+};
+
+/* 分桶配置 */
+struct SizeBucketConfig {
+	int bucketCount;
+	SizeMapping mapping;
+	float intensityScale;		//点尺寸 = 强度 * intensityScale
+
+	SizeBucketConfig() : bucketCount(DEFAULT_SIZE_BUCKETS), mapping(SIZE_MAPPING_LINEAR), intensityScale(0.01f) {}
+};
+
+/**
+  * 按点尺寸分桶后的点序，第b桶的点为order[offsets[b]]到order[offsets[b + 1] - 1]，
+  * 桶内保持原有点序
+  */
+struct SizeBuckets {
+	std::vector<float> sizes;		//每个桶的代表尺寸
+	std::vector<size_t> offsets;	//共bucketCount + 1个
+	std::vector<uint32_t> order;
+
+	int BucketCount() const { return (int)sizes.size(); }
+	size_t BucketSize(int b) const { return offsets[b + 1] - offsets[b]; }
+};
+
+/**
+  * 将强度量化为有限个尺寸桶并按桶对点序做稳定的并行计数排序，只需在点云变化时执行一次。
+  * 未开启点平滑时OpenGL按取整后的像素尺寸光栅化，桶宽不超过1像素时与逐点设置尺寸的效果基本一致
+  * @param[in] cloud 点云
+  * @param[in] config 分桶配置
+  * @param[out] buckets 分桶结果
+  */
+void BuildSizeBuckets(const PointsCloud& cloud, const SizeBucketConfig& config, SizeBuckets& buckets);
+
+/**
+  * 由分桶结果得到每个点所在的桶
+  * @param[in] buckets 分桶结果
+  * @param[out] ids 每个点的桶序号
+  */
+void BucketIds(const SizeBuckets& buckets, std::vector<unsigned short>& ids);
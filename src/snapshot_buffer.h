@@ -0,0 +1,43 @@
+﻿#pragma once
+
+#include <atomic>
+#include <mutex>
+
+/**
+  * 双缓冲快照：界面线程修改自己的状态后发布一份拷贝，绘制线程读取最新发布的拷贝，
+  * 两者不共用可变状态。写端写入后备槽再切换前台槽，只有写端连续发布两次而读端仍在拷贝时才会等待，
+  * 每个槽一把锁，不同视图之间没有共享的锁
+  */
+template <typename T>
+class SnapshotBuffer {
+public:
+	SnapshotBuffer() : mFront(0) {}
+
+	/**
+	  * 发布新的状态，只能由一个线程调用
+	  */
+	void Publish(const T& value)
+	{
+		int back = 1 - mFront.load(std::memory_order_relaxed);
+		{
+			std::lock_guard<std::mutex> lock(mLocks[back]);
+			mSlots[back] = value;
+		}
+		mFront.store(back, std::memory_order_release);
+	}
+
+	/**
+	  * 读取最新发布的状态，可在任意线程调用
+	  */
+	T Read() const
+	{
+		int front = mFront.load(std::memory_order_acquire);
+		std::lock_guard<std::mutex> lock(mLocks[front]);
+		return mSlots[front];
+	}
+
+private:
+	T mSlots[2];
+	mutable std::mutex mLocks[2];
+	std::atomic<int> mFront;
+};
@@ -0,0 +1,147 @@
+﻿#include "splat_renderer.h"
+#include "trace.h"
+#include "opencv2/core/utility.hpp"
+#include "opencv2/imgproc.hpp"
+#include <string.h>
+
+#define SPLAT_BLOCK				(64 * 1024)
+#define EMPTY_PIXEL				UINT64_MAX
+
+using namespace cv;
+
+namespace {
+
+inline uint32_t PackColor(const Vec3b& bgr)
+{
+	return (uint32_t)bgr[0] | ((uint32_t)bgr[1] << 8) | ((uint32_t)bgr[2] << 16);
+}
+
+/**
+  * 原子地取最小值，当前值不大于value时不写入
+  */
+inline void AtomicMin(std::atomic<uint64_t>& target, uint64_t value)
+{
+	uint64_t current = target.load(std::memory_order_relaxed);
+	while (value < current && !target.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+	}
+}
+
+}
+
+void SplatRenderer::Render(const PointsCloud& cloud, const ViewCamera& camera, const SplatConfig& config, Size size,
+	Mat& image, Mat* depth)
+{
+	TRACE_SCOPE("SplatRenderer::Render");
+	int width = size.width, height = size.height;
+	size_t pixels = (size_t)width * height;
+	if (mPixels < pixels) {
+		mBuffer.reset(new std::atomic<uint64_t>[pixels]);
+		mPixels = pixels;
+	}
+	std::atomic<uint64_t>* buffer = mBuffer.get();
+	parallel_for_(Range(0, height), [&](const Range& range) {
+		for (size_t p = (size_t)range.start * width; p < (size_t)range.end * width; p++) {
+			buffer[p].store(EMPTY_PIXEL, std::memory_order_relaxed);
+		}
+	});
+
+	//强度伪彩色表，与CloudRenderer的映射一致
+	Mat lut;
+	float lower = 0, upper = 0, scale = 0;
+	uint32_t fixedColor = PackColor(Vec3b(0, 255, 0));
+	const uint32_t* rgb = NULL;
+	if (config.rgbColors) {
+		const PointField* field = cloud.FindField(RGB_FIELD_NAME);
+		rgb = field && field->ElemSize() == 4 ? (const uint32_t*)field->data.data() : NULL;
+		fixedColor = PackColor(Vec3b(255, 255, 255));
+	} else if (config.intensityColors) {
+		if (!ColumnMinMax(cloud.intensity.data(), cloud.Size(), lower, upper)) {
+			lower = upper = 0;
+		}
+		scale = upper > lower ? 255.0f / (upper - lower) : 0;
+		Mat gray(1, 256, CV_8UC1);
+		for (int v = 0; v < 256; v++) {
+			gray.at<uchar>(0, v) = (uchar)v;
+		}
+		applyColorMap(gray, lut, COLORMAP_JET);
+	}
+
+	Matx44f mvp = camera.Projection((double)width / height) * camera.Modelview();
+	size_t count = cloud.Size();
+	parallel_for_(Range(0, (int)((count + SPLAT_BLOCK - 1) / SPLAT_BLOCK)), [&](const Range& range) {
+		TRACE_SCOPE("splat points");
+		size_t end = MIN(count, (size_t)range.end * SPLAT_BLOCK);
+		for (size_t i = (size_t)range.start * SPLAT_BLOCK; i < end; i++) {
+			float x = cloud.x[i], y = cloud.y[i], z = cloud.z[i];
+			float cx = mvp(0, 0) * x + mvp(0, 1) * y + mvp(0, 2) * z + mvp(0, 3);
+			float cy = mvp(1, 0) * x + mvp(1, 1) * y + mvp(1, 2) * z + mvp(1, 3);
+			float cz = mvp(2, 0) * x + mvp(2, 1) * y + mvp(2, 2) * z + mvp(2, 3);
+			float cw = mvp(3, 0) * x + mvp(3, 1) * y + mvp(3, 2) * z + mvp(3, 3);
+			//与OpenGL一致，中心在裁剪空间外的点整个丢弃，nan在此处被过滤
+			if (!(cw > 0 && cx >= -cw && cx <= cw && cy >= -cw && cy <= cw && cz >= -cw && cz <= cw)) {
+				continue;
+			}
+
+			//窗口坐标，图像行方向与OpenGL相反
+			float inv = 1 / cw;
+			float sx = (cx * inv + 1) * 0.5f * width;
+			float sy = (1 - cy * inv) * 0.5f * height;
+			int splat = cvRound(cloud.intensity[i] * config.intensityScale);
+			splat = MIN(MAX(splat, 1), config.maxSplatSize);
+			int x0 = cvFloor(sx - splat * 0.5f + 0.5f), y0 = cvFloor(sy - splat * 0.5f + 0.5f);
+			int x1 = MIN(x0 + splat, width), y1 = MIN(y0 + splat, height);
+			x0 = MAX(x0, 0);
+			y0 = MAX(y0, 0);
+
+			//打包的0x00RRGGBB与缓冲中的颜色布局相同，蓝色在最低字节
+			uint32_t color = fixedColor;
+			if (rgb != NULL) {
+				color = rgb[i] & 0xFFFFFF;
+			} else if (config.intensityColors && !config.rgbColors) {
+				int v = cvRound((cloud.intensity[i] - lower) * scale);
+				color = PackColor(lut.at<Vec3b>(0, MIN(MAX(v, 0), 255)));
+			}
+			//正浮点数的位模式与数值同序，可直接作为深度比较
+			uint32_t depthBits;
+			memcpy(&depthBits, &cw, sizeof(depthBits));
+			uint64_t value = ((uint64_t)depthBits << 32) | color;
+			for (int row = y0; row < y1; row++) {
+				std::atomic<uint64_t>* line = buffer + (size_t)row * width;
+				for (int col = x0; col < x1; col++) {
+					AtomicMin(line[col], value);
+				}
+			}
+		}
+	});
+
+	//解析每个像素的颜色与深度
+	image.create(size, CV_8UC3);
+	if (depth != NULL) {
+		depth->create(size, CV_32FC1);
+	}
+	Vec3b background = Vec3b(saturate_cast<uchar>(config.background[0]),
+		saturate_cast<uchar>(config.background[1]), saturate_cast<uchar>(config.background[2]));
+	parallel_for_(Range(0, height), [&](const Range& range) {
+		for (int row = range.start; row < range.end; row++) {
+			const std::atomic<uint64_t>* line = buffer + (size_t)row * width;
+			Vec3b* pixel = image.ptr<Vec3b>(row);
+			float* depthRow = depth != NULL ? depth->ptr<float>(row) : NULL;
+			for (int col = 0; col < width; col++) {
+				uint64_t value = line[col].load(std::memory_order_relaxed);
+				if (value == EMPTY_PIXEL) {
+					pixel[col] = background;
+				} else {
+					pixel[col] = Vec3b((uchar)value, (uchar)(value >> 8), (uchar)(value >> 16));
+				}
+				if (depthRow != NULL) {
+					uint32_t depthBits = (uint32_t)(value >> 32);
+					float w = 0;
+					if (value != EMPTY_PIXEL) {
+						memcpy(&w, &depthBits, sizeof(w));
+					}
+					depthRow[col] = w;
+				}
+			}
+		}
+	});
+}
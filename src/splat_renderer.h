@@ -0,0 +1,46 @@
+﻿#pragma once
+
+#include "points_cloud.h"
+#include "view_camera.h"
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+
+#define MAX_SPLAT_SIZE			16
+
+/* CPU绘制参数 */
+struct SplatConfig {
+	bool intensityColors;		//按强度映射伪彩色，否则为统一绿色
+	bool rgbColors;				//使用逐点rgb字段，没有该字段时为白色，与CloudRenderer一致；优先于intensityColors
+	float intensityScale;		//点尺寸 = 强度 * intensityScale，与glPointSize一致
+	int maxSplatSize;
+	cv::Scalar background;
+
+	SplatConfig() : intensityColors(false), rgbColors(false), intensityScale(0.01f), maxSplatSize(MAX_SPLAT_SIZE), background(0, 0, 0) {}
+};
+
+/**
+  * 纯CPU的点云绘制器，不依赖OpenGL与显示设备。
+  * 点按ViewCamera投影后以强度决定边长的正方形落到图像上，各线程按点范围并行，
+  * 每个像素保存 深度 << 32 | 颜色 的64位值，用原子比较交换取最小值完成无锁深度测试
+  */
+class SplatRenderer {
+public:
+	SplatRenderer() : mPixels(0) {}
+
+	/**
+	  * 绘制一帧
+	  * @param[in] cloud 点云
+	  * @param[in] camera 相机参数
+	  * @param[in] config 绘制参数
+	  * @param[in] size 图像尺寸
+	  * @param[out] image CV_8UC3图像
+	  * @param[out] depth 可选，CV_32F相机坐标系下的深度，无点处为0
+	  */
+	void Render(const PointsCloud& cloud, const ViewCamera& camera, const SplatConfig& config, cv::Size size,
+		cv::Mat& image, cv::Mat* depth = NULL);
+
+private:
+	std::unique_ptr<std::atomic<uint64_t>[]> mBuffer;
+	size_t mPixels;
+};
@@ -0,0 +1,126 @@
+﻿#include "strip_stereo.h"
+#include "trace.h"
+#include "opencv2/calib3d.hpp"
+#include "opencv2/core/utility.hpp"
+#include "opencv2/imgproc.hpp"
+#include <math.h>
+
+using namespace cv;
+
+const char* StereoMethodName(StereoMethod method)
+{
+	return method == STEREO_BM ? "bm" : "sgbm";
+}
+
+static Ptr<StereoMatcher> CreateMatcher(const StereoConfig& config, int channels)
+{
+	if (config.method == STEREO_BM) {
+		Ptr<StereoBM> matcher = StereoBM::create(config.numDisparities, MAX(config.blockSize | 1, 5));
+		matcher->setMinDisparity(config.minDisparity);
+		matcher->setUniquenessRatio(10);
+		matcher->setSpeckleWindowSize(100);
+		matcher->setSpeckleRange(32);
+		return matcher;
+	}
+	int area = config.blockSize * config.blockSize * channels;
+	return StereoSGBM::create(config.minDisparity, config.numDisparities, config.blockSize,
+		8 * area, 32 * area, 1, 63, 10, 100, 32, StereoSGBM::MODE_SGBM);
+}
+
+void ComputeDisparity(const Mat& left, const Mat& right, const StereoConfig& config, Mat& disparity,
+	StereoStats* stats)
+{
+	CV_Assert(left.size() == right.size() && left.type() == right.type());
+
+	//块匹配只支持灰度图
+	Mat leftInput = left, rightInput = right;
+	if (config.method == STEREO_BM && left.channels() != 1) {
+		cvtColor(left, leftInput, COLOR_BGR2GRAY);
+		cvtColor(right, rightInput, COLOR_BGR2GRAY);
+	}
+
+	int rows = left.rows;
+	int strips = config.strips > 0 ? config.strips : getNumberOfCPUs();
+	strips = MAX(MIN(strips, rows / MIN_STRIP_ROWS), 1);
+	int overlap = config.blockSize / 2 + STRIP_OVERLAP;
+
+	disparity.create(left.size(), CV_32F);
+	std::vector<StripTiming> timings(strips);
+	int64 startTick = getTickCount();
+
+	//每个条带连同上下重叠行独立匹配，只取中间部分写回，条带之间没有共享状态
+	parallel_for_(Range(0, strips), [&](const Range& range) {
+		for (int i = range.start; i < range.end; i++) {
+			TRACE_SCOPE("stereo strip");
+			int64 stripTick = getTickCount();
+			int firstRow = rows * i / strips, lastRow = rows * (i + 1) / strips;
+			int top = MAX(firstRow - overlap, 0), bottom = MIN(lastRow + overlap, rows);
+
+			Mat stripDisparity;
+			CreateMatcher(config, leftInput.channels())->compute(leftInput.rowRange(top, bottom),
+				rightInput.rowRange(top, bottom), stripDisparity);
+
+			//定点视差(x16)转为浮点，小于最小视差的为无效
+			short invalid = (short)(config.minDisparity * 16);
+			for (int y = firstRow; y < lastRow; y++) {
+				const short* src = stripDisparity.ptr<short>(y - top);
+				float* dst = disparity.ptr<float>(y);
+				for (int x = 0; x < disparity.cols; x++) {
+					dst[x] = src[x] < invalid ? -1.f : src[x] * (1.f / 16);
+				}
+			}
+
+			timings[i].firstRow = firstRow;
+			timings[i].rows = lastRow - firstRow;
+			timings[i].ms = (getTickCount() - stripTick) * 1000 / getTickFrequency();
+		}
+	}, strips);
+
+	if (stats) {
+		stats->strips = timings;
+		stats->totalMs = (getTickCount() - startTick) * 1000 / getTickFrequency();
+	}
+}
+
+DisparityScore ScoreDisparity(const Mat& disparity, const Mat& groundTruth, double gtScale, double threshold)
+{
+	CV_Assert(disparity.size() == groundTruth.size() && disparity.type() == CV_32F);
+
+	Mat truth;
+	groundTruth.convertTo(truth, CV_32F, 1 / gtScale);
+
+	DisparityScore score;
+	size_t bad = 0;
+	double squared = 0;
+	for (int y = 0; y < truth.rows; y++) {
+		const float* t = truth.ptr<float>(y);
+		const float* d = disparity.ptr<float>(y);
+		for (int x = 0; x < truth.cols; x++) {
+			if (t[x] <= 0) {
+				continue;
+			}
+			score.groundTruth++;
+			if (d[x] < 0) {
+				bad++;
+				continue;
+			}
+			double error = d[x] - t[x];
+			score.matched++;
+			squared += error * error;
+			if (fabs(error) > threshold) {
+				bad++;
+			}
+		}
+	}
+	score.badRate = score.groundTruth ? (double)bad / score.groundTruth : 0;
+	score.rmse = score.matched ? sqrt(squared / score.matched) : 0;
+	return score;
+}
+
+void ColorizeDisparity(const Mat& disparity, const StereoConfig& config, Mat& image)
+{
+	Mat normalized;
+	disparity.convertTo(normalized, CV_8U, 255.0 / (config.minDisparity + config.numDisparities));
+	applyColorMap(normalized, image, COLORMAP_JET);
+	image.setTo(Scalar::all(0), disparity < 0);
+}
@@ -0,0 +1,78 @@
+﻿#pragma once
+
+#include "opencv2/core.hpp"
+#include <vector>
+
+#define STRIP_OVERLAP			16		//条带上下额外匹配的行数，去掉代价聚合在条带边界处的影响
+#define MIN_STRIP_ROWS			32
+#define BAD_PIXEL_THRESHOLD		2.0		//视差误差超过该值的像素计为错误
+
+/* 匹配算法 */
+enum StereoMethod {
+	STEREO_BM = 0,
+	STEREO_SGBM = 1
+};
+
+/* 视差计算参数 */
+struct StereoConfig {
+	StereoMethod method;
+	int minDisparity;
+	int numDisparities;			//需为16的倍数
+	int blockSize;				//匹配窗口边长，奇数
+	int strips;					//条带数，0为CPU核数
+
+	StereoConfig() : method(STEREO_SGBM), minDisparity(0), numDisparities(224), blockSize(5), strips(0) {}
+};
+
+/* 单个条带的耗时 */
+struct StripTiming {
+	int firstRow;
+	int rows;
+	double ms;
+};
+
+/* 视差计算耗时 */
+struct StereoStats {
+	std::vector<StripTiming> strips;
+	double totalMs;
+
+	StereoStats() : totalMs(0) {}
+};
+
+/* 与真值视差的比较结果 */
+struct DisparityScore {
+	size_t groundTruth;			//真值有效的像素数
+	size_t matched;				//真值与计算结果都有效的像素数
+	double badRate;				//误差超过阈值或无结果的像素占真值有效像素的比例
+	double rmse;				//matched像素的均方根误差
+
+	DisparityScore() : groundTruth(0), matched(0), badRate(0), rmse(0) {}
+};
+
+const char* StereoMethodName(StereoMethod method);
+
+/**
+  * 把图像分成上下重叠的水平条带，各条带并行做块匹配或半全局匹配，再拼接为整幅视差图
+  * @param[in] left 校正后的左图
+  * @param[in] right 校正后的右图
+  * @param[in] config 匹配参数
+  * @param[out] disparity CV_32F视差图，无效像素为-1
+  * @param[out] stats 可选，各条带与总耗时
+  */
+void ComputeDisparity(const cv::Mat& left, const cv::Mat& right, const StereoConfig& config, cv::Mat& disparity,
+	StereoStats* stats = NULL);
+
+/**
+  * 与真值视差比较，真值为0的像素视为未知，不参与统计
+  * @param[in] disparity CV_32F视差图
+  * @param[in] groundTruth 8位或16位真值图
+  * @param[in] gtScale 真值图像素值 = 视差 * gtScale
+  * @param[in] threshold 错误像素的误差阈值
+  */
+DisparityScore ScoreDisparity(const cv::Mat& disparity, const cv::Mat& groundTruth, double gtScale = 1,
+	double threshold = BAD_PIXEL_THRESHOLD);
+
+/**
+  * 视差图映射为伪彩色用于显示，无效像素为黑色
+  */
+void ColorizeDisparity(const cv::Mat& disparity, const StereoConfig& config, cv::Mat& image);
@@ -0,0 +1,172 @@
+﻿#include "tile_cache.h"
+#include "trace.h"
+#include "opencv2/core/utility.hpp"
+
+using namespace cv;
+
+TileCache::TileCache(size_t budgetBytes)
+	: mImage(NULL), mBudget(budgetBytes), mStopping(false)
+{
+}
+
+TileCache::~TileCache()
+{
+	Stop();
+}
+
+void TileCache::Start(const TiledImage* image, int threads)
+{
+	Stop();
+	mImage = image;
+	mStopping = false;
+	if (threads <= 0) {
+		threads = MAX(getNumberOfCPUs() / 2, 1);
+	}
+	for (int i = 0; i < threads; i++) {
+		mThreads.push_back(std::thread(&TileCache::Worker, this));
+	}
+}
+
+void TileCache::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStopping = true;
+	}
+	mCondition.notify_all();
+	for (size_t i = 0; i < mThreads.size(); i++) {
+		mThreads[i].join();
+	}
+	mThreads.clear();
+
+	mEntries.clear();
+	mLru.clear();
+	mQueue.clear();
+	mPending.clear();
+	mFailed.clear();
+	mStats = TileCacheStats();
+}
+
+TileCache::TilePtr TileCache::Find(uint64_t key)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	std::unordered_map<uint64_t, Entry>::iterator it = mEntries.find(key);
+	if (it == mEntries.end()) {
+		mStats.misses++;
+		return TilePtr();
+	}
+	mStats.hits++;
+	mLru.splice(mLru.begin(), mLru, it->second.position);
+	return it->second.tile;
+}
+
+int TileCache::AddClient()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mFrames.push_back(1);
+	return (int)mFrames.size() - 1;
+}
+
+void TileCache::Request(uint64_t key, int client)
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (mEntries.count(key) || mFailed.count(key)) {
+			return;
+		}
+		std::unordered_map<uint64_t, std::vector<uint64_t> >::iterator it = mPending.find(key);
+		bool queued = it != mPending.end();
+		std::vector<uint64_t>& requested = queued ? it->second : mPending[key];
+		if (requested.size() < mFrames.size()) {
+			requested.resize(mFrames.size(), 0);
+		}
+		requested[client] = mFrames[client];
+		if (queued) {
+			return;
+		}
+		mQueue.push_front(key);
+	}
+	mCondition.notify_one();
+}
+
+void TileCache::BeginFrame(int client)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mFrames[client]++;
+}
+
+bool TileCache::IsStale(const std::vector<uint64_t>& requested) const
+{
+	//只要有一个视图最近仍请求过就继续解码，一个视图移走不影响其他视图
+	for (size_t c = 0; c < requested.size(); c++) {
+		if (requested[c] != 0 && requested[c] + STALE_TILE_FRAMES >= mFrames[c]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+TileCacheStats TileCache::Stats() const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	TileCacheStats stats = mStats;
+	stats.resident = mEntries.size();
+	return stats;
+}
+
+void TileCache::Worker()
+{
+	SetTraceThreadName("tile decode");
+	std::unique_lock<std::mutex> lock(mMutex);
+	while (true) {
+		mCondition.wait(lock, [this] { return mStopping || !mQueue.empty(); });
+		if (mStopping) {
+			return;
+		}
+
+		uint64_t key = mQueue.front();
+		mQueue.pop_front();
+		if (IsStale(mPending[key])) {
+			mPending.erase(key);
+			mStats.stale++;
+			continue;
+		}
+
+		lock.unlock();
+		std::shared_ptr<Mat> tile = std::make_shared<Mat>();
+		bool decoded;
+		{
+			TRACE_SCOPE("tile decode");
+			decoded = mImage->DecodeTile(TileLevel(key), TileCol(key), TileRow(key), *tile);
+		}
+		lock.lock();
+
+		mPending.erase(key);
+		if (!decoded) {
+			mFailed.insert(key);
+			continue;
+		}
+
+		//新分块放在表头，超出内存上限时从表尾淘汰
+		Entry entry;
+		entry.tile = tile;
+		entry.bytes = tile->total() * tile->elemSize();
+		mLru.push_front(key);
+		entry.position = mLru.begin();
+		mEntries[key] = entry;
+		mStats.decoded++;
+		mStats.bytes += entry.bytes;
+		while (mStats.bytes > mBudget && mLru.size() > 1) {
+			uint64_t oldest = mLru.back();
+			mLru.pop_back();
+			mStats.bytes -= mEntries[oldest].bytes;
+			mEntries.erase(oldest);
+			mStats.evicted++;
+		}
+		if (mArrivalCallback) {
+			lock.unlock();
+			mArrivalCallback();
+			lock.lock();
+		}
+	}
+}
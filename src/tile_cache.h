@@ -0,0 +1,108 @@
+﻿#pragma once
+
+#include "tiled_image.h"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#define DEFAULT_TILE_CACHE_MB	256
+#define STALE_TILE_FRAMES		2		//请求过的视图都超过该帧数未再请求时，待解码分块直接丢弃
+
+/* 分块缓存统计 */
+struct TileCacheStats {
+	size_t hits;
+	size_t misses;
+	size_t decoded;
+	size_t stale;				//因视图已移走而放弃解码的请求数
+	size_t evicted;
+	size_t resident;			//驻留的分块数
+	size_t bytes;				//驻留分块占用的字节数
+
+	TileCacheStats() : hits(0), misses(0), decoded(0), stale(0), evicted(0), resident(0), bytes(0) {}
+};
+
+/**
+  * 按内存上限淘汰最久未使用分块的LRU缓存，后台线程按需解码。
+  * 新请求优先解码，视图移走后未再请求的分块放弃解码，占用内存只与视口大小相关。
+  * 多个视图共用时各自注册为一个请求方，按各自的帧数判断请求是否过期
+  */
+class TileCache {
+public:
+	typedef std::shared_ptr<const cv::Mat> TilePtr;
+
+	explicit TileCache(size_t budgetBytes = (size_t)DEFAULT_TILE_CACHE_MB << 20);
+	~TileCache();
+
+	/**
+	  * 启动解码线程，之前的分块全部清空
+	  * @param[in] image 分块图像，使用期间需保持有效
+	  * @param[in] threads 解码线程数，0为CPU核数的一半
+	  */
+	void Start(const TiledImage* image, int threads = 0);
+	void Stop();
+
+	/**
+	  * 查找已驻留的分块并更新其使用时间
+	  * @return 未驻留或解码失败时返回空
+	  */
+	TilePtr Find(uint64_t key);
+
+	/**
+	  * 注册一个独立绘制的请求方(视图)
+	  * @return 请求方序号
+	  */
+	int AddClient();
+
+	/**
+	  * 请求在后台解码分块，已驻留或已在等待中的分块只更新请求时间
+	  * @param[in] client AddClient返回的序号
+	  */
+	void Request(uint64_t key, int client);
+
+	/**
+	  * 请求方每次绘制前调用，用于判断其请求是否过期
+	  * @param[in] client AddClient返回的序号
+	  */
+	void BeginFrame(int client);
+
+	/**
+	  * 设置新分块解码完成时的通知，在解码线程中调用，需在Start之前设置
+	  */
+	void SetArrivalCallback(std::function<void()> callback) { mArrivalCallback = callback; }
+
+	TileCacheStats Stats() const;
+
+private:
+	struct Entry {
+		TilePtr tile;
+		std::list<uint64_t>::iterator position;
+		size_t bytes;
+	};
+
+	void Worker();
+	bool IsStale(const std::vector<uint64_t>& requested) const;
+
+	const TiledImage* mImage;
+	size_t mBudget;
+
+	mutable std::mutex mMutex;
+	std::condition_variable mCondition;
+	std::unordered_map<uint64_t, Entry> mEntries;
+	std::list<uint64_t> mLru;						//表头为最近使用
+	std::deque<uint64_t> mQueue;					//表头为最新请求
+	std::unordered_map<uint64_t, std::vector<uint64_t> > mPending;	//等待解码的分块及各请求方最近请求的帧号，0为未请求
+	std::unordered_set<uint64_t> mFailed;
+	std::vector<uint64_t> mFrames;					//各请求方的帧号，从1开始
+	bool mStopping;
+	TileCacheStats mStats;
+
+	std::vector<std::thread> mThreads;
+	std::function<void()> mArrivalCallback;
+};
@@ -0,0 +1,93 @@
+﻿#include "tiled_image.h"
+#include "opencv2/imgcodecs.hpp"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fstream>
+#include <sstream>
+
+using namespace cv;
+
+namespace {
+
+/**
+  * 读取xml中形如 name="value" 的属性
+  */
+bool XmlAttribute(const std::string& xml, const std::string& name, std::string& value)
+{
+	std::string pattern = name + "=\"";
+	size_t start = xml.find(pattern);
+	if (start == std::string::npos) {
+		return false;
+	}
+	start += pattern.size();
+	size_t end = xml.find('"', start);
+	if (end == std::string::npos) {
+		return false;
+	}
+	value = xml.substr(start, end - start);
+	return true;
+}
+
+bool XmlIntAttribute(const std::string& xml, const std::string& name, int& value)
+{
+	std::string text;
+	if (!XmlAttribute(xml, name, text)) {
+		return false;
+	}
+	value = atoi(text.c_str());
+	return true;
+}
+
+}
+
+bool TiledImage::Open(const std::string& path)
+{
+	mMaxLevel = -1;
+	std::ifstream file(path.c_str(), std::ios::binary);
+	if (!file) {
+		printf("can not open %s\n", path.c_str());
+		return false;
+	}
+	std::stringstream buffer;
+	buffer << file.rdbuf();
+	std::string xml = buffer.str();
+
+	int width = 0, height = 0;
+	if (!XmlAttribute(xml, "Format", mFormat) || !XmlIntAttribute(xml, "TileSize", mTileSize)
+		|| !XmlIntAttribute(xml, "Overlap", mOverlap) || !XmlIntAttribute(xml, "Width", width)
+		|| !XmlIntAttribute(xml, "Height", height) || mTileSize <= 0 || mOverlap < 0 || width <= 0 || height <= 0) {
+		printf("invalid dzi file %s\n", path.c_str());
+		return false;
+	}
+	mSize = Size(width, height);
+
+	size_t dot = path.rfind('.');
+	mTileDir = (dot == std::string::npos ? path : path.substr(0, dot)) + "_files/";
+	mMaxLevel = (int)ceil(log2((double)MAX(width, height)));
+	return true;
+}
+
+Size TiledImage::LevelSize(int level) const
+{
+	double factor = 1 << level;
+	return Size((int)ceil(mSize.width / factor), (int)ceil(mSize.height / factor));
+}
+
+bool TiledImage::DecodeTile(int level, int col, int row, Mat& tile) const
+{
+	//dzi的层级从最粗的1x1开始编号
+	char name[64];
+	sprintf(name, "%d/%d_%d.", mMaxLevel - level, col, row);
+	tile = imread(mTileDir + name + mFormat, IMREAD_COLOR);
+	return !tile.empty();
+}
+
+Mat TiledImage::TileContent(const Mat& tile, int level, int col, int row) const
+{
+	Size levelSize = LevelSize(level);
+	int width = MIN(mTileSize, levelSize.width - col * mTileSize);
+	int height = MIN(mTileSize, levelSize.height - row * mTileSize);
+	Rect content = Rect(col > 0 ? mOverlap : 0, row > 0 ? mOverlap : 0, width, height) & Rect(Point(0, 0), tile.size());
+	return tile(content);
+}
@@ -0,0 +1,64 @@
+﻿#pragma once
+
+#include "opencv2/core.hpp"
+#include <stdint.h>
+#include <string>
+
+/**
+  * 分块编号，第level层(0为原图，每层为上一层的1/2)第row行第col列
+  */
+inline uint64_t TileKey(int level, int col, int row)
+{
+	return ((uint64_t)level << 56) | ((uint64_t)(uint32_t)col << 28) | (uint64_t)(uint32_t)row;
+}
+
+inline int TileLevel(uint64_t key) { return (int)(key >> 56); }
+inline int TileCol(uint64_t key) { return (int)((key >> 28) & 0xFFFFFFF); }
+inline int TileRow(uint64_t key) { return (int)(key & 0xFFFFFFF); }
+
+/**
+  * Deep Zoom(.dzi)格式的分块图像，各层分块为独立的图像文件，按需单独解码，
+  * 无需把整幅图像读入内存。
+  * xxx.dzi描述图像尺寸、分块大小与重叠像素数，分块位于xxx_files/<dzi层级>/<列>_<行>.<格式>
+  */
+class TiledImage {
+public:
+	TiledImage() : mTileSize(0), mOverlap(0), mMaxLevel(-1) {}
+
+	/**
+	  * 读取.dzi描述文件
+	  * @param[in] path .dzi文件路径
+	  * @return 格式不支持或字段缺失时返回false
+	  */
+	bool Open(const std::string& path);
+
+	bool IsOpen() const { return mMaxLevel >= 0; }
+
+	/**
+	  * 层数，最粗的一层为1x1
+	  */
+	int LevelCount() const { return mMaxLevel + 1; }
+
+	cv::Size LevelSize(int level) const;
+	int TileSize() const { return mTileSize; }
+
+	/**
+	  * 解码一个分块，可在多个线程中同时调用
+	  * @param[out] tile 解码结果，包含重叠像素
+	  * @return 文件不存在或解码失败时返回false
+	  */
+	bool DecodeTile(int level, int col, int row, cv::Mat& tile) const;
+
+	/**
+	  * 去掉分块四周的重叠像素，得到分块本身覆盖的区域
+	  */
+	cv::Mat TileContent(const cv::Mat& tile, int level, int col, int row) const;
+
+private:
+	std::string mTileDir;
+	std::string mFormat;
+	cv::Size mSize;
+	int mTileSize;
+	int mOverlap;
+	int mMaxLevel;
+};
@@ -0,0 +1,137 @@
+﻿#include "trace.h"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <stdio.h>
+#include <vector>
+
+/* 一个已结束的事件 */
+struct TraceEvent {
+	const char* name;
+	int64_t startNs;
+	int64_t durationNs;
+};
+
+/* 一个线程的环形缓冲，线程结束后仍由登记表持有，直到程序退出 */
+struct TraceRing {
+	std::vector<TraceEvent> events;
+	std::atomic<uint64_t> head;			//已写入的事件总数
+	const char* threadName;
+	int threadId;
+
+	TraceRing() : events(TRACE_RING_SIZE), head(0), threadName(NULL), threadId(0) {}
+};
+
+static std::mutex gTraceMutex;
+static std::vector<std::shared_ptr<TraceRing> > gTraceRings;
+static const int64_t gTraceOrigin = TraceNowNs();		//输出的时间戳相对程序启动
+
+static TraceRing* ThreadRing()
+{
+	thread_local TraceRing* ring = NULL;
+	if (ring == NULL) {
+		std::shared_ptr<TraceRing> created = std::make_shared<TraceRing>();
+		std::lock_guard<std::mutex> lock(gTraceMutex);
+		created->threadId = (int)gTraceRings.size() + 1;
+		gTraceRings.push_back(created);
+		ring = created.get();
+	}
+	return ring;
+}
+
+int64_t TraceNowNs()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void TraceRecord(const char* name, int64_t startNs, int64_t endNs)
+{
+	//只有本线程写入，先写事件再发布head
+	TraceRing* ring = ThreadRing();
+	uint64_t head = ring->head.load(std::memory_order_relaxed);
+	TraceEvent& event = ring->events[head & (TRACE_RING_SIZE - 1)];
+	event.name = name;
+	event.startNs = startNs;
+	event.durationNs = endNs - startNs;
+	ring->head.store(head + 1, std::memory_order_release);
+}
+
+void SetTraceThreadName(const char* name)
+{
+	ThreadRing()->threadName = name;
+}
+
+/**
+  * 写出字符串，转义JSON特殊字符
+  */
+static void WriteJsonString(FILE* file, const char* text)
+{
+	fputc('"', file);
+	for (const char* c = text; *c != '\0'; c++) {
+		if (*c == '"' || *c == '\\') {
+			fputc('\\', file);
+		}
+		if ((unsigned char)*c >= 0x20) {
+			fputc(*c, file);
+		}
+	}
+	fputc('"', file);
+}
+
+bool DumpTrace(const std::string& path, size_t* events)
+{
+	std::vector<std::shared_ptr<TraceRing> > rings;
+	{
+		std::lock_guard<std::mutex> lock(gTraceMutex);
+		rings = gTraceRings;
+	}
+
+	FILE* file = fopen(path.c_str(), "w");
+	if (file == NULL) {
+		return false;
+	}
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	size_t written = 0;
+	bool first = true;
+	std::vector<TraceEvent> copy;
+	for (size_t r = 0; r < rings.size(); r++) {
+		TraceRing& ring = *rings[r];
+		if (ring.threadName != NULL) {
+			fprintf(file, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":",
+				first ? "" : ",\n", ring.threadId);
+			WriteJsonString(file, ring.threadName);
+			fprintf(file, "}}");
+			first = false;
+		}
+
+		//先拷贝再检查拷贝期间写端是否已绕回，被覆盖的最旧部分丢弃
+		uint64_t head = ring.head.load(std::memory_order_acquire);
+		uint64_t begin = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+		copy.resize((size_t)(head - begin));
+		for (uint64_t i = begin; i < head; i++) {
+			copy[(size_t)(i - begin)] = ring.events[i & (TRACE_RING_SIZE - 1)];
+		}
+		uint64_t after = ring.head.load(std::memory_order_acquire);
+		uint64_t valid = after > TRACE_RING_SIZE ? after - TRACE_RING_SIZE + 1 : 0;
+
+		for (uint64_t i = begin > valid ? begin : valid; i < head; i++) {
+			const TraceEvent& event = copy[(size_t)(i - begin)];
+			fprintf(file, "%s{\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"name\":", first ? "" : ",\n",
+				ring.threadId, (event.startNs - gTraceOrigin) / 1000.0, event.durationNs / 1000.0);
+			WriteJsonString(file, event.name);
+			fputc('}', file);
+			first = false;
+			written++;
+		}
+	}
+	fprintf(file, "\n]}\n");
+	bool ok = ferror(file) == 0;
+	fclose(file);
+
+	if (events != NULL) {
+		*events = written;
+	}
+	return ok;
+}
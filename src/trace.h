@@ -0,0 +1,67 @@
+﻿#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+//编译时关闭追踪：定义ENABLE_TRACE为0(CMake选项ENABLE_TRACE=OFF)，TRACE_SCOPE不产生任何代码
+#ifndef ENABLE_TRACE
+#define ENABLE_TRACE			1
+#endif
+
+#define TRACE_RING_SIZE			65536	//每个线程保留的最近事件数，须为2的幂
+
+#define TRACE_CONCAT_INNER(a, b)	a##b
+#define TRACE_CONCAT(a, b)			TRACE_CONCAT_INNER(a, b)
+
+#if ENABLE_TRACE
+//记录所在作用域的起止时间，name须为字符串常量
+#define TRACE_SCOPE(name)		TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+#else
+#define TRACE_SCOPE(name)
+#endif
+
+/**
+  * 单调时钟，纳秒
+  */
+int64_t TraceNowNs();
+
+/**
+  * 记录一个已结束的事件到当前线程的环形缓冲
+  * @param[in] name 事件名称，须在程序运行期间有效(字符串常量)
+  * @param[in] startNs 开始时刻，TraceNowNs
+  * @param[in] endNs 结束时刻
+  */
+void TraceRecord(const char* name, int64_t startNs, int64_t endNs);
+
+/**
+  * 设置当前线程在追踪中显示的名称
+  * @param[in] name 线程名称，须为字符串常量
+  */
+void SetTraceThreadName(const char* name);
+
+/**
+  * 把各线程缓冲中的事件写为Chrome/Perfetto可打开的JSON(chrome://tracing、ui.perfetto.dev)，
+  * 可与记录线程同时调用，写出期间被覆盖的事件会被丢弃
+  * @param[in] path 输出路径
+  * @param[out] events 可选，写出的事件数
+  * @return 文件无法写入时返回false
+  */
+bool DumpTrace(const std::string& path, size_t* events = NULL);
+
+/**
+  * 作用域追踪，构造时记录开始时刻，析构时写入当前线程的环形缓冲。
+  * 每个线程第一次记录时登记自己的缓冲，之后只写线程局部内存，不加锁
+  */
+class TraceScope {
+public:
+	explicit TraceScope(const char* name) : mName(name), mStart(TraceNowNs()) {}
+	~TraceScope() { TraceRecord(mName, mStart, TraceNowNs()); }
+
+private:
+	TraceScope(const TraceScope&);
+	TraceScope& operator=(const TraceScope&);
+
+	const char* mName;
+	int64_t mStart;
+};
@@ -0,0 +1,51 @@
+﻿#include "view_camera.h"
+#include <math.h>
+
+#define PI						3.1415926535
+
+using namespace cv;
+
+namespace {
+
+Matx44f Translation(float x, float y, float z)
+{
+	return Matx44f(
+		1, 0, 0, x,
+		0, 1, 0, y,
+		0, 0, 1, z,
+		0, 0, 0, 1);
+}
+
+}
+
+Matx44f ViewCamera::Modelview() const
+{
+	//与glTranslatef(-center)、glTranslatef(transX, -transY, -distance)、glRotatef(-pitch, 1, 0, 0)、glRotatef(-yaw, 0, 1, 0)依次右乘的结果相同
+	float pitchRad = (float)(-pitch * PI / 180), yawRad = (float)(-yaw * PI / 180);
+	float cp = cosf(pitchRad), sp = sinf(pitchRad);
+	float cy = cosf(yawRad), sy = sinf(yawRad);
+	Matx44f rotateX(
+		1, 0, 0, 0,
+		0, cp, -sp, 0,
+		0, sp, cp, 0,
+		0, 0, 0, 1);
+	Matx44f rotateY(
+		cy, 0, sy, 0,
+		0, 1, 0, 0,
+		-sy, 0, cy, 0,
+		0, 0, 0, 1);
+	return Translation(-center.x, -center.y, -center.z) * Translation(transX, -transY, -distance) * rotateX * rotateY;
+}
+
+Matx44f ViewCamera::Projection(double aspect) const
+{
+	//与glFrustum一致
+	double top = zNear * tan(fovy * PI / 360.0);
+	double right = top * aspect;
+	double n = zNear, f = zFar;
+	return Matx44f(
+		(float)(n / right), 0, 0, 0,
+		0, (float)(n / top), 0, 0,
+		0, 0, (float)(-(f + n) / (f - n)), (float)(-2 * f * n / (f - n)),
+		0, 0, -1, 0);
+}
@@ -0,0 +1,38 @@
+﻿#pragma once
+
+#include "opencv2/core.hpp"
+
+#define DEFAULT_FOVY			45
+#define DEFAULT_Z_NEAR			1
+#define DEFAULT_Z_FAR			5000
+
+/**
+  * 3d视图的相机参数，矩阵与OnOpengl中gluPerspective、glTranslatef、glRotatef的组合一致，
+  * 供不依赖OpenGL的绘制与剔除使用
+  */
+struct ViewCamera {
+	float yaw;					//角度
+	float pitch;				//角度
+	float transX;
+	float transY;
+	float distance;
+	cv::Point3f center;			//平移到视图原点的点，默认为点云中心，FitCamera时为旋转后的质心
+
+	float fovy;					//竖直视场角，角度
+	float zNear;
+	float zFar;
+
+	ViewCamera() : yaw(0), pitch(0), transX(0), transY(0), distance(1000),
+		fovy(DEFAULT_FOVY), zNear(DEFAULT_Z_NEAR), zFar(DEFAULT_Z_FAR) {}
+
+	/**
+	  * 模型视图矩阵，行主序
+	  */
+	cv::Matx44f Modelview() const;
+
+	/**
+	  * 透视投影矩阵，行主序
+	  * @param[in] aspect 宽高比
+	  */
+	cv::Matx44f Projection(double aspect) const;
+};
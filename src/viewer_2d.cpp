@@ -0,0 +1,223 @@
+﻿#include "viewer_2d.h"
+#include "trace.h"
+#include "viewport_2d.h"
+#include "opencv2/imgproc.hpp"
+#include "opencv2/highgui.hpp"
+
+using namespace cv;
+
+Viewer2d::Viewer2d(const std::string& name, Size size)
+	: mName(name), mSize(size), mScheduler(NULL), mView(-1), mRecorder(NULL), mTiledImage(NULL), mTileCache(NULL),
+	mTileClient(-1)
+{
+	mImage = Mat(size, CV_8UC3, Scalar(100, 100, 100));
+	mPyramid.Build(mImage);
+	mResult = Mat(size, CV_8UC3, Scalar(100, 100, 100));
+	Publish();
+}
+
+void Viewer2d::Open(RedrawScheduler* scheduler)
+{
+	namedWindow(mName, WINDOW_AUTOSIZE);
+	setMouseCallback(mName, OnMouse, this);
+	mScheduler = scheduler;
+	mView = scheduler->AddView(mName, [this] { Present(); });
+	scheduler->Invalidate(mView);
+}
+
+void Viewer2d::SetImage(const Mat& image)
+{
+	std::lock_guard<std::mutex> lock(mContentMutex);
+	mImage = image;
+	mPyramid.Build(mImage);
+	mTiledImage = NULL;
+	mTileCache = NULL;
+}
+
+void Viewer2d::WaitImage()
+{
+	std::lock_guard<std::mutex> lock(mContentMutex);
+	mPyramid.Wait();
+}
+
+void Viewer2d::SetTiledImage(const TiledImage* image, TileCache* cache)
+{
+	std::lock_guard<std::mutex> lock(mContentMutex);
+	mTiledImage = image;
+	mTileCache = cache;
+	//共用缓存的各视图分别判断请求是否过期
+	mTileClient = cache != NULL ? cache->AddClient() : -1;
+}
+
+Size Viewer2d::ImageSize() const
+{
+	std::lock_guard<std::mutex> lock(mContentMutex);
+	return mTiledImage != NULL ? mTiledImage->LevelSize(0) : mImage.size();
+}
+
+void Viewer2d::FitToWindow()
+{
+	Size imageSize = ImageSize();
+	if (imageSize.area() > 0) {
+		mState.scale = MIN((float)mSize.width / imageSize.width, (float)mSize.height / imageSize.height);
+		mState.offset = Point(0, 0);
+		Publish();
+	}
+}
+
+void Viewer2d::EditAnnotations(const std::function<void(AnnotationLayer&)>& edit)
+{
+	std::lock_guard<std::mutex> lock(mContentMutex);
+	edit(mAnnotations);
+}
+
+void Viewer2d::ClearAnnotations()
+{
+	std::lock_guard<std::mutex> lock(mContentMutex);
+	mAnnotations.Clear();
+}
+
+size_t Viewer2d::AnnotationCount() const
+{
+	std::lock_guard<std::mutex> lock(mContentMutex);
+	return mAnnotations.Size();
+}
+
+size_t Viewer2d::DrawAnnotations(Mat& dst) const
+{
+	View2dState state = mSnapshot.Read();
+	std::lock_guard<std::mutex> lock(mContentMutex);
+	return mAnnotations.Draw(dst, state.scale, state.offset);
+}
+
+void Viewer2d::Render(Mat& dst) const
+{
+	TRACE_SCOPE("Viewer2d::Render");
+	View2dState state = mSnapshot.Read();
+	dst.create(mSize, CV_8UC3);
+	{
+		//缩小时从金字塔中选最接近的层级，只需再做一次小幅缩小；只重采样窗口内可见的部分，平移时为直接拷贝
+		std::lock_guard<std::mutex> lock(mContentMutex);
+		if (mTiledImage != NULL) {
+			RenderTiledViewport(*mTiledImage, *mTileCache, mTileClient, state.scale, state.offset, dst);
+		} else {
+			double levelScale = 1;
+			const Mat& level = state.scale < 1 ? mPyramid.Select(state.scale, levelScale) : mImage;
+			RenderViewport(level, state.scale / levelScale, state.offset, dst);
+		}
+
+		//标注在窗口分辨率下绘制，只绘制视口内的部分
+		mAnnotations.Draw(dst, state.scale, state.offset);
+	}
+	if (state.dragging) {
+		Point p0(cvRound(state.dragStart.x * state.scale) + state.offset.x, cvRound(state.dragStart.y * state.scale) + state.offset.y);
+		Point p1(cvRound(state.dragEnd.x * state.scale) + state.offset.x, cvRound(state.dragEnd.y * state.scale) + state.offset.y);
+		if (state.dragLine)
+			line(dst, p0, p1, Scalar(255, 0, 0), 1);
+		else
+			rectangle(dst, p0, p1, Scalar(0, 255, 255), 1);
+	}
+
+	char text[128];
+	sprintf(text, "ROI RECT X = %d, Y = %d", state.offset.x, state.offset.y);
+	putText(dst, text, cv::Point(50, 50), cv::FONT_HERSHEY_COMPLEX, 0.5, Scalar(0, 255, 255));
+}
+
+void Viewer2d::Present()
+{
+	TRACE_SCOPE("Viewer2d::Present");
+	Render(mResult);
+	imshow(mName, mResult);
+}
+
+void Viewer2d::Invalidate()
+{
+	if (mScheduler != NULL) {
+		mScheduler->Invalidate(mView);
+	}
+}
+
+void Viewer2d::OnMouse(int event, int x, int y, int flags, void* userdata)
+{
+	Viewer2d* viewer = (Viewer2d*)userdata;
+	if (viewer->mRecorder != NULL) {
+		viewer->mRecorder->Record(INPUT_VIEW_2D, event, x, y, flags);
+	}
+	viewer->HandleMouse(event, x, y, flags);
+}
+
+bool Viewer2d::HandleMouse(int event, int x, int y, int flags)
+{
+	TRACE_SCOPE("Viewer2d::HandleMouse");
+	if (x < 0 || x > mSize.width - 1 || y < 0 || y > mSize.height - 1)
+		return false;
+
+	View2dState last = mState;
+	size_t lastAnnotations = AnnotationCount();
+
+	//左键按下，记录开始移动时的位置
+	if (event == CV_EVENT_LBUTTONDOWN) {
+		mDragOrigin = Point(x, y);
+		mDragOffset = mState.offset;
+	}
+
+	//左键按下且鼠标移动中，记录移动的距离
+	if (event == CV_EVENT_MOUSEMOVE && (flags & CV_EVENT_LBUTTONDOWN)) {
+		mState.offset = mDragOffset + Point(x, y) - mDragOrigin;
+	}
+
+	//右键按下，记录标注起点
+	Point2f imagePoint((float)(x - mState.offset.x) / mState.scale, (float)(y - mState.offset.y) / mState.scale);
+	if (event == CV_EVENT_RBUTTONDOWN) {
+		mState.dragStart = imagePoint;
+		mState.dragEnd = imagePoint;
+		mState.dragging = true;
+	}
+
+	//右键拖动中，更新待添加的标注
+	if (event == CV_EVENT_MOUSEMOVE && mState.dragging) {
+		mState.dragEnd = imagePoint;
+		mState.dragLine = (flags & CV_EVENT_FLAG_SHIFTKEY) != 0;
+	}
+
+	//右键抬起，单击添加点(按住ctrl为十字)，拖动添加矩形(按住shift为直线)
+	if (event == CV_EVENT_RBUTTONUP && mState.dragging) {
+		mState.dragging = false;
+		Point2f diff = (imagePoint - mState.dragStart) * mState.scale;
+		std::lock_guard<std::mutex> lock(mContentMutex);
+		if (diff.dot(diff) < 9) {
+			if (flags & CV_EVENT_FLAG_CTRLKEY)
+				mAnnotations.AddCross(mState.dragStart, Scalar(0, 255, 0));
+			else
+				mAnnotations.AddPoint(mState.dragStart, Scalar(0, 0, 255));
+		} else if (flags & CV_EVENT_FLAG_SHIFTKEY) {
+			mAnnotations.AddLine(mState.dragStart, imagePoint, Scalar(255, 0, 0));
+		} else {
+			mAnnotations.AddBox(mState.dragStart, imagePoint, Scalar(0, 255, 255));
+		}
+	}
+
+	//滚轮滚动，对图像进行缩放
+	if (event == CV_EVENT_MOUSEWHEEL) {
+		int value = getMouseWheelDelta(flags);
+		float scaleStep = 0;
+		if (value > 0)
+			scaleStep = VIEWER_SCALE_STEP_2D;
+		else if (value < 0)
+			scaleStep = -VIEWER_SCALE_STEP_2D;
+		mState.scale *= (1 + scaleStep);
+		mState.offset.x = x + (mState.offset.x - x)*(1 + scaleStep);
+		mState.offset.y = y + (mState.offset.y - y)*(1 + scaleStep);
+	}
+
+	//只更新视图状态并发布快照，不在回调中重绘，由主循环按帧间隔合并重绘
+	bool changed = mState.offset != last.offset || mState.scale != last.scale || mState.dragging != last.dragging
+		|| (mState.dragging && mState.dragEnd != last.dragEnd) || AnnotationCount() != lastAnnotations;
+	if (changed) {
+		Publish();
+	}
+	if (mScheduler != NULL) {
+		mScheduler->OnEvent(mView, changed);
+	}
+	return changed;
+}
@@ -0,0 +1,146 @@
+﻿#pragma once
+
+#include "opencv2/core.hpp"
+#include "annotation_layer.h"
+#include "image_pyramid.h"
+#include "redraw_scheduler.h"
+#include "snapshot_buffer.h"
+#include "input_trace.h"
+#include "tiled_image.h"
+#include "tile_cache.h"
+#include <functional>
+#include <mutex>
+#include <string>
+
+#define VIEWER_WIDTH			800
+#define VIEWER_HEIGHT			800
+#define VIEWER_SCALE_STEP_2D	0.1
+
+/* 2d视图的绘制状态，由界面线程发布，绘制时读取 */
+struct View2dState {
+	float scale;				//源图像到窗口的缩放倍数
+	cv::Point offset;			//缩放后源图像左上角在窗口中的位置
+	bool dragging;				//右键拖动中，绘制待添加的直线或矩形
+	bool dragLine;
+	cv::Point2f dragStart;		//源图像坐标
+	cv::Point2f dragEnd;
+
+	View2dState() : scale(1), offset(0, 0), dragging(false), dragLine(false) {}
+};
+
+/**
+  * 2d图像视图，拥有窗口、视图状态、源图像金字塔与标注层。
+  * 鼠标回调通过userdata找到所属视图，同一进程可以有多个互不影响的视图；
+  * 输入只修改界面线程的状态并发布快照，Render可在任意线程按最新快照绘制
+  */
+class Viewer2d {
+public:
+	Viewer2d(const std::string& name, cv::Size size = cv::Size(VIEWER_WIDTH, VIEWER_HEIGHT));
+
+	/**
+	  * 创建窗口并注册到调度器，之后输入事件与Invalidate通过调度器重绘
+	  * @param[in] scheduler 调度器，需比视图存在更久
+	  */
+	void Open(RedrawScheduler* scheduler);
+
+	/**
+	  * 显示普通图像，后台构建金字塔
+	  */
+	void SetImage(const cv::Mat& image);
+
+	/**
+	  * 等待后台的金字塔构建完成，之后缩小时总能选到最接近的层级
+	  */
+	void WaitImage();
+
+	/**
+	  * 显示分块图像，代替普通图像
+	  * @param[in] image 分块图像，需已打开
+	  * @param[in] cache 分块缓存，可被多个视图共用
+	  */
+	void SetTiledImage(const TiledImage* image, TileCache* cache);
+
+	/**
+	  * 缩放到整幅图像显示在窗口内
+	  */
+	void FitToWindow();
+
+	/**
+	  * 当前显示的图像尺寸，分块图像为原图尺寸
+	  */
+	cv::Size ImageSize() const;
+
+	/**
+	  * 在持有标注锁时修改标注层，只能在界面线程调用
+	  * @param[in] edit 修改函数
+	  */
+	void EditAnnotations(const std::function<void(AnnotationLayer&)>& edit);
+	void ClearAnnotations();
+	size_t AnnotationCount() const;
+
+	/**
+	  * 在dst上按当前视图状态绘制标注，用于统计绘制耗时
+	  * @return 绘制的标注数
+	  */
+	size_t DrawAnnotations(cv::Mat& dst) const;
+
+	/**
+	  * 按最新发布的状态绘制一帧，可在任意线程调用
+	  * @param[out] dst CV_8UC3窗口图像
+	  */
+	void Render(cv::Mat& dst) const;
+
+	/**
+	  * 绘制并显示到窗口，由调度器在界面线程调用
+	  */
+	void Present();
+
+	/**
+	  * 非交互的状态变化后请求重绘
+	  */
+	void Invalidate();
+
+	View2dState State() const { return mSnapshot.Read(); }
+	const std::string& Name() const { return mName; }
+	int ViewId() const { return mView; }
+
+	/**
+	  * 录制之后的鼠标回调，NULL为停止录制
+	  */
+	void SetInputRecorder(InputRecorder* recorder) { mRecorder = recorder; }
+
+	/**
+	  * 不经过窗口直接处理一次鼠标事件，用于回放录制的输入
+	  * @return 事件是否改变了需要绘制的状态
+	  */
+	bool InjectMouse(int event, int x, int y, int flags) { return HandleMouse(event, x, y, flags); }
+
+	static void OnMouse(int event, int x, int y, int flags, void* userdata);
+
+private:
+	bool HandleMouse(int event, int x, int y, int flags);
+	void Publish() { mSnapshot.Publish(mState); }
+
+	std::string mName;
+	cv::Size mSize;
+	RedrawScheduler* mScheduler;
+	int mView;
+	InputRecorder* mRecorder;
+
+	//只在界面线程访问的输入状态
+	View2dState mState;
+	cv::Point mDragOrigin;				//左键按下时的鼠标位置
+	cv::Point mDragOffset;				//左键按下时的图像位置
+	SnapshotBuffer<View2dState> mSnapshot;
+
+	//图像与标注由界面线程修改、绘制线程读取，每个视图一把锁，视图之间互不等待
+	mutable std::mutex mContentMutex;
+	cv::Mat mImage;
+	ImagePyramid mPyramid;
+	const TiledImage* mTiledImage;
+	TileCache* mTileCache;
+	int mTileClient;					//在分块缓存中的请求方序号
+	AnnotationLayer mAnnotations;
+
+	cv::Mat mResult;
+};
@@ -0,0 +1,230 @@
+﻿#include "viewer_3d.h"
+#include "trace.h"
+#include "gl_headers.h"
+#include "opencv2/highgui.hpp"
+#include <math.h>
+#include <string.h>
+
+#define PI						3.1415926535
+
+using namespace cv;
+
+static void gluPerspective(GLdouble fovy, GLdouble aspect, GLdouble zNear, GLdouble zFar)
+{
+	GLdouble xmin, xmax, ymin, ymax;
+
+	ymax = zNear * tan(fovy * PI / 360.0);
+	ymin = -ymax;
+	xmin = ymin * aspect;
+	xmax = ymax * aspect;
+
+	glFrustum(xmin, xmax, ymin, ymax, zNear, zFar);
+}
+
+Viewer3d::Viewer3d(const std::string& name, cv::Size size)
+	: mName(name), mSize(size), mScheduler(NULL), mView(-1), mRecorder(NULL), mCloud(NULL), mLastX(0), mLastY(0),
+	mMaxDistance(MAX_VIEW_DISTANCE), mFitted(false)
+{
+	mSnapshot.Publish(mCamera);
+}
+
+void Viewer3d::Open(RedrawScheduler* scheduler)
+{
+	namedWindow(mName, WINDOW_OPENGL);
+	resizeWindow(mName, mSize.width, mSize.height);
+	setOpenGlContext(mName);
+	setMouseCallback(mName, OnMouse, this);
+	setOpenGlDrawCallback(mName, OnOpengl, this);
+	mScheduler = scheduler;
+	mView = scheduler->AddView(mName, [this] { updateWindow(mName); });
+	scheduler->Invalidate(mView);
+}
+
+void Viewer3d::SetCloud(const PointsCloud* cloud)
+{
+	mCloud = cloud;
+	mRenderer.SetCloud(cloud);
+	//序列、共享内存的逐帧更新与体素切换都会调用，适配后的中心不随之丢失
+	if (!mFitted) {
+		mCamera.center = cloud != NULL ? cloud->centerPoint : Point3f();
+	}
+	mSnapshot.Publish(mCamera);
+}
+
+void Viewer3d::SetCamera(const ViewCamera& camera)
+{
+	mCamera = camera;
+	mSnapshot.Publish(mCamera);
+}
+
+void Viewer3d::FitCamera(const CloudStats& stats)
+{
+	if (!stats.Valid()) {
+		return;
+	}
+
+	//水平、竖直视场中较小的一个决定距离
+	double halfFovy = mCamera.fovy * PI / 360.0;
+	double halfFovx = atan(tan(halfFovy) * mSize.width / mSize.height);
+	double halfFov = MIN(halfFovy, halfFovx);
+	float radius = MAX(stats.Radius(), 1.0f);
+
+	//顶点在视图坐标中为R * p + trans - center，旋转绕世界原点，
+	//center取旋转后的质心R * g，质心即落在视线上距离distance处
+	ViewCamera rotation = mCamera;
+	rotation.center = Point3f();
+	rotation.transX = rotation.transY = rotation.distance = 0;
+	Point3f centroid = stats.Centroid();
+	Vec4f rotated = rotation.Modelview() * Vec4f(centroid.x, centroid.y, centroid.z, 1);
+
+	mCamera.center = Point3f(rotated[0], rotated[1], rotated[2]);
+	mCamera.transX = 0;
+	mCamera.transY = 0;
+	mCamera.distance = (float)(radius / sin(halfFov));
+	mCamera.zFar = MAX((float)DEFAULT_Z_FAR, mCamera.distance + radius * 2);
+	mMaxDistance = MAX((float)MAX_VIEW_DISTANCE, mCamera.distance * 2);
+	mFitted = true;
+	mSnapshot.Publish(mCamera);
+	Invalidate();
+}
+
+double Viewer3d::RenderSplats(const SplatConfig& config, Mat& image)
+{
+	return RenderSplats(mSnapshot.Read(), config, image);
+}
+
+double Viewer3d::RenderSplats(const ViewCamera& camera, const SplatConfig& config, Mat& image)
+{
+	if (mCloud == NULL) {
+		return 0;
+	}
+	TRACE_SCOPE("Viewer3d::RenderSplats");
+	std::lock_guard<std::mutex> lock(mSplatMutex);
+	int64 startTick = getTickCount();
+	mSplatRenderer.Render(*mCloud, camera, config, mSize, image);
+	return (getTickCount() - startTick) * 1000 / getTickFrequency();
+}
+
+void Viewer3d::Invalidate()
+{
+	if (mScheduler != NULL) {
+		mScheduler->Invalidate(mView);
+	}
+}
+
+void Viewer3d::OnMouse(int event, int x, int y, int flags, void* userdata)
+{
+	Viewer3d* viewer = (Viewer3d*)userdata;
+	if (viewer->mRecorder != NULL) {
+		viewer->mRecorder->Record(INPUT_VIEW_3D, event, x, y, flags);
+	}
+	viewer->HandleMouse(event, x, y, flags);
+}
+
+void Viewer3d::OnOpengl(void* userdata)
+{
+	((Viewer3d*)userdata)->Draw();
+}
+
+bool Viewer3d::HandleMouse(int event, int x, int y, int flags)
+{
+	TRACE_SCOPE("Viewer3d::HandleMouse");
+	ViewCamera last = mCamera;
+
+	if (event == CV_EVENT_RBUTTONDOWN) {
+		mLastX = x;
+		mLastY = y;
+	}
+
+	if (event == CV_EVENT_MOUSEMOVE && (flags & CV_EVENT_RBUTTONDOWN))   //右键按下，鼠标移动时
+	{
+		mCamera.transX += (x - mLastX) * 1.0;
+		mCamera.transY += (y - mLastY) * 1.0;
+		mLastX = x;
+		mLastY = y;
+	}
+
+	if (event == CV_EVENT_LBUTTONDOWN) {
+		mLastX = x;
+		mLastY = y;
+	}
+
+	if (event == CV_EVENT_MOUSEMOVE && (flags & CV_EVENT_LBUTTONDOWN))   //左键按下，鼠标移动时
+	{
+		mCamera.yaw -= (x - mLastX) * 1.0;
+		if (mCamera.yaw < 0.0) {
+			mCamera.yaw += 360.0;
+		} else if (mCamera.yaw > 360.0) {
+			mCamera.yaw -= 360.0;
+		}
+
+		mCamera.pitch -= (y - mLastY) * 1.0;
+		if (mCamera.pitch < 0.0) {
+			mCamera.pitch += 360.0;
+		} else if (mCamera.pitch > 360.0) {
+			mCamera.pitch -= 360.0;
+		}
+
+		mLastX = x;
+		mLastY = y;
+	}
+
+	if (event == CV_EVENT_MOUSEWHEEL) {
+		//自动适配放大了距离范围时步长按比例放大
+		int value = getMouseWheelDelta(flags);
+		float step = VIEWER_SCALE_STEP_3D * mMaxDistance / MAX_VIEW_DISTANCE;
+		if (value > 0) {
+			mCamera.distance += step;
+		} else if (value < 0) {
+			mCamera.distance -= step;
+		}
+
+		if (mCamera.distance < 1.0) {
+			mCamera.distance = 1.0;
+		} else if (mCamera.distance > mMaxDistance) {
+			mCamera.distance = mMaxDistance;
+		}
+	}
+
+	//只更新相机状态并发布快照，不在回调中重绘，由主循环按帧间隔用最新状态重绘
+	float lastView[] = { last.yaw, last.pitch, last.transX, last.transY, last.distance };
+	float view[] = { mCamera.yaw, mCamera.pitch, mCamera.transX, mCamera.transY, mCamera.distance };
+	bool changed = memcmp(lastView, view, sizeof(view)) != 0;
+	if (changed) {
+		mSnapshot.Publish(mCamera);
+	}
+	if (mScheduler != NULL) {
+		mScheduler->OnEvent(mView, changed);
+	}
+	return changed;
+}
+
+void Viewer3d::Draw()
+{
+	TRACE_SCOPE("Viewer3d::Draw");
+	ViewCamera camera = mSnapshot.Read();
+
+	glViewport(0, 0, mSize.width, mSize.height);
+	glMatrixMode(GL_PROJECTION);
+	glLoadIdentity();
+	gluPerspective(camera.fovy, (double)mSize.width / mSize.height, camera.zNear, camera.zFar);
+
+	glMatrixMode(GL_MODELVIEW);
+	glLoadIdentity();
+	glTranslatef(-camera.center.x, -camera.center.y, -camera.center.z);
+	glTranslatef(camera.transX, -camera.transY, -camera.distance);
+	glRotatef(-camera.pitch, 1, 0, 0);
+	glRotatef(-camera.yaw, 0, 1, 0);
+
+	mRenderer.Draw();
+
+	glFlush();
+
+	if (mDrawCallback) {
+		mDrawCallback();
+	}
+
+	//标题栏显示本帧提交与被剔除的点数
+	const CullStats& cull = mRenderer.LastCull();
+	setWindowTitle(mName, format("%s - submitted %zu culled %zu", mName.c_str(), cull.submittedPoints, cull.culledPoints));
+}
@@ -0,0 +1,132 @@
+﻿#pragma once
+
+#include "opencv2/core.hpp"
+#include "cloud_renderer.h"
+#include "cloud_stats.h"
+#include "splat_renderer.h"
+#include "redraw_scheduler.h"
+#include "snapshot_buffer.h"
+#include "input_trace.h"
+#include "view_camera.h"
+#include "viewer_2d.h"
+#include <functional>
+#include <mutex>
+#include <string>
+
+#define VIEWER_SCALE_STEP_3D	20
+#define MAX_VIEW_DISTANCE		2000
+
+/**
+  * 3d点云视图，拥有OpenGL窗口、相机状态与绘制器。
+  * 鼠标与绘制回调通过userdata找到所属视图；输入只修改界面线程的相机并发布快照，
+  * OpenGL绘制与CPU绘制都使用最新发布的相机，CPU绘制可在任意线程进行
+  */
+class Viewer3d {
+public:
+	Viewer3d(const std::string& name, cv::Size size = cv::Size(VIEWER_WIDTH, VIEWER_HEIGHT));
+
+	/**
+	  * 创建OpenGL窗口并注册到调度器
+	  * @param[in] scheduler 调度器，需比视图存在更久
+	  */
+	void Open(RedrawScheduler* scheduler);
+
+	/**
+	  * 显示的点云，多个视图可以共用同一点云，绘制期间点云需保持不变。
+	  * 相机中心取点云中心，FitCamera之后保持适配的中心，直到ClearFit
+	  */
+	void SetCloud(const PointsCloud* cloud);
+	const PointsCloud* Cloud() const { return mCloud; }
+
+	/**
+	  * 最新发布的相机，可在任意线程调用
+	  */
+	ViewCamera Camera() const { return mSnapshot.Read(); }
+
+	/**
+	  * 设置相机并发布，只能在界面线程(或拥有该视图的线程)调用
+	  */
+	void SetCamera(const ViewCamera& camera);
+
+	/**
+	  * 自动适配相机：保持当前视角方向，把质心移到视图中心，调整距离使包含包围盒的球完整落在视场内，
+	  * 远裁剪面与滚轮的最大距离随之放大。旋转仍绕世界原点进行，与Modelview一致
+	  * @param[in] stats 点云统计
+	  */
+	void FitCamera(const CloudStats& stats);
+
+	/**
+	  * 取消FitCamera的适配，加载新点云时调用，下次SetCloud重新以点云中心为相机中心
+	  */
+	void ClearFit() { mFitted = false; }
+
+	/**
+	  * 用CPU绘制器按最新发布的相机绘制一帧，可在任意线程调用，同一视图的多次调用依次进行
+	  * @param[in] config 绘制参数
+	  * @param[out] image CV_8UC3图像
+	  * @return 耗时，毫秒
+	  */
+	double RenderSplats(const SplatConfig& config, cv::Mat& image);
+
+	/**
+	  * 指定相机的RenderSplats
+	  */
+	double RenderSplats(const ViewCamera& camera, const SplatConfig& config, cv::Mat& image);
+
+	/**
+	  * OpenGL绘制器，只能在界面线程访问
+	  */
+	CloudRenderer& Renderer() { return mRenderer; }
+
+	/**
+	  * 每次OpenGL绘制完成后在界面线程调用
+	  */
+	void SetDrawCallback(std::function<void()> callback) { mDrawCallback = callback; }
+
+	/**
+	  * 非交互的状态变化后请求重绘
+	  */
+	void Invalidate();
+
+	const std::string& Name() const { return mName; }
+	cv::Size Size() const { return mSize; }
+	int ViewId() const { return mView; }
+
+	/**
+	  * 录制之后的鼠标回调，NULL为停止录制
+	  */
+	void SetInputRecorder(InputRecorder* recorder) { mRecorder = recorder; }
+
+	/**
+	  * 不经过窗口直接处理一次鼠标事件，用于回放录制的输入
+	  * @return 事件是否改变了需要绘制的状态
+	  */
+	bool InjectMouse(int event, int x, int y, int flags) { return HandleMouse(event, x, y, flags); }
+
+	static void OnMouse(int event, int x, int y, int flags, void* userdata);
+	static void OnOpengl(void* userdata);
+
+private:
+	bool HandleMouse(int event, int x, int y, int flags);
+	void Draw();
+
+	std::string mName;
+	cv::Size mSize;
+	RedrawScheduler* mScheduler;
+	int mView;
+	InputRecorder* mRecorder;
+	const PointsCloud* mCloud;
+
+	//只在界面线程访问的输入状态
+	ViewCamera mCamera;
+	float mLastX;
+	float mLastY;
+	float mMaxDistance;
+	bool mFitted;						//相机中心来自FitCamera，逐帧SetCloud时不覆盖
+	SnapshotBuffer<ViewCamera> mSnapshot;
+
+	CloudRenderer mRenderer;
+	std::function<void()> mDrawCallback;
+	SplatRenderer mSplatRenderer;
+	std::mutex mSplatMutex;				//每个视图一个CPU绘制器
+};
@@ -0,0 +1,112 @@
+﻿#include "viewport_2d.h"
+#include "opencv2/imgproc.hpp"
+#include <math.h>
+
+using namespace cv;
+
+void DrawScaled(const Mat& src, const Rect& dstRect, Mat& dst)
+{
+	Rect visible = dstRect & Rect(Point(0, 0), dst.size());
+	if (visible.empty() || src.empty()) {
+		return;
+	}
+
+	Mat target = dst(visible);
+	Rect scaledRect = visible - dstRect.tl();
+	if (dstRect.size() == src.size()) {
+		src(scaledRect).copyTo(target);
+		return;
+	}
+
+	//缩放后坐标x对应源图像坐标x * fx
+	double fx = (double)src.cols / dstRect.width;
+	double fy = (double)src.rows / dstRect.height;
+	if (fx >= 1 && fy >= 1) {
+		//缩小：取覆盖可见区域的源图像块做区域平均
+		int x0 = (int)floor(scaledRect.x * fx), x1 = (int)ceil(scaledRect.br().x * fx);
+		int y0 = (int)floor(scaledRect.y * fy), y1 = (int)ceil(scaledRect.br().y * fy);
+		Rect sourceRect = Rect(x0, y0, x1 - x0, y1 - y0) & Rect(Point(0, 0), src.size());
+		resize(src(sourceRect), target, target.size(), 0, 0, INTER_AREA);
+	} else {
+		//放大：按像素中心对齐的逆映射直接从源图像插值
+		Matx23d inverse(fx, 0, (scaledRect.x + 0.5) * fx - 0.5,
+			0, fy, (scaledRect.y + 0.5) * fy - 0.5);
+		warpAffine(src, target, inverse, target.size(), INTER_LINEAR | WARP_INVERSE_MAP, BORDER_REPLICATE);
+	}
+}
+
+Rect RenderViewport(const Mat& src, double scale, Point offset, Mat& dst)
+{
+	//缩放后的图像尺寸与原先resize(Size(cols * scale, rows * scale))一致
+	Rect scaledRect(offset, Size((int)(src.cols * scale), (int)(src.rows * scale)));
+	Rect visible = scaledRect & Rect(Point(0, 0), dst.size());
+	if (visible.size() != dst.size()) {
+		dst.setTo(Scalar::all(0));
+	}
+	DrawScaled(src, scaledRect, dst);
+	return visible;
+}
+
+Rect RenderTiledViewport(const TiledImage& image, TileCache& cache, int client, double scale, Point offset, Mat& dst)
+{
+	dst.setTo(Scalar::all(0));
+	Size imageSize = image.LevelSize(0);
+	Rect visible = Rect(offset, Size((int)(imageSize.width * scale), (int)(imageSize.height * scale)))
+		& Rect(Point(0, 0), dst.size());
+	if (visible.empty()) {
+		return visible;
+	}
+
+	//选择分辨率不低于scale的最粗层级，s为层级像素到窗口像素的倍数
+	int level = 0;
+	while (level + 1 < image.LevelCount() && scale <= 1.0 / (1 << (level + 1))) {
+		level++;
+	}
+	double s = scale * (1 << level);
+	Size levelSize = image.LevelSize(level);
+	int tileSize = image.TileSize();
+
+	//窗口内可见的分块范围
+	int col0 = MAX((int)floor((visible.x - offset.x) / s) / tileSize, 0);
+	int row0 = MAX((int)floor((visible.y - offset.y) / s) / tileSize, 0);
+	int col1 = MIN((int)ceil((visible.br().x - offset.x) / s) / tileSize, (levelSize.width - 1) / tileSize);
+	int row1 = MIN((int)ceil((visible.br().y - offset.y) / s) / tileSize, (levelSize.height - 1) / tileSize);
+
+	cache.BeginFrame(client);
+	for (int row = row0; row <= row1; row++) {
+		for (int col = col0; col <= col1; col++) {
+			//分块在层级坐标与窗口坐标中的范围，相邻分块按同一取整规则首尾相接
+			Rect tileRect = Rect(col * tileSize, row * tileSize, tileSize, tileSize) & Rect(Point(0, 0), levelSize);
+			Point tl(offset.x + cvRound(tileRect.x * s), offset.y + cvRound(tileRect.y * s));
+			Point br(offset.x + cvRound(tileRect.br().x * s), offset.y + cvRound(tileRect.br().y * s));
+			Rect dstRect(tl, br);
+
+			TileCache::TilePtr tile = cache.Find(TileKey(level, col, row));
+			if (tile) {
+				DrawScaled(image.TileContent(*tile, level, col, row), dstRect, dst);
+				continue;
+			}
+
+			//未加载的分块先请求解码，暂用已驻留的更粗层级中对应的部分代替
+			cache.Request(TileKey(level, col, row), client);
+			for (int coarser = level + 1; coarser < image.LevelCount(); coarser++) {
+				int shift = coarser - level;
+				int parentCol = col >> shift, parentRow = row >> shift;
+				TileCache::TilePtr parent = cache.Find(TileKey(coarser, parentCol, parentRow));
+				if (!parent) {
+					continue;
+				}
+				Mat content = image.TileContent(*parent, coarser, parentCol, parentRow);
+				Point origin(parentCol * tileSize, parentRow * tileSize);
+				Point subTl((tileRect.x >> shift) - origin.x, (tileRect.y >> shift) - origin.y);
+				Point subBr(((tileRect.br().x + (1 << shift) - 1) >> shift) - origin.x, ((tileRect.br().y + (1 << shift) - 1) >> shift) - origin.y);
+				Rect sub = Rect(subTl, subBr) & Rect(Point(0, 0), content.size());
+				if (!sub.empty()) {
+					DrawScaled(content(sub), dstRect, dst);
+				}
+				break;
+			}
+		}
+	}
+	return visible;
+}
@@ -0,0 +1,39 @@
+﻿#pragma once
+
+#include "opencv2/core.hpp"
+#include "tiled_image.h"
+#include "tile_cache.h"
+
+/**
+  * 将源图像缩放到dstRect的大小后绘制到dst中，只重采样dst内可见的部分，dst其余像素不变
+  * @param[in] src 源图像
+  * @param[in] dstRect 缩放后的图像在dst中的位置，可以超出dst
+  * @param[in,out] dst 输出图像，类型与src一致
+  */
+void DrawScaled(const cv::Mat& src, const cv::Rect& dstRect, cv::Mat& dst);
+
+/**
+  * 将源图像缩放scale倍后左上角平移到offset，结果写入dst，dst中没有图像的部分填黑色。
+  * 只对dst中可见的区域重采样，耗时与dst尺寸相关而与源图像尺寸、缩放倍数无关；
+  * scale为1时直接拷贝。缩小用INTER_AREA，放大用INTER_LINEAR
+  * @param[in] src 源图像
+  * @param[in] scale 缩放倍数
+  * @param[in] offset 缩放后图像左上角在dst中的位置
+  * @param[in,out] dst 输出图像，需已分配，类型与src一致
+  * @return dst中被图像覆盖的区域
+  */
+cv::Rect RenderViewport(const cv::Mat& src, double scale, cv::Point offset, cv::Mat& dst);
+
+/**
+  * 分块图像的RenderViewport，只绘制窗口内可见的分块。
+  * 未驻留的分块向缓存请求后台解码，本次用已驻留的更粗层级代替，解码完成后再次绘制即可细化
+  * @param[in] image 分块图像
+  * @param[in] cache 分块缓存
+  * @param[in] client 在分块缓存中注册的请求方序号
+  * @param[in] scale 相对原图的缩放倍数
+  * @param[in] offset 缩放后图像左上角在dst中的位置
+  * @param[in,out] dst 输出图像，需已分配为CV_8UC3
+  * @return dst中被图像覆盖的区域
+  */
+cv::Rect RenderTiledViewport(const TiledImage& image, TileCache& cache, int client, double scale, cv::Point offset,
+	cv::Mat& dst);
@@ -0,0 +1,247 @@
+﻿#include "voxel_filter.h"
+#include "cloud_stats.h"
+#include "trace.h"
+#include "opencv2/core/utility.hpp"
+#include <math.h>
+#include <stdint.h>
+#include <vector>
+
+#define MIN_CHUNK_POINTS		(64 * 1024)
+
+using namespace cv;
+
+namespace {
+
+/* 排序中的一个点，坐标与颜色随编号一起移动，求平均时顺序读取；编号不超过32位时为24字节 */
+template<typename Key>
+struct VoxelPoint {
+	Key key;
+	float x, y, z;
+	float intensity;
+	uint32_t rgb;
+};
+
+/* 分块并行处理时的等长划分，块数与线程数相关，块内顺序处理 */
+struct Chunks {
+	int count;
+	size_t size;
+	size_t total;
+
+	explicit Chunks(size_t points) : total(points)
+	{
+		count = (int)MIN((size_t)MAX(getNumThreads(), 1) * 4, points / MIN_CHUNK_POINTS + 1);
+		size = (points + count - 1) / count;
+	}
+
+	size_t Begin(int c) const { return MIN(total, c * size); }
+	size_t End(int c) const { return MIN(total, (c + 1) * size); }
+};
+
+/**
+  * 稳定的分块并行LSD基数排序：各块分别统计直方图，按(桶, 块)顺序累加出写入位置后并行分发
+  * @param[in,out] points 按编号排序
+  * @param[in] keyBits 编号的有效位数，平均分为每趟不超过VOXEL_RADIX_BITS位
+  */
+template<typename Key>
+void RadixSort(std::vector<VoxelPoint<Key> >& points, int keyBits, const Chunks& chunks)
+{
+	int passes = (keyBits + VOXEL_RADIX_BITS - 1) / VOXEL_RADIX_BITS;
+	int digitBits = (keyBits + passes - 1) / passes;
+	Key mask = (Key)((1 << digitBits) - 1);
+	int bins = 1 << digitBits;
+	std::vector<VoxelPoint<Key> > sorted(points.size());
+	std::vector<size_t> histograms((size_t)chunks.count * bins);
+
+	for (int shift = 0; shift < keyBits; shift += digitBits) {
+		TRACE_SCOPE("voxel radix pass");
+		std::fill(histograms.begin(), histograms.end(), 0);
+		parallel_for_(Range(0, chunks.count), [&](const Range& range) {
+			for (int c = range.start; c < range.end; c++) {
+				size_t* histogram = &histograms[(size_t)c * bins];
+				for (size_t i = chunks.Begin(c); i < chunks.End(c); i++) {
+					histogram[(points[i].key >> shift) & mask]++;
+				}
+			}
+		}, chunks.count);
+
+		size_t position = 0;
+		for (int b = 0; b < bins; b++) {
+			for (int c = 0; c < chunks.count; c++) {
+				size_t& slot = histograms[(size_t)c * bins + b];
+				size_t binPoints = slot;
+				slot = position;
+				position += binPoints;
+			}
+		}
+
+		parallel_for_(Range(0, chunks.count), [&](const Range& range) {
+			for (int c = range.start; c < range.end; c++) {
+				size_t* cursor = &histograms[(size_t)c * bins];
+				for (size_t i = chunks.Begin(c); i < chunks.End(c); i++) {
+					sorted[cursor[(points[i].key >> shift) & mask]++] = points[i];
+				}
+			}
+		}, chunks.count);
+		points.swap(sorted);
+	}
+}
+
+/**
+  * 计算体素编号、排序并求每个体素的平均，Key为能容纳全部编号的无符号整数
+  * @param[in] lower 包围盒下界，体素网格的原点
+  * @param[in] cells 各轴的格数，编号cells之积留给坐标含nan的点，排序后位于末尾
+  * @param[in] keyBits 编号的有效位数
+  */
+template<typename Key>
+void Downsample(const PointsCloud& input, float leafSize, Point3f lower, const uint64_t cells[3], int keyBits,
+	PointsCloud& output)
+{
+	size_t count = input.Size();
+	Key nx = (Key)cells[0], ny = (Key)cells[1];
+	Key invalidKey = (Key)(cells[0] * cells[1] * cells[2]);
+	int64_t lastX = (int64_t)cells[0] - 1, lastY = (int64_t)cells[1] - 1, lastZ = (int64_t)cells[2] - 1;
+	float invLeaf = 1 / leafSize;
+
+	Chunks chunks(count);
+	std::vector<VoxelPoint<Key> > points(count);
+	const float* px = input.x.data();
+	const float* py = input.y.data();
+	const float* pz = input.z.data();
+	const float* pi = input.intensity.data();
+	const PointField* rgbField = input.FindField(RGB_FIELD_NAME);
+	const uint32_t* rgb = rgbField && rgbField->ElemSize() == 4 ? (const uint32_t*)rgbField->data.data() : NULL;
+	parallel_for_(Range(0, chunks.count), [&](const Range& range) {
+		TRACE_SCOPE("voxel keys");
+		for (int c = range.start; c < range.end; c++) {
+			for (size_t i = chunks.Begin(c); i < chunks.End(c); i++) {
+				VoxelPoint<Key>& point = points[i];
+				point.x = px[i];
+				point.y = py[i];
+				point.z = pz[i];
+				point.intensity = pi[i];
+				point.rgb = rgb ? rgb[i] : 0;
+				if (point.x != point.x || point.y != point.y || point.z != point.z) {
+					point.key = invalidKey;
+					continue;
+				}
+				//浮点舍入可能使上边界上的点落到最后一格之外
+				Key ix = (Key)MIN((int64_t)((point.x - lower.x) * invLeaf), lastX);
+				Key iy = (Key)MIN((int64_t)((point.y - lower.y) * invLeaf), lastY);
+				Key iz = (Key)MIN((int64_t)((point.z - lower.z) * invLeaf), lastZ);
+				point.key = ix + nx * (iy + ny * iz);
+			}
+		}
+	}, chunks.count);
+
+	RadixSort(points, keyBits, chunks);
+
+	//每块统计在本块内开始的体素数，跨块的体素由开始所在的块求平均
+	std::vector<size_t> voxelOffsets(chunks.count + 1, 0);
+	parallel_for_(Range(0, chunks.count), [&](const Range& range) {
+		for (int c = range.start; c < range.end; c++) {
+			size_t starts = 0;
+			for (size_t i = chunks.Begin(c); i < chunks.End(c); i++) {
+				if (points[i].key != invalidKey && (i == 0 || points[i].key != points[i - 1].key)) {
+					starts++;
+				}
+			}
+			voxelOffsets[c + 1] = starts;
+		}
+	}, chunks.count);
+	for (int c = 0; c < chunks.count; c++) {
+		voxelOffsets[c + 1] += voxelOffsets[c];
+	}
+
+	output.Resize(voxelOffsets[chunks.count]);
+	uint32_t* outRgb = rgb ? (uint32_t*)output.AddField<int>(RGB_FIELD_NAME) : NULL;
+	parallel_for_(Range(0, chunks.count), [&](const Range& range) {
+		TRACE_SCOPE("voxel average");
+		for (int c = range.start; c < range.end; c++) {
+			size_t v = voxelOffsets[c];
+			for (size_t i = chunks.Begin(c); i < chunks.End(c); i++) {
+				Key key = points[i].key;
+				if (key == invalidKey || (i > 0 && key == points[i - 1].key)) {
+					continue;
+				}
+
+				double sumX = 0, sumY = 0, sumZ = 0, sumIntensity = 0;
+				uint64_t sumR = 0, sumG = 0, sumB = 0;
+				size_t intensityCount = 0;
+				size_t end = i;
+				for (; end < count && points[end].key == key; end++) {
+					const VoxelPoint<Key>& point = points[end];
+					sumX += point.x;
+					sumY += point.y;
+					sumZ += point.z;
+					if (point.intensity == point.intensity) {
+						sumIntensity += point.intensity;
+						intensityCount++;
+					}
+					sumR += (point.rgb >> 16) & 0xFF;
+					sumG += (point.rgb >> 8) & 0xFF;
+					sumB += point.rgb & 0xFF;
+				}
+
+				size_t voxelPoints = end - i;
+				output.x[v] = (float)(sumX / voxelPoints);
+				output.y[v] = (float)(sumY / voxelPoints);
+				output.z[v] = (float)(sumZ / voxelPoints);
+				output.intensity[v] = intensityCount > 0 ? (float)(sumIntensity / intensityCount) : 0;
+				if (outRgb != NULL) {
+					outRgb[v] = (uint32_t)((sumR / voxelPoints) << 16 | (sumG / voxelPoints) << 8 | (sumB / voxelPoints));
+				}
+				v++;
+			}
+		}
+	}, chunks.count);
+
+	output.UpdateBoundary();
+}
+
+}
+
+bool VoxelGridDownsample(const PointsCloud& input, float leafSize, PointsCloud& output)
+{
+	CV_Assert(&input != &output);
+	if (!(leafSize > 0)) {
+		return false;
+	}
+	TRACE_SCOPE("VoxelGridDownsample");
+
+	CloudStats stats;
+	stats.Accumulate(input.x.data(), input.y.data(), input.z.data(), NULL, input.Size());
+	output.Reset();
+	if (!stats.Valid()) {
+		return true;
+	}
+
+	//体素编号 = ix + nx * (iy + ny * iz)
+	Point3f lower = stats.Lower(), upper = stats.Upper();
+	double extent[3] = {
+		floor((upper.x - lower.x) / (double)leafSize) + 1,
+		floor((upper.y - lower.y) / (double)leafSize) + 1,
+		floor((upper.z - lower.z) / (double)leafSize) + 1
+	};
+	if (extent[0] * extent[1] * extent[2] >= 9.2e18) {
+		return false;
+	}
+	uint64_t cells[3] = { (uint64_t)extent[0], (uint64_t)extent[1], (uint64_t)extent[2] };
+	uint64_t keyCount = cells[0] * cells[1] * cells[2] + 1;
+	int keyBits = 1;
+	while (keyBits < 64 && ((keyCount - 1) >> keyBits) != 0) {
+		keyBits++;
+	}
+
+	if (keyBits <= 32) {
+		Downsample<uint32_t>(input, leafSize, lower, cells, keyBits, output);
+	} else {
+		Downsample<uint64_t>(input, leafSize, lower, cells, keyBits, output);
+	}
+	return true;
+}
+
+float AutoVoxelLeafSize(const PointsCloud& cloud)
+{
+	float longest = MAX(cloud.width, MAX(cloud.height, cloud.depth));
+	return longest > 0 ? longest / VOXEL_AUTO_DIVISIONS : 1;
+}
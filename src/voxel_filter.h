@@ -0,0 +1,22 @@
+﻿#pragma once
+
+#include "points_cloud.h"
+
+#define VOXEL_RADIX_BITS		11		//体素编号基数排序每趟处理的位数
+#define VOXEL_AUTO_DIVISIONS	256		//自动叶子尺寸：包围盒最长边划分的格数
+
+/**
+  * 体素网格降采样：按叶子尺寸把点划入体素，每个非空体素输出一个点。
+  * 体素编号并行计算后，点的坐标与颜色随编号一起做稳定的分块并行基数排序，同一体素的点相邻，
+  * 再按段并行顺序求平均；输出按体素编号(z、y、x依次为主序)排列，结果与线程数无关
+  * @param[in] input 输入点云
+  * @param[in] leafSize 体素边长
+  * @param[out] output 体素内点的质心，强度取平均(忽略nan)，rgb字段按通道平均，其他附加字段不保留；不能与input相同
+  * @return leafSize不为正或体素数超出64位编号时返回false
+  */
+bool VoxelGridDownsample(const PointsCloud& input, float leafSize, PointsCloud& output);
+
+/**
+  * 按包围盒最长边的VOXEL_AUTO_DIVISIONS分之一选取叶子尺寸，边界需已更新
+  */
+float AutoVoxelLeafSize(const PointsCloud& cloud);
@@ -0,0 +1,413 @@
+﻿#include "xyzi_loader.h"
+#include "trace.h"
+#include "mapped_file.h"
+#include "opencv2/core/utility.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <cmath>
+
+#define MAX_LINE_BUFFER_SIZE	128
+#define MIN_CHUNK_SIZE			(256 * 1024)
+#define CHUNKS_PER_THREAD		4
+
+using namespace cv;
+
+namespace {
+
+const float kFloatPow10[] = {
+	1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+};
+
+const double kDoublePow10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+inline bool IsDigit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+inline bool IsBlank(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+/**
+  * 拷贝出一个以'\0'结尾的token交给strtof，处理快速路径覆盖不到的格式
+  */
+const char* ParseFloatSlow(const char* begin, const char* end, float& value)
+{
+	char buffer[64];
+	size_t length = 0;
+	while (begin + length < end && length < sizeof(buffer) - 1 && !IsBlank(begin[length]) && begin[length] != '\n') {
+		buffer[length] = begin[length];
+		length++;
+	}
+	buffer[length] = '\0';
+
+	char* stop = buffer;
+	float result = strtof(buffer, &stop);
+	if (stop == buffer) {
+		return begin;
+	}
+	value = result;
+	return begin + (stop - buffer);
+}
+
+/**
+  * 解析一行中的前columns.count个浮点数并按列取出xyzi，xyzi文本的语义同sscanf("%f %f %f %f") == 4
+  */
+inline bool ParseLine(const char* p, const char* end, const TextColumns& columns, float values[4])
+{
+	float tokens[MAX_TEXT_COLUMNS];
+	for (int k = 0; k < columns.count; k++) {
+		while (p < end && IsBlank(*p)) {
+			p++;
+		}
+		const char* next = ParseFloat(p, end, tokens[k]);
+		if (next == p) {
+			return false;
+		}
+		p = next;
+	}
+	for (int k = 0; k < 4; k++) {
+		values[k] = columns.index[k] >= 0 ? tokens[columns.index[k]] : DEFAULT_INTENSITY;
+	}
+	return true;
+}
+
+/* 单个分块的解析结果，按列存放 */
+struct ChunkResult {
+	std::vector<float> x;
+	std::vector<float> y;
+	std::vector<float> z;
+	std::vector<float> intensity;
+
+	void Release()
+	{
+		std::vector<float>().swap(x);
+		std::vector<float>().swap(y);
+		std::vector<float>().swap(z);
+		std::vector<float>().swap(intensity);
+	}
+};
+
+void ParseChunk(const char* begin, const char* end, const TextColumns& columns, ChunkResult& result)
+{
+	//按每行约32字节预估点数，减少扩容
+	size_t estimate = (end - begin) / 32 + 1;
+	result.x.reserve(estimate);
+	result.y.reserve(estimate);
+	result.z.reserve(estimate);
+	result.intensity.reserve(estimate);
+
+	float values[4];
+	for (; begin < end; begin++) {
+		const char* lineEnd = (const char*)memchr(begin, '\n', end - begin);
+		if (lineEnd == NULL) {
+			lineEnd = end;
+		}
+		const char* lineBegin = begin;
+		begin = lineEnd;
+
+		if (!ParseLine(lineBegin, lineEnd, columns, values)) {
+			continue;
+		}
+		if (columns.skipNonFinite && (!std::isfinite(values[0]) || !std::isfinite(values[1]) || !std::isfinite(values[2]))) {
+			continue;
+		}
+		result.x.push_back(values[0]);
+		result.y.push_back(values[1]);
+		result.z.push_back(values[2]);
+		result.intensity.push_back(values[3]);
+	}
+}
+
+/**
+  * 将文件按换行符对齐切分为若干块
+  * @return 块边界，共chunkCount+1个
+  */
+std::vector<const char*> SplitChunks(const char* data, size_t size, int chunkCount)
+{
+	std::vector<const char*> bounds(chunkCount + 1);
+	const char* end = data + size;
+	bounds[0] = data;
+	for (int i = 1; i < chunkCount; i++) {
+		const char* p = data + size / chunkCount * i;
+		if (p < bounds[i - 1]) {
+			p = bounds[i - 1];
+		}
+		if (p > data && p[-1] != '\n') {
+			const char* lineEnd = (const char*)memchr(p, '\n', end - p);
+			p = lineEnd ? lineEnd + 1 : end;
+		}
+		bounds[i] = p;
+	}
+	bounds[chunkCount] = end;
+	return bounds;
+}
+
+bool SameColumn(const ColumnBuffer<float>& a, const ColumnBuffer<float>& b)
+{
+	return a.size() == b.size() && (a.empty() || memcmp(a.data(), b.data(), a.size() * sizeof(float)) == 0);
+}
+
+bool SameCloud(const PointsCloud& a, const PointsCloud& b)
+{
+	return SameColumn(a.x, b.x) && SameColumn(a.y, b.y) && SameColumn(a.z, b.z) && SameColumn(a.intensity, b.intensity)
+		&& a.lowerBoundary == b.lowerBoundary && a.upperBoundary == b.upperBoundary;
+}
+
+}
+
+const char* ParseFloat(const char* begin, const char* end, float& value)
+{
+	const char* p = begin;
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+')) {
+		negative = *p == '-';
+		p++;
+	}
+
+	uint64 mantissa = 0;
+	int digits = 0;
+	int exponent = 0;
+
+	//整数部分
+	const char* digitsBegin = p;
+	for (; p < end && IsDigit(*p); p++) {
+		if (digits < 20) {
+			mantissa = mantissa * 10 + (*p - '0');
+		}
+		if (mantissa != 0) {
+			digits++;
+		}
+	}
+	bool hasDigits = p != digitsBegin;
+
+	//十六进制浮点数交给strtof
+	if (p < end && (*p == 'x' || *p == 'X')) {
+		return ParseFloatSlow(begin, end, value);
+	}
+
+	//小数部分
+	if (p < end && *p == '.') {
+		p++;
+		const char* fractionBegin = p;
+		for (; p < end && IsDigit(*p); p++) {
+			if (digits < 20) {
+				mantissa = mantissa * 10 + (*p - '0');
+				exponent--;
+			}
+			if (mantissa != 0) {
+				digits++;
+			}
+		}
+		hasDigits = hasDigits || p != fractionBegin;
+	}
+
+	//inf、nan等特殊值交给strtof
+	if (!hasDigits) {
+		return ParseFloatSlow(begin, end, value);
+	}
+
+	//指数部分，缺少数字时不消耗'e'
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		const char* q = p + 1;
+		bool expNegative = false;
+		if (q < end && (*q == '-' || *q == '+')) {
+			expNegative = *q == '-';
+			q++;
+		}
+		if (q < end && IsDigit(*q)) {
+			int expValue = 0;
+			for (; q < end && IsDigit(*q); q++) {
+				if (expValue < 100000) {
+					expValue = expValue * 10 + (*q - '0');
+				}
+			}
+			exponent += expNegative ? -expValue : expValue;
+			p = q;
+		}
+	}
+
+	if (mantissa == 0) {
+		value = negative ? -0.0f : 0.0f;
+		return p;
+	}
+
+	if (digits > 19) {
+		return ParseFloatSlow(begin, end, value);
+	}
+
+	//尾数与10的幂均可精确表示时，一次浮点运算即为正确舍入结果
+	if (mantissa <= (1ull << 24) && exponent >= -10 && exponent <= 10) {
+		float result = (float)mantissa;
+		result = exponent >= 0 ? result * kFloatPow10[exponent] : result / kFloatPow10[-exponent];
+		value = negative ? -result : result;
+		return p;
+	}
+
+	if (mantissa <= (1ull << 53) && exponent >= -22 && exponent <= 22) {
+		double result = (double)mantissa;
+		result = exponent >= 0 ? result * kDoublePow10[exponent] : result / kDoublePow10[-exponent];
+
+		//double恰好落在两个float中点时，二次舍入可能出错，交给strtof
+		uint64 bits;
+		memcpy(&bits, &result, sizeof(bits));
+		if ((bits & 0x1FFFFFFFull) != 0x10000000ull) {
+			value = negative ? -(float)result : (float)result;
+			return p;
+		}
+	}
+
+	return ParseFloatSlow(begin, end, value);
+}
+
+bool ParseXyziText(const char* data, size_t size, const TextColumns& columns, PointsCloud& cloud)
+{
+	if (columns.count <= 0 || columns.count > MAX_TEXT_COLUMNS) {
+		return false;
+	}
+
+	cloud.Reset();
+
+	int chunkCount = 1;
+	if (size > MIN_CHUNK_SIZE) {
+		size_t maxChunks = size / MIN_CHUNK_SIZE;
+		chunkCount = MAX(1, getNumThreads() * CHUNKS_PER_THREAD);
+		chunkCount = (int)MIN((size_t)chunkCount, maxChunks);
+	}
+
+	std::vector<ChunkResult> results(chunkCount);
+	if (size > 0) {
+		std::vector<const char*> bounds = SplitChunks(data, size, chunkCount);
+		parallel_for_(Range(0, chunkCount), [&](const Range& range) {
+			TRACE_SCOPE("xyzi parse");
+			for (int i = range.start; i < range.end; i++) {
+				ParseChunk(bounds[i], bounds[i + 1], columns, results[i]);
+			}
+		}, chunkCount);
+	}
+
+	//按块顺序合并，保持与逐行读取相同的点序
+	std::vector<size_t> offsets(chunkCount + 1, 0);
+	for (int i = 0; i < chunkCount; i++) {
+		offsets[i + 1] = offsets[i] + results[i].x.size();
+	}
+
+	cloud.Resize(offsets[chunkCount]);
+	parallel_for_(Range(0, chunkCount), [&](const Range& range) {
+		for (int i = range.start; i < range.end; i++) {
+			ChunkResult& result = results[i];
+			std::copy(result.x.begin(), result.x.end(), cloud.x.begin() + offsets[i]);
+			std::copy(result.y.begin(), result.y.end(), cloud.y.begin() + offsets[i]);
+			std::copy(result.z.begin(), result.z.end(), cloud.z.begin() + offsets[i]);
+			std::copy(result.intensity.begin(), result.intensity.end(), cloud.intensity.begin() + offsets[i]);
+			result.Release();
+		}
+	}, chunkCount);
+
+	cloud.UpdateBoundary();
+	return true;
+}
+
+bool LoadXyziTxt(const std::string& path, PointsCloud& cloud, LoadStats* stats)
+{
+	int64 startTick = getTickCount();
+
+	MappedFile file;
+	if (!file.Open(path)) {
+		return false;
+	}
+
+	TextColumns columns;
+	ParseXyziText(file.Data(), file.Size(), columns, cloud);
+
+	if (stats != NULL) {
+		stats->bytes = file.Size();
+		stats->points = cloud.Size();
+		stats->seconds = (getTickCount() - startTick) / getTickFrequency();
+	}
+	return true;
+}
+
+bool LoadXyziTxtLegacy(const std::string& path, PointsCloud& cloud, LoadStats* stats)
+{
+	int64 startTick = getTickCount();
+
+	FILE *file = fopen(path.c_str(), "r");
+	if (file == NULL) {
+		return false;
+	}
+
+	char line_buffer[MAX_LINE_BUFFER_SIZE];
+	float x = 0, y = 0, z = 0, i = 0;
+	size_t bytes = 0;
+	cloud.Reset();
+
+	bool isFirstIn = true;
+	while (fgets(line_buffer, MAX_LINE_BUFFER_SIZE, file)) {
+		bytes += strlen(line_buffer);
+		if (sscanf(line_buffer, "%f %f %f %f", &x, &y, &z, &i) == 4) {
+			cloud.PushBack(Point3f(x, y, z), i);
+
+			if (isFirstIn) {
+				cloud.lowerBoundary.x = cloud.upperBoundary.x = x;
+				cloud.lowerBoundary.y = cloud.upperBoundary.y = y;
+				cloud.lowerBoundary.z = cloud.upperBoundary.z = z;
+				isFirstIn = false;
+			}
+			cloud.lowerBoundary.x = MIN(cloud.lowerBoundary.x, x);
+			cloud.lowerBoundary.y = MIN(cloud.lowerBoundary.y, y);
+			cloud.lowerBoundary.z = MIN(cloud.lowerBoundary.z, z);
+
+			cloud.upperBoundary.x = MAX(cloud.upperBoundary.x, x);
+			cloud.upperBoundary.y = MAX(cloud.upperBoundary.y, y);
+			cloud.upperBoundary.z = MAX(cloud.upperBoundary.z, z);
+		}
+	}
+	fclose(file);
+
+	cloud.UpdateCenter();
+
+	if (stats != NULL) {
+		stats->bytes = bytes;
+		stats->points = cloud.Size();
+		stats->seconds = (getTickCount() - startTick) / getTickFrequency();
+	}
+	return true;
+}
+
+bool BenchmarkXyziTxt(const std::string& path, int repeat)
+{
+	PointsCloud legacyCloud, cloud;
+	LoadStats legacyBest, best, stats;
+
+	for (int i = 0; i < repeat; i++) {
+		if (!LoadXyziTxtLegacy(path, legacyCloud, &stats)) {
+			printf("bench: cannot open %s\n", path.c_str());
+			return false;
+		}
+		if (i == 0 || stats.seconds < legacyBest.seconds) {
+			legacyBest = stats;
+		}
+	}
+
+	for (int i = 0; i < repeat; i++) {
+		LoadXyziTxt(path, cloud, &stats);
+		if (i == 0 || stats.seconds < best.seconds) {
+			best = stats;
+		}
+	}
+
+	bool same = SameCloud(legacyCloud, cloud);
+	printf("bench: %s, %zu points, %.2f MB\n", path.c_str(), best.points, best.bytes / (1024.0 * 1024.0));
+	printf("bench: fgets/sscanf %8.2f ms %8.2f MB/s\n", legacyBest.seconds * 1000, legacyBest.Throughput());
+	printf("bench: mmap/parallel %8.2f ms %8.2f MB/s (%d threads)\n", best.seconds * 1000, best.Throughput(), getNumThreads());
+	printf("bench: results %s\n", same ? "identical" : "DIFFER");
+	return same;
+}
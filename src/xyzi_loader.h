@@ -0,0 +1,65 @@
+﻿#pragma once
+
+#include "points_cloud.h"
+#include <string>
+
+#define MAX_TEXT_COLUMNS		64
+
+/* 文本中x、y、z、intensity所在的列号，列号为-1时使用默认强度 */
+struct TextColumns {
+	int index[4];
+	int count;
+	bool skipNonFinite;	//跳过坐标为nan、inf的行
+
+	TextColumns() : count(4), skipNonFinite(false)
+	{
+		for (int k = 0; k < 4; k++) {
+			index[k] = k;
+		}
+	}
+};
+
+/**
+  * 内存映射并多线程解析xyzi文本点云，每行"x y z i"
+  * @param[in] path 文件路径
+  * @param[out] cloud 输出点云，包含边界与中心点
+  * @param[out] stats 耗时统计，可为NULL
+  * @return 文件打开失败返回false
+  */
+bool LoadXyziTxt(const std::string& path, PointsCloud& cloud, LoadStats* stats = NULL);
+
+/**
+  * 多线程解析内存中的文本点云，每行为空白分隔的浮点数
+  * @param[in] data 文本起始位置
+  * @param[in] size 文本字节数
+  * @param[in] columns 每行需要的列数以及xyzi所在列
+  * @param[out] cloud 输出点云，包含边界与中心点
+  * @return 列描述非法返回false
+  */
+bool ParseXyziText(const char* data, size_t size, const TextColumns& columns, PointsCloud& cloud);
+
+/**
+  * 逐行fgets/sscanf解析xyzi文本点云，作为基准与结果校验
+  * @param[in] path 文件路径
+  * @param[out] cloud 输出点云
+  * @param[out] stats 耗时统计，可为NULL
+  * @return 文件打开失败返回false
+  */
+bool LoadXyziTxtLegacy(const std::string& path, PointsCloud& cloud, LoadStats* stats = NULL);
+
+/**
+  * 解析一个浮点数，不依赖locale，结果与strtof一致
+  * @param[in] begin 起始位置
+  * @param[in] end 结束位置
+  * @param[out] value 解析结果
+  * @return 解析结束位置，失败返回begin
+  */
+const char* ParseFloat(const char* begin, const char* end, float& value);
+
+/**
+  * 对比新旧两种解析方式的吞吐量(MB/s)并校验结果一致
+  * @param[in] path 文件路径
+  * @param[in] repeat 重复次数
+  * @return 结果一致返回true
+  */
+bool BenchmarkXyziTxt(const std::string& path, int repeat);
@@ -0,0 +1,66 @@
+﻿#include "shm_ring.h"
+#include "opencv2/core/utility.hpp"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <thread>
+
+#define PI						3.1415926535
+
+using namespace cv;
+
+/**
+  * 共享内存点云的参考写端：生成旋转的螺旋点云，直接写入共享内存各列后发布
+  * 用法：shm_producer name [points] [fps] [frames]，frames为0时一直发布
+  */
+int main(int argc, char** argv)
+{
+	if (argc < 2) {
+		printf("usage: shm_producer name [points=1000000] [fps=30] [frames=0]\n");
+		return 1;
+	}
+	size_t points = argc > 2 ? (size_t)atol(argv[2]) : 1000000;
+	double fps = argc > 3 ? atof(argv[3]) : 30;
+	long frames = argc > 4 ? atol(argv[4]) : 0;
+
+	ShmRing ring;
+	if (!ring.Create(argv[1], DEFAULT_SHM_SLOTS, points)) {
+		printf("cannot create shared memory %s\n", argv[1]);
+		return 1;
+	}
+	printf("publishing %zu points at %.0f fps to %s\n", points, fps, argv[1]);
+
+	int64 interval = (int64)(getTickFrequency() / MAX(fps, 1.0));
+	int64 nextTick = getTickCount();
+	for (long n = 0; frames == 0 || n < frames; n++) {
+		//各列直接在共享内存中生成，不经过中间缓冲
+		ShmFrame frame = ring.BeginWrite();
+		float phase = (float)(n * 0.05);
+		parallel_for_(Range(0, (int)((points + 65535) / 65536)), [&](const Range& range) {
+			size_t end = MIN(points, (size_t)range.end * 65536);
+			for (size_t i = (size_t)range.start * 65536; i < end; i++) {
+				float t = (float)i / points;
+				float angle = t * 40 * (float)PI + phase;
+				float radius = 100 + 50 * sinf(t * 8 * (float)PI);
+				frame.x[i] = radius * cosf(angle);
+				frame.y[i] = t * 400 - 200;
+				frame.z[i] = radius * sinf(angle);
+				frame.intensity[i] = 50 + 150 * t;
+			}
+		});
+		ring.EndWrite(frame, points);
+
+		if (n % 100 == 0) {
+			printf("frame %llu\n", (unsigned long long)frame.frame);
+		}
+		nextTick += interval;
+		int64 remain = nextTick - getTickCount();
+		if (remain > 0) {
+			std::this_thread::sleep_for(std::chrono::microseconds((long long)(remain * 1e6 / getTickFrequency())));
+		} else {
+			nextTick = getTickCount();
+		}
+	}
+	return 0;
+}